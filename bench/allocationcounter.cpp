@@ -0,0 +1,49 @@
+#include "allocationcounter.h"
+#include <stddef.h>
+
+namespace {
+
+// Plain thread-locals in the executable need no allocation to reach, so
+// they are safe to touch from inside malloc.
+thread_local bool counting = false;
+thread_local qint64 allocations = 0;
+
+} // namespace
+
+extern "C" {
+
+void* __libc_malloc(size_t size) noexcept;
+void* __libc_calloc(size_t count, size_t size) noexcept;
+void* __libc_realloc(void* pointer, size_t size) noexcept;
+
+void* malloc(size_t size) noexcept {
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    if (counting) allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) noexcept {
+    if (counting) allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+} // extern "C"
+
+AllocationCounter::AllocationCounter()
+    : start(allocations)
+    , wasCounting(counting)
+{
+    counting = true;
+}
+
+AllocationCounter::~AllocationCounter() {
+    counting = wasCounting;
+}
+
+qint64 AllocationCounter::count() const {
+    return allocations - start;
+}
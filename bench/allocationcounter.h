@@ -0,0 +1,22 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts heap allocations (malloc, calloc, realloc and everything built on
+// them, operator new and Qt's containers included) made by the calling
+// thread while a counter is alive. Works by interposing glibc's allocator,
+// so it is only linked into the benchmark.
+class AllocationCounter {
+public:
+    AllocationCounter();
+    ~AllocationCounter();
+
+    qint64 count() const;
+
+private:
+    qint64 start;
+    bool wasCounting;
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,488 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QIdentityProxyModel>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTableView>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include "allocationcounter.h"
+#include "treegenerator.h"
+#include "filemodel.h"
+#include "fileoperations.h"
+#include "iconcache.h"
+#include "perftrace.h"
+#include "searchindex.h"
+
+// lotus-dir-bench: builds synthetic trees in a scratch folder and times the
+// file manager's hot paths on them. Results go out as one JSON document so
+// runs on the same machine can be diffed; progress goes to stderr.
+
+namespace {
+
+const int kRepeats = 3;
+const int kAllocationRows = 50000;
+const int kTimeoutMs = 30 * 60 * 1000;
+const int kStatFields[] = {FileModel::SizeColumn, FileModel::ModifiedColumn};
+
+struct Options {
+    QList<int> sizes;
+    int maxCopyEntries = 100000;
+    int fileSize = 4096;
+};
+
+void progress(const QString& message) {
+    fprintf(stderr, "bench: %s\n", qPrintable(message));
+}
+
+// Runs the event loop until done() holds. A ticking timer wakes the loop
+// so conditions that change on other threads get re-checked.
+bool waitFor(const std::function<bool()>& done, int timeoutMs = kTimeoutMs) {
+    QElapsedTimer timer;
+    timer.start();
+    QTimer tick;
+    tick.start(10);
+    while (!done()) {
+        if (timer.elapsed() > timeoutMs) return false;
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return true;
+}
+
+double milliseconds(qint64 nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+double median(QVector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values.isEmpty() ? 0 : values.at(values.size() / 2);
+}
+
+QJsonObject result(const char* benchmark, const char* shape, const TreeGenerator::Tree& tree) {
+    QJsonObject object;
+    object["benchmark"] = benchmark;
+    object["tree"] = shape;
+    object["entries"] = tree.entries();
+    return object;
+}
+
+// Lists the folder and waits for every row; the listing itself ends at
+// directoryLoaded, the rest is the chunked row insertion.
+bool loadDirectory(FileModel& model, const QString& path, int rows, qint64* loadedNs = nullptr,
+                   qint64* allRowsNs = nullptr) {
+    bool loaded = false;
+    QMetaObject::Connection connection = QObject::connect(&model, &FileModel::directoryLoaded,
+                                                          [&](const QString& loadedPath) {
+        if (loadedPath == path) loaded = true;
+    });
+    QElapsedTimer timer;
+    timer.start();
+    model.setRootPath(path);
+    bool ok = waitFor([&]() { return loaded; });
+    if (loadedNs) *loadedNs = timer.nsecsElapsed();
+    ok = ok && waitFor([&]() { return model.rowCount() >= rows; });
+    if (allRowsNs) *allRowsNs = timer.nsecsElapsed();
+    QObject::disconnect(connection);
+    return ok;
+}
+
+// Asks for every stat-backed cell and waits until all of them are filled,
+// so timed passes measure the steady state rather than the fetches. The
+// decoration goes first so the modes it needs ride in the same request.
+bool loadStatFields(FileModel& model, int firstRow, int lastRow) {
+    auto missing = [&]() {
+        bool anyMissing = false;
+        for (int row = firstRow; row <= lastRow; row++) {
+            model.data(model.index(row, FileModel::NameColumn), Qt::DecorationRole);
+            for (int column : kStatFields) {
+                if (model.isDir(model.index(row, 0)) && column == FileModel::SizeColumn) continue;
+                if (!model.data(model.index(row, column)).isValid()) anyMissing = true;
+            }
+        }
+        return anyMissing;
+    };
+    return waitFor([&]() { return !missing(); });
+}
+
+QJsonObject benchDirectoryLoad(const TreeGenerator::Tree& tree) {
+    QVector<double> loaded;
+    QVector<double> allRows;
+    QVector<double> reopened;
+    for (int i = 0; i < kRepeats; i++) {
+        FileModel model;
+        qint64 loadedNs = 0;
+        qint64 allRowsNs = 0;
+        loadDirectory(model, tree.root, tree.entries() + 1, &loadedNs, &allRowsNs);
+        loaded.append(milliseconds(loadedNs));
+        allRows.append(milliseconds(allRowsNs));
+
+        // Back again after a step up, served from the listing cache
+        loadDirectory(model, QFileInfo(tree.root).absolutePath(), 1);
+        qint64 reopenedNs = 0;
+        loadDirectory(model, tree.root, 1, &reopenedNs);
+        reopened.append(milliseconds(reopenedNs));
+    }
+
+    QJsonObject object = result("directory_load", "wide", tree);
+    object["listing_ms"] = median(loaded);
+    object["all_rows_ms"] = median(allRows);
+    object["all_rows_min_ms"] = *std::min_element(allRows.constBegin(), allRows.constEnd());
+    object["cached_reopen_ms"] = median(reopened);
+    return object;
+}
+
+QJsonObject benchModelData(const TreeGenerator::Tree& tree) {
+    FileModel model;
+    loadDirectory(model, tree.root, tree.entries() + 1);
+    loadStatFields(model, 0, model.rowCount() - 1);
+
+    const QList<QPair<const char*, int>> roles = {
+        {"display", Qt::DisplayRole},
+        {"decoration", Qt::DecorationRole},
+        {"font", Qt::FontRole},
+        {"alignment", Qt::TextAlignmentRole}
+    };
+    QJsonObject perRole;
+    qint64 totalCalls = 0;
+    qint64 totalNs = 0;
+    int valid = 0;
+    for (const auto& role : roles) {
+        const int columns = role.second == Qt::DecorationRole ? 1 : FileModel::ColumnCount;
+        QElapsedTimer timer;
+        timer.start();
+        for (int row = 0; row < model.rowCount(); row++) {
+            for (int column = 0; column < columns; column++) {
+                valid += model.data(model.index(row, column), role.second).isValid();
+            }
+        }
+        const qint64 ns = timer.nsecsElapsed();
+        const qint64 calls = qint64(model.rowCount()) * columns;
+        perRole[role.first] = double(ns) / qMax<qint64>(calls, 1);
+        totalCalls += calls;
+        totalNs += ns;
+    }
+
+    QJsonObject object = result("model_data", "wide", tree);
+    object["ns_per_call"] = perRole;
+    object["calls_per_second"] = totalCalls * 1e9 / qMax<qint64>(totalNs, 1);
+    object["valid_values"] = valid;
+    return object;
+}
+
+QJsonObject benchIconResolution(const TreeGenerator::Tree& tree) {
+    QStringList names;
+    names.reserve(tree.entries());
+    for (int i = 0; i < tree.entries(); i++) names.append(TreeGenerator::entryName(i, false));
+
+    const IconCache& icons = IconCache::instance();
+    int categories[IconCache::CategoryCount] = {};
+    QVector<double> runs;
+    qint64 allocations = 0;
+    for (int i = 0; i < kRepeats; i++) {
+        qint64 ns = 0;
+        {
+            AllocationCounter counter;
+            QElapsedTimer timer;
+            timer.start();
+            for (const QString& name : qAsConst(names)) {
+                categories[icons.categoryForName(name.constData(), name.size(), false, false)]++;
+            }
+            ns = timer.nsecsElapsed();
+            allocations += counter.count();
+        }
+        runs.append(double(ns) / qMax(names.size(), 1));
+    }
+
+    QJsonObject object = result("icon_resolution", "names", tree);
+    object["ns_per_name"] = median(runs);
+    object["allocations"] = allocations;
+    object["generic"] = categories[IconCache::Generic] / kRepeats;
+    return object;
+}
+
+QJsonObject benchSearch(const TreeGenerator::Tree& tree) {
+    SearchIndex index;
+    bool built = false;
+    QObject::connect(&index, &SearchIndex::indexProgress, [&](int, bool done) { built = built || done; });
+
+    QElapsedTimer timer;
+    timer.start();
+    index.preload(tree.root);
+    waitFor([&]() { return built; });
+    const qint64 buildNs = timer.nsecsElapsed();
+
+    int current = 0;
+    bool finished = false;
+    bool firstResults = false;
+    int matches = 0;
+    qint64 firstNs = 0;
+    QObject::connect(&index, &SearchIndex::resultsReady, [&](int gen, const QVector<SearchHit>&) {
+        if (gen == current && !firstResults) {
+            firstResults = true;
+            firstNs = timer.nsecsElapsed();
+        }
+    });
+    QObject::connect(&index, &SearchIndex::searchFinished, [&](int gen, int count, bool partial) {
+        if (gen == current && !partial) {
+            finished = true;
+            matches = count;
+        }
+    });
+
+    // A common prefix, a narrower one, a refinement of it and a miss
+    QJsonObject queries;
+    for (const char* text : {"report", "notes 1", "notes 12", "no such file"}) {
+        finished = false;
+        firstResults = false;
+        timer.restart();
+        current = index.search(tree.root, text);
+        waitFor([&]() { return finished; });
+        QJsonObject query;
+        query["ms"] = milliseconds(timer.nsecsElapsed());
+        query["first_results_ms"] = firstResults ? milliseconds(firstNs) : 0;
+        query["matches"] = matches;
+        queries[text] = query;
+    }
+
+    QJsonObject object = result("search", "deep", tree);
+    object["index_build_ms"] = milliseconds(buildNs);
+    object["queries"] = queries;
+    return object;
+}
+
+// Copies the tree, then trashes every file of the copy one by one (the
+// folders left behind are deleted, untimed).
+QJsonArray benchCopyAndTrash(const TreeGenerator::Tree& tree, const QString& scratch) {
+    FileOperationQueue queue;
+    bool finished = false;
+    QStringList errors;
+    QObject::connect(&queue, &FileOperationQueue::jobFinished, [&](int, bool, const QStringList& jobErrors) {
+        finished = true;
+        errors = jobErrors;
+    });
+    auto run = [&](FileOperationJob::Kind kind, const QStringList& sources, const QString& dest) {
+        finished = false;
+        QElapsedTimer timer;
+        timer.start();
+        queue.enqueue(kind, sources, dest);
+        waitFor([&]() { return finished; });
+        return timer.nsecsElapsed();
+    };
+
+    const QString dest = scratch + "/copy-" + QString::number(tree.entries());
+    QDir().mkpath(dest);
+    const qint64 copyNs = run(FileOperationJob::Copy, {tree.root}, dest);
+    QJsonObject copy = result("copy", "deep", tree);
+    copy["ms"] = milliseconds(copyNs);
+    copy["files_per_second"] = tree.files * 1e9 / qMax<qint64>(copyNs, 1);
+    copy["megabytes_per_second"] = tree.bytes / 1e6 * 1e9 / qMax<qint64>(copyNs, 1);
+    copy["errors"] = errors.size();
+
+    QStringList files;
+    QDirIterator it(dest, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) files.append(it.next());
+    const qint64 trashNs = run(FileOperationJob::Trash, files, QString());
+    QJsonObject trash = result("trash", "deep", tree);
+    trash["ms"] = milliseconds(trashNs);
+    trash["items_per_second"] = files.size() * 1e9 / qMax<qint64>(trashNs, 1);
+    trash["errors"] = errors.size();
+
+    run(FileOperationJob::Delete, {dest}, QString());
+    return {copy, trash};
+}
+
+// Counts what data() allocates while a list view repaints a full viewport
+// of a large folder. The probe sits between view and model and only counts
+// inside the model's data(). Display text is a new QString per cell by
+// nature; every other role has to come back without touching the heap.
+class AllocationProbe : public QIdentityProxyModel {
+public:
+    using QIdentityProxyModel::QIdentityProxyModel;
+
+    QVariant data(const QModelIndex& index, int role) const override {
+        const QModelIndex source = mapToSource(index);
+        AllocationCounter counter;
+        QVariant value = sourceModel()->data(source, role);
+        (role == Qt::DisplayRole ? displayAllocations : otherAllocations) += counter.count();
+        calls++;
+        return value;
+    }
+
+    void reset() {
+        calls = 0;
+        displayAllocations = 0;
+        otherAllocations = 0;
+    }
+
+    mutable qint64 calls = 0;
+    mutable qint64 displayAllocations = 0;
+    mutable qint64 otherAllocations = 0;
+};
+
+QJsonObject benchRepaintAllocations(const TreeGenerator::Tree& tree, bool* passed) {
+    FileModel model;
+    loadDirectory(model, tree.root, tree.entries() + 1);
+    AllocationProbe probe;
+    probe.setSourceModel(&model);
+
+    // Set up like the main window's list view
+    QTableView view;
+    view.setModel(&probe);
+    view.setShowGrid(false);
+    view.setAlternatingRowColors(true);
+    view.horizontalHeader()->setStretchLastSection(true);
+    view.verticalHeader()->setVisible(false);
+    view.verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view.resize(1280, 1600);
+    view.show();
+    view.scrollTo(probe.index(probe.rowCount() / 2, 0), QAbstractItemView::PositionAtTop);
+
+    // The first paints fetch stat fields, rasterize icons and queue
+    // thumbnails; measure once everything on screen is loaded, so the
+    // measured paint covers thumbnail hits and cached failures alike.
+    view.viewport()->grab();
+    const int firstRow = view.rowAt(0);
+    int lastRow = view.rowAt(view.viewport()->height() - 1);
+    if (lastRow < 0) lastRow = probe.rowCount() - 1;
+    loadStatFields(model, firstRow, lastRow);
+    view.viewport()->grab();
+    ThumbnailCache* thumbnails = model.thumbnailCache();
+    waitFor([&]() { return thumbnails->queuedLoads() == 0; });
+    view.viewport()->grab();
+
+    probe.reset();
+    view.viewport()->grab();
+
+    *passed = probe.otherAllocations == 0;
+    QJsonObject object = result("repaint_allocations", "wide", tree);
+    object["painted_rows"] = lastRow - firstRow + 1;
+    object["data_calls"] = probe.calls;
+    object["display_allocations"] = probe.displayAllocations;
+    object["other_allocations"] = probe.otherAllocations;
+    object["passed"] = *passed;
+    return object;
+}
+
+QList<int> parseSizes(const QString& text) {
+    QList<int> sizes;
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        QString size = part.trimmed().toLower();
+        int factor = 1;
+        if (size.endsWith('k')) factor = 1000;
+        if (size.endsWith('m')) factor = 1000000;
+        if (factor > 1) size.chop(1);
+        bool ok = false;
+        const int value = size.toInt(&ok);
+        if (ok && value > 0) sizes.append(value * factor);
+    }
+    return sizes;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    // The allocation check paints a real view; no display is needed for that
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    app.setApplicationName("lotus-dir-bench");
+    app.setOrganizationName("Lotus-DIR");
+    // Claims this thread's trace ring now; its one-time allocation would
+    // otherwise land in whichever check first records a slow data() call
+    PerfTrace::record("bench", PerfTrace::now(), 0);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times Lotus-DIR's hot paths on synthetic folder trees.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "Tree sizes to run, e.g. 1k,100k,1m.", "list", "1k,100k,1m");
+    QCommandLineOption maxCopyOption("max-copy", "Largest tree to copy and trash.", "entries", "100000");
+    QCommandLineOption fileSizeOption("file-size", "Bytes per file in copied trees.", "bytes", "4096");
+    QCommandLineOption dirOption("dir", "Where to create the scratch folder.", "path", QDir::tempPath());
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON here instead of stdout.", "file");
+    parser.addOptions({sizesOption, maxCopyOption, fileSizeOption, dirOption, outputOption});
+    parser.process(app);
+
+    Options options;
+    options.sizes = parseSizes(parser.value(sizesOption));
+    options.maxCopyEntries = parser.value(maxCopyOption).toInt();
+    options.fileSize = parser.value(fileSizeOption).toInt();
+
+    QTemporaryDir scratch(parser.value(dirOption) + "/lotus-dir-bench-XXXXXX");
+    if (!scratch.isValid()) {
+        fprintf(stderr, "bench: cannot create a scratch folder in %s\n", qPrintable(parser.value(dirOption)));
+        return 2;
+    }
+    // Caches, settings and the trash all stay inside the scratch folder
+    for (const char* variable : {"XDG_CACHE_HOME", "XDG_CONFIG_HOME", "XDG_DATA_HOME"}) {
+        const QString path = scratch.path() + "/" + QString(variable).toLower();
+        QDir().mkpath(path);
+        qputenv(variable, QFile::encodeName(path));
+    }
+    IconCache::instance().prepare({QSize(16, 16)});
+
+    const QDateTime started = QDateTime::currentDateTimeUtc();
+    QJsonArray results;
+    bool passed = true;
+    progress(QString("allocation check, %1 rows").arg(kAllocationRows));
+    TreeGenerator::Tree allocationTree = TreeGenerator::wide(scratch.path() + "/alloc", kAllocationRows);
+    results.append(benchRepaintAllocations(allocationTree, &passed));
+
+    for (int size : qAsConst(options.sizes)) {
+        progress(QString("generating trees of %1 entries").arg(size));
+        const QString suffix = QString::number(size);
+        TreeGenerator::Tree wide = TreeGenerator::wide(scratch.path() + "/wide-" + suffix, size);
+        const int fileSize = size <= options.maxCopyEntries ? options.fileSize : 0;
+        TreeGenerator::Tree deep = TreeGenerator::deep(scratch.path() + "/deep-" + suffix, size, fileSize);
+
+        progress("directory load");
+        results.append(benchDirectoryLoad(wide));
+        progress("model data");
+        results.append(benchModelData(wide));
+        progress("icon resolution");
+        results.append(benchIconResolution(wide));
+        progress("search");
+        results.append(benchSearch(deep));
+        if (size <= options.maxCopyEntries) {
+            progress("copy and trash");
+            for (const QJsonValue& value : benchCopyAndTrash(deep, scratch.path())) results.append(value);
+        }
+    }
+
+    QJsonObject machine;
+    machine["cpus"] = QThread::idealThreadCount();
+    machine["architecture"] = QSysInfo::currentCpuArchitecture();
+    machine["kernel"] = QSysInfo::kernelVersion();
+    machine["qt"] = qVersion();
+    QJsonObject report;
+    report["version"] = 1;
+    report["started"] = started.toString(Qt::ISODate);
+    report["machine"] = machine;
+    report["results"] = results;
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            fprintf(stderr, "bench: cannot write %s\n", qPrintable(parser.value(outputOption)));
+            return 2;
+        }
+    } else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    if (!passed) progress("FAILED: data() allocated outside the display role during a repaint");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "treegenerator.h"
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char* const kStems[] = {"report", "IMG", "notes", "track", "backup", "main", "Invoice", "draft"};
+const char* const kSuffixes[] = {"txt", "pdf", "docx", "png", "xlsx", "mp3", "jpg", "zip", "cpp", "mp4", "md", "json", ""};
+const int kStemCount = sizeof(kStems) / sizeof(kStems[0]);
+const int kSuffixCount = sizeof(kSuffixes) / sizeof(kSuffixes[0]);
+
+// A valid 1x1 PNG, so wide trees have images that thumbnail; the JPEGs
+// and videos stay empty and exercise the failure path
+const char kTinyPng[] =
+    "\x89\x50\x4e\x47\x0d\x0a\x1a\x0a\x00\x00\x00\x0d\x49\x48\x44\x52\x00\x00\x00\x01"
+    "\x00\x00\x00\x01\x08\x06\x00\x00\x00\x1f\x15\xc4\x89\x00\x00\x00\x0b\x49\x44\x41"
+    "\x54\x78\x9c\x63\x60\x00\x02\x00\x00\x05\x00\x01\x7a\x5e\xab\x3f\x00\x00\x00\x00"
+    "\x49\x45\x4e\x44\xae\x42\x60\x82";
+
+const int kWideDirEvery = 64;
+// Per folder of a deep tree
+const int kDeepFiles = 24;
+const int kDeepDirs = 8;
+
+bool createFile(int dirFd, const QByteArray& name, const QByteArray& content) {
+    int fd = ::openat(dirFd, name.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = content.isEmpty() || ::write(fd, content.constData(), size_t(content.size())) == content.size();
+    ::close(fd);
+    return ok;
+}
+
+bool createDir(int dirFd, const QByteArray& name) {
+    return ::mkdirat(dirFd, name.constData(), 0755) == 0 || errno == EEXIST;
+}
+
+} // namespace
+
+QString TreeGenerator::entryName(int i, bool isDir) {
+    if (isDir) return QString("Folder %1").arg(i);
+    const char* suffix = kSuffixes[i % kSuffixCount];
+    QString name = QString("%1 %2").arg(kStems[(i / kSuffixCount) % kStemCount]).arg(i);
+    return *suffix ? name + '.' + suffix : name;
+}
+
+TreeGenerator::Tree TreeGenerator::wide(const QString& root, int entries) {
+    Tree tree;
+    tree.root = root;
+    ::mkdir(QFile::encodeName(root).constData(), 0755);
+    int dirFd = ::open(QFile::encodeName(root).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) return tree;
+
+    const QByteArray png = QByteArray::fromRawData(kTinyPng, sizeof(kTinyPng) - 1);
+    for (int i = 0; i < entries; i++) {
+        const bool isDir = i % kWideDirEvery == kWideDirEvery - 1;
+        const QByteArray name = QFile::encodeName(entryName(i, isDir));
+        const QByteArray content = name.endsWith(".png") ? png : QByteArray();
+        if (isDir ? createDir(dirFd, name) : createFile(dirFd, name, content)) {
+            if (isDir) tree.dirs++;
+            else tree.files++;
+        }
+    }
+    ::close(dirFd);
+    return tree;
+}
+
+// Breadth first: each folder gets its files and subfolders before the
+// next folder is filled, until the entry budget runs out.
+TreeGenerator::Tree TreeGenerator::deep(const QString& root, int entries, int fileSize) {
+    Tree tree;
+    tree.root = root;
+    const QByteArray content(qMax(fileSize, 0), 'x');
+    ::mkdir(QFile::encodeName(root).constData(), 0755);
+
+    QVector<QByteArray> queue = {QFile::encodeName(root)};
+    int next = 0;
+    for (int head = 0; head < queue.size() && next < entries; head++) {
+        int dirFd = ::open(queue.at(head).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) continue;
+
+        for (int i = 0; i < kDeepFiles && next < entries; i++, next++) {
+            if (createFile(dirFd, QFile::encodeName(entryName(next, false)), content)) {
+                tree.files++;
+                tree.bytes += content.size();
+            }
+        }
+        for (int i = 0; i < kDeepDirs && next < entries; i++, next++) {
+            const QByteArray name = QFile::encodeName(entryName(next, true));
+            if (createDir(dirFd, name)) {
+                tree.dirs++;
+                queue.append(queue.at(head) + '/' + name);
+            }
+        }
+        ::close(dirFd);
+    }
+    return tree;
+}
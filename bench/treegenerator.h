@@ -0,0 +1,32 @@
+#ifndef TREEGENERATOR_H
+#define TREEGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+
+// Synthetic folder trees for the benchmarks. A wide tree is one folder
+// holding every entry; a deep one spreads them over nested folders a few
+// levels down, the way a source checkout or a photo library does. Names
+// mix common suffixes (none of them thumbnailed) and unpadded numbers, so
+// icon lookup and natural sorting see realistic input.
+class TreeGenerator {
+public:
+    struct Tree {
+        QString root;
+        int files = 0;
+        int dirs = 0;
+        qint64 bytes = 0;
+
+        int entries() const { return files + dirs; }
+    };
+
+    // Every 64th entry is a folder, the rest are empty files.
+    static Tree wide(const QString& root, int entries);
+    // Files get fileSize bytes each, so copies have something to move.
+    static Tree deep(const QString& root, int entries, int fileSize);
+
+    // The name of entry i, as wide() and deep() create it.
+    static QString entryName(int i, bool isDir);
+};
+
+#endif // TREEGENERATOR_H
@@ -0,0 +1,478 @@
+#include "accesslog.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+namespace {
+
+// On-disk layout: header, then records back to back, each a RecordHeader
+// and its path (UTF-16) padded to 8 bytes. Past `used` is zero-filled slack.
+const char kFileMagic[8] = {'L', 'D', 'I', 'R', 'L', 'O', 'G', '1'};
+const quint32 kFileVersion = 1;
+
+struct LogFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 reserved;
+    qint64 used;
+};
+
+// An access adds its own score to the path's; a snapshot (written by
+// compaction) carries a path's whole score. Replay treats both alike.
+enum RecordType : quint8 {
+    AccessRecord = 1,
+    SnapshotRecord = 2
+};
+
+struct RecordHeader {
+    quint32 pathLength;
+    quint8 type;
+    quint8 isDir;
+    quint16 reserved;
+    qint64 time;
+    double score;
+};
+
+// The file grows this much at a time, so appends rarely remap
+const qint64 kGrowBytes = 64 * 1024;
+
+// A week-old access counts half as much as one made now. Files opened
+// count double a folder passed through on the way to them.
+const double kHalfLifeMs = 7.0 * 24 * 60 * 60 * 1000;
+const double kFileWeight = 1.0;
+const double kDirWeight = 0.5;
+
+// Paths kept ranked for recents(), and kept at all through a compaction
+const int kRankedEntries = 500;
+const int kMaxEntries = 5000;
+
+// Compact once this many records were written beyond one per live path
+const int kCompactSlack = 2048;
+
+qint64 recordSize(int pathLength) {
+    return (qint64(sizeof(RecordHeader)) + qint64(pathLength) * 2 + 7) & ~qint64(7);
+}
+
+// log2(2^a + 2^b), without leaving log space
+double addScores(double a, double b) {
+    if (a < b) std::swap(a, b);
+    return a + std::log2(1.0 + std::exp2(b - a));
+}
+
+void writeRecord(uchar* at, quint8 type, const AccessEntry& entry, double score) {
+    RecordHeader record;
+    record.pathLength = quint32(entry.path.size());
+    record.type = type;
+    record.isDir = entry.isDir ? 1 : 0;
+    record.reserved = 0;
+    record.time = entry.lastAccess;
+    record.score = score;
+    memcpy(at, &record, sizeof(record));
+    memcpy(at + sizeof(record), entry.path.constData(), size_t(entry.path.size()) * 2);
+}
+
+// Holds the log's inter-process lock for a scope; a no-op without a lock file.
+class LogLock {
+public:
+    explicit LogLock(int fd) : fd(fd) {
+        while (fd >= 0 && ::flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+    ~LogLock() {
+        if (fd >= 0) ::flock(fd, LOCK_UN);
+    }
+
+private:
+    int fd;
+};
+
+} // namespace
+
+// AccessLogCompactor
+
+AccessLogCompactor::AccessLogCompactor(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void AccessLogCompactor::compact(const QString& fileName, const QVector<AccessEntry>& entries) {
+    qint64 used = sizeof(LogFileHeader);
+    for (const AccessEntry& entry : entries) used += recordSize(entry.path.size());
+
+    // Zero-filled, so the padding and the slack past `used` need no writes
+    QByteArray data(int(((used + kGrowBytes - 1) / kGrowBytes) * kGrowBytes), '\0');
+    uchar* at = reinterpret_cast<uchar*>(data.data());
+    LogFileHeader header;
+    memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.reserved = 0;
+    header.used = used;
+    memcpy(at, &header, sizeof(header));
+    at += sizeof(header);
+    for (const AccessEntry& entry : entries) {
+        writeRecord(at, SnapshotRecord, entry, entry.score);
+        at += recordSize(entry.path.size());
+    }
+
+    QFile file(fileName);
+    const bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        && file.write(data) == data.size() && file.flush();
+    if (!ok) qWarning() << "Cannot compact access log" << fileName << file.errorString();
+    emit compacted(fileName, ok);
+}
+
+// AccessLog
+
+AccessLog::AccessLog(QObject *parent)
+    : QObject(parent)
+    , fileName(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+               + "/Lotus-DIR/access-log.bin")
+    , lockFd(-1)
+    , map(nullptr)
+    , mappedBytes(0)
+    , used(0)
+    , fileDevice(0)
+    , fileInode(0)
+    , loaded(false)
+    , appendedRecords(0)
+    , compacting(false)
+    , snapshotDevice(0)
+    , snapshotInode(0)
+    , compactor(new AccessLogCompactor)
+{
+    qRegisterMetaType<AccessEntry>("AccessEntry");
+    qRegisterMetaType<QVector<AccessEntry>>("QVector<AccessEntry>");
+
+    compactor->moveToThread(&compactorThread);
+    connect(&compactorThread, &QThread::finished, compactor, &QObject::deleteLater);
+    connect(compactor, &AccessLogCompactor::compacted, this, &AccessLog::handleCompacted);
+    compactorThread.setObjectName("AccessLogCompactor");
+    compactorThread.start();
+}
+
+AccessLog::~AccessLog() {
+    compactorThread.quit();
+    compactorThread.wait();
+    closeFile();
+    if (lockFd >= 0) ::close(lockFd);
+}
+
+void AccessLog::record(const QString& path, bool isDir) {
+    load();
+    LogLock lock(lockFd);
+    catchUp();
+
+    AccessEntry access;
+    access.path = path;
+    access.isDir = isDir;
+    access.lastAccess = QDateTime::currentMSecsSinceEpoch();
+    access.score = std::log2(isDir ? kDirWeight : kFileWeight) + double(access.lastAccess) / kHalfLifeMs;
+    rank(apply(path, isDir, access.lastAccess, access.score));
+    append(AccessRecord, access, access.score);
+    if (compacting) sinceSnapshot.append(access);
+
+    if (!compacting && (entries.size() > 2 * kMaxEntries
+                        || appendedRecords > entries.size() + kCompactSlack)) {
+        compact();
+    }
+}
+
+QVector<SearchHit> AccessLog::recents(int limit) {
+    load();
+    {
+        LogLock lock(lockFd);
+        catchUp();
+    }
+
+    QVector<SearchHit> hits;
+    for (int entry : qAsConst(ranking)) {
+        if (hits.size() >= limit) break;
+        const AccessEntry& access = entries.at(entry);
+        // Deleted or moved away since; the entry fades out on its own
+        if (!QFileInfo::exists(access.path)) continue;
+        SearchHit hit;
+        hit.path = access.path;
+        hit.isDir = access.isDir;
+        hits.append(hit);
+    }
+    return hits;
+}
+
+// Replays the log into the score table.
+void AccessLog::load() {
+    if (loaded) return;
+    loaded = true;
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    lockFd = ::open(QFile::encodeName(fileName + ".lock").constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lockFd < 0) qWarning() << "Cannot open access log lock" << fileName;
+    LogLock lock(lockFd);
+    if (mapFile()) replay(sizeof(LogFileHeader), false);
+    rebuildRanking();
+}
+
+// Folds the records from offset up to the header's used length into the
+// scores. Live records (appended by another instance since we last looked)
+// are ranked as they come, and kept for the compacted log if one is being
+// written. A log that is damaged from some record on is cut back to the
+// records before it. Called with the lock held.
+void AccessLog::replay(qint64 offset, bool live) {
+    qint64 claimed;
+    memcpy(&claimed, map + offsetof(LogFileHeader, used), sizeof(claimed));
+    if (claimed > mappedBytes && !remap(file.size())) return;
+    const qint64 end = qMin(claimed, mappedBytes);
+
+    while (offset + qint64(sizeof(RecordHeader)) <= end) {
+        RecordHeader record;
+        memcpy(&record, map + offset, sizeof(record));
+        const qint64 size = recordSize(int(qMin(record.pathLength, quint32(INT_MAX / 4))));
+        if ((record.type != AccessRecord && record.type != SnapshotRecord)
+            || offset + size > end || !std::isfinite(record.score)) {
+            break;
+        }
+        AccessEntry access;
+        access.path = QString(reinterpret_cast<const QChar*>(map + offset + sizeof(record)), int(record.pathLength));
+        access.isDir = record.isDir;
+        access.score = record.score;
+        access.lastAccess = record.time;
+        const int entry = apply(access.path, access.isDir, access.lastAccess, access.score);
+        if (live) rank(entry);
+        if (live && compacting) sinceSnapshot.append(access);
+        if (record.type == AccessRecord) appendedRecords++;
+        offset += size;
+    }
+    used = offset;
+    if (offset != claimed) {
+        qWarning() << "Access log damaged; keeping" << entries.size() << "paths" << fileName;
+        memcpy(map + offsetof(LogFileHeader, used), &used, sizeof(used));
+    }
+}
+
+// Folds in what other instances appended since we last looked. If one of
+// them compacted the log meanwhile it is a different file now, and the
+// scores are reloaded from it; returns false then. Without a log (it
+// could not be opened) the scores just live in memory. Called with the lock held.
+bool AccessLog::catchUp() {
+    if (!map) return true;
+    struct stat st;
+    if (::stat(QFile::encodeName(fileName).constData(), &st) == 0
+        && quint64(st.st_dev) == fileDevice && quint64(st.st_ino) == fileInode) {
+        replay(used, true);
+        return true;
+    }
+
+    closeFile();
+    entries.clear();
+    entryIndex.clear();
+    appendedRecords = 0;
+    if (mapFile()) replay(sizeof(LogFileHeader), false);
+    rebuildRanking();
+    return false;
+}
+
+// Opens and maps the log, starting a new one if it is missing or not ours.
+// Called with the lock held.
+bool AccessLog::mapFile() {
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open access log" << fileName << file.errorString();
+        return false;
+    }
+
+    LogFileHeader header;
+    const bool valid = file.size() >= kGrowBytes
+        && file.read(reinterpret_cast<char*>(&header), sizeof(header)) == qint64(sizeof(header))
+        && memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) == 0
+        && header.version == kFileVersion
+        && header.used >= qint64(sizeof(header)) && header.used <= file.size();
+    if (!valid) {
+        memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+        header.version = kFileVersion;
+        header.reserved = 0;
+        header.used = sizeof(header);
+        if (!file.resize(0) || !file.resize(kGrowBytes) || !file.seek(0)
+            || file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))
+            || !file.flush()) {
+            closeFile();
+            return false;
+        }
+    }
+
+    struct stat st;
+    if (fstat(file.handle(), &st) != 0 || !remap(file.size())) {
+        closeFile();
+        return false;
+    }
+    fileDevice = quint64(st.st_dev);
+    fileInode = quint64(st.st_ino);
+    used = header.used;
+    return true;
+}
+
+// Maps the first bytes of the log, growing the file to that size if it is
+// smaller. Another instance may have grown it already.
+bool AccessLog::remap(qint64 bytes) {
+    if (map) file.unmap(map);
+    map = file.size() >= bytes || file.resize(bytes) ? file.map(0, bytes) : nullptr;
+    if (!map) {
+        qWarning() << "Cannot map access log" << fileName << file.errorString();
+        closeFile();
+        return false;
+    }
+    mappedBytes = bytes;
+    return true;
+}
+
+void AccessLog::closeFile() {
+    if (map) file.unmap(map);
+    map = nullptr;
+    mappedBytes = 0;
+    used = 0;
+    fileDevice = 0;
+    fileInode = 0;
+    file.close();
+}
+
+// Writes the record into the mapping first and only then counts it in the
+// header, so a crash halfway leaves the log as it was. Called with the lock
+// held, after catchUp(), so used is the header's.
+bool AccessLog::append(quint8 type, const AccessEntry& entry, double score) {
+    if (!map) return false;
+
+    const qint64 size = recordSize(entry.path.size());
+    if (used + size > mappedBytes) {
+        const qint64 grown = ((used + size + kGrowBytes - 1) / kGrowBytes) * kGrowBytes;
+        if (!remap(qMax(grown, file.size()))) return false;
+    }
+
+    writeRecord(map + used, type, entry, score);
+    used += size;
+    memcpy(map + offsetof(LogFileHeader, used), &used, sizeof(used));
+    appendedRecords++;
+    return true;
+}
+
+// Folds a record into its path's score; returns the entry.
+int AccessLog::apply(const QString& path, bool isDir, qint64 time, double score) {
+    auto it = entryIndex.constFind(path);
+    int entry;
+    if (it == entryIndex.constEnd()) {
+        entry = entries.size();
+        AccessEntry access;
+        access.path = path;
+        access.isDir = isDir;
+        access.score = score;
+        access.lastAccess = time;
+        entries.append(access);
+        entryIndex.insert(path, entry);
+    } else {
+        entry = it.value();
+        AccessEntry& access = entries[entry];
+        access.isDir = isDir;
+        access.score = addScores(access.score, score);
+        access.lastAccess = qMax(access.lastAccess, time);
+    }
+    return entry;
+}
+
+// The entry's score went up: it may enter the ranking or climb it. Bounded
+// by the ranking's size, not by the number of paths.
+void AccessLog::rank(int entry) {
+    const double score = entries.at(entry).score;
+    int position = ranking.indexOf(entry);
+    if (position < 0) {
+        if (ranking.size() >= kRankedEntries) {
+            if (entries.at(ranking.last()).score >= score) return;
+            ranking.removeLast();
+        }
+        ranking.append(entry);
+        position = ranking.size() - 1;
+    }
+    while (position > 0 && entries.at(ranking.at(position - 1)).score < score) {
+        std::swap(ranking[position - 1], ranking[position]);
+        position--;
+    }
+}
+
+void AccessLog::rebuildRanking() {
+    ranking.resize(entries.size());
+    for (int i = 0; i < ranking.size(); i++) ranking[i] = i;
+    const int ranked = qMin(kRankedEntries, ranking.size());
+    std::partial_sort(ranking.begin(), ranking.begin() + ranked, ranking.end(), [this](int a, int b) {
+        return entries.at(a).score > entries.at(b).score;
+    });
+    ranking.resize(ranked);
+}
+
+// Forgets all but the kMaxEntries best paths.
+void AccessLog::prune() {
+    if (entries.size() <= kMaxEntries) return;
+
+    QVector<int> order(entries.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+    std::nth_element(order.begin(), order.begin() + kMaxEntries, order.end(), [this](int a, int b) {
+        return entries.at(a).score > entries.at(b).score;
+    });
+    order.resize(kMaxEntries);
+
+    QVector<AccessEntry> kept;
+    kept.reserve(kMaxEntries);
+    entryIndex.clear();
+    for (int entry : qAsConst(order)) {
+        entryIndex.insert(entries.at(entry).path, kept.size());
+        kept.append(entries.at(entry));
+    }
+    entries = kept;
+    rebuildRanking();
+}
+
+// Hands a snapshot of every score to the compactor. Accesses recorded
+// meanwhile, here or by another instance, still go to the current log,
+// and are replayed into the compacted one once it replaces it. Each
+// instance writes its own scratch file.
+void AccessLog::compact() {
+    prune();
+    compacting = true;
+    sinceSnapshot.clear();
+    snapshotDevice = fileDevice;
+    snapshotInode = fileInode;
+    const QString compactedName = fileName + ".compact." + QString::number(QCoreApplication::applicationPid());
+    QMetaObject::invokeMethod(compactor, "compact", Qt::QueuedConnection,
+                              Q_ARG(QString, compactedName), Q_ARG(QVector<AccessEntry>, entries));
+}
+
+void AccessLog::handleCompacted(const QString& compactedName, bool ok) {
+    LogLock lock(lockFd);
+    // Another instance compacted the log meanwhile, and its copy already
+    // holds everything this snapshot does
+    const bool current = ok && catchUp() && fileDevice == snapshotDevice && fileInode == snapshotInode;
+    compacting = false;
+    if (!current) {
+        QFile::remove(compactedName);
+        sinceSnapshot.clear();
+        return;
+    }
+
+    closeFile();
+    if (::rename(QFile::encodeName(compactedName).constData(), QFile::encodeName(fileName).constData()) != 0) {
+        qWarning() << "Cannot replace access log with" << compactedName;
+    }
+    appendedRecords = 0;
+    if (mapFile()) {
+        for (const AccessEntry& access : qAsConst(sinceSnapshot)) append(AccessRecord, access, access.score);
+    }
+    sinceSnapshot.clear();
+}
@@ -0,0 +1,106 @@
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include "searchindex.h"
+
+// One path's standing in the access log. The frecency score is
+// log2(sum of weight * 2^(age / half-life)) with ages counted from the
+// Unix epoch: every score decays at the same rate, so only an access ever
+// reorders anything, and keeping it in log form means it never overflows.
+struct AccessEntry {
+    QString path;
+    bool isDir = false;
+    double score = 0;
+    qint64 lastAccess = 0; // msecs since epoch
+};
+
+// Rewrites the log as one snapshot record per path on a background thread,
+// so compaction never stalls the GUI.
+class AccessLogCompactor : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AccessLogCompactor(QObject *parent = nullptr);
+
+public slots:
+    void compact(const QString& fileName, const QVector<AccessEntry>& entries);
+
+signals:
+    void compacted(const QString& fileName, bool ok);
+};
+
+// Files opened and folders visited, kept in an append-only log under
+// ~/.local/share/Lotus-DIR. The log is memory-mapped and grown in chunks:
+// recording an access writes one record into the mapping and bumps the
+// used length in the header, so a crash loses at most that record. Scores
+// are folded in as records arrive and the best paths are kept ranked, so
+// recents() costs the same however long the history is. Once the log
+// holds mostly superseded records it is compacted in the background.
+// Loaded on first use, to keep it off the start-up path. Every running
+// instance shares the log: each takes a lock file's flock around touching
+// it and first folds in what the others appended, or reloads the log if
+// another instance compacted it into a new file.
+class AccessLog : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AccessLog(QObject *parent = nullptr);
+    ~AccessLog();
+
+    void record(const QString& path, bool isDir);
+    // Up to limit of the most frecent paths that still exist, best first.
+    QVector<SearchHit> recents(int limit);
+
+private slots:
+    void handleCompacted(const QString& compactedName, bool ok);
+
+private:
+    void load();
+    bool mapFile();
+    bool remap(qint64 bytes);
+    void closeFile();
+    bool catchUp();
+    void replay(qint64 offset, bool live);
+    bool append(quint8 type, const AccessEntry& entry, double value);
+    int apply(const QString& path, bool isDir, qint64 time, double score);
+    void rank(int entry);
+    void rebuildRanking();
+    void prune();
+    void compact();
+
+    QString fileName;
+    int lockFd;
+    QFile file;
+    uchar* map;
+    qint64 mappedBytes;
+    qint64 used;
+    // Identity of the mapped log, to notice it being replaced
+    quint64 fileDevice;
+    quint64 fileInode;
+    bool loaded;
+
+    QVector<AccessEntry> entries;
+    QHash<QString, int> entryIndex;
+    // Best entries first; only an access can move one in or up
+    QVector<int> ranking;
+
+    // Records written since the last compaction, and accesses made while
+    // one runs (replayed into the compacted log)
+    int appendedRecords;
+    bool compacting;
+    QVector<AccessEntry> sinceSnapshot;
+    quint64 snapshotDevice;
+    quint64 snapshotInode;
+    QThread compactorThread;
+    AccessLogCompactor* compactor;
+};
+
+Q_DECLARE_METATYPE(AccessEntry)
+
+#endif // ACCESSLOG_H
@@ -0,0 +1,365 @@
+#include "contentsearch.h"
+#include "simdsearch.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace {
+
+const int kFlushIntervalMs = 50;
+const int kMaxMatches = 10000;
+const int kMaxHitsPerFile = 50;
+const int kContextBytes = 200;
+const int kContextLead = 60;
+const qint64 kMaxFileSize = 512LL * 1024 * 1024;
+// Files are read in windows this big, so a new query interrupts large ones
+// quickly, plus up to kMaxCarry bytes of an unfinished line carried over.
+const size_t kReadWindow = 1024 * 1024;
+const size_t kMaxCarry = 256 * 1024;
+// Paths queued per scanner; past that the walker waits for the scanners
+const size_t kLaneCapacity = 1024;
+
+// One bounded deque per scanner thread. The tree walker deals paths
+// round-robin, waiting while a lane is full; owners take from the front and
+// idle threads steal from the back of the others, so one directory full of
+// huge files cannot stall the rest.
+class WorkQueues {
+public:
+    explicit WorkQueues(int count)
+        : lanes(count)
+        , queued(0)
+        , producing(true)
+    {
+        for (auto& lane : lanes) lane.reset(new Lane);
+    }
+
+    void push(int lane, QByteArray path) {
+        {
+            QMutexLocker locker(&lanes[lane]->mutex);
+            while (lanes[lane]->items.size() >= kLaneCapacity) lanes[lane]->space.wait(&lanes[lane]->mutex);
+            lanes[lane]->items.push_back(std::move(path));
+        }
+        queued++;
+        available.wakeOne();
+    }
+
+    // Blocks until work arrives; false once the walk is over and every lane is empty.
+    bool pop(int self, QByteArray& path) {
+        while (true) {
+            if (take(self, path, true)) return true;
+            for (size_t i = 1; i < lanes.size(); i++) {
+                if (take(int((self + i) % lanes.size()), path, false)) return true;
+            }
+            if (!producing.load() && queued.load() == 0) return false;
+
+            QMutexLocker locker(&idleMutex);
+            if (producing.load() && queued.load() == 0) available.wait(&idleMutex, 10);
+        }
+    }
+
+    void finish() {
+        producing = false;
+        available.wakeAll();
+    }
+
+    int size() const { return int(lanes.size()); }
+
+private:
+    struct Lane {
+        QMutex mutex;
+        QWaitCondition space;
+        std::deque<QByteArray> items;
+    };
+
+    bool take(int lane, QByteArray& path, bool front) {
+        QMutexLocker locker(&lanes[lane]->mutex);
+        std::deque<QByteArray>& items = lanes[lane]->items;
+        if (items.empty()) return false;
+        if (front) {
+            path = std::move(items.front());
+            items.pop_front();
+        } else {
+            path = std::move(items.back());
+            items.pop_back();
+        }
+        queued--;
+        lanes[lane]->space.wakeOne();
+        return true;
+    }
+
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<int> queued;
+    std::atomic<bool> producing;
+    QMutex idleMutex;
+    QWaitCondition available;
+};
+
+} // namespace
+
+// ContentSearchWorker
+
+ContentSearchWorker::ContentSearchWorker(std::atomic<int>* generation, QObject *parent)
+    : QObject(parent)
+    , generation(generation)
+    , queryGeneration(0)
+    , matches(0)
+    , filesScanned(0)
+{
+}
+
+void ContentSearchWorker::search(int gen, const QString& root, const QString& text) {
+    if (gen != generation->load()) return;
+
+    queryGeneration = gen;
+    matches = 0;
+    filesScanned = 0;
+    pendingHits.clear();
+
+    // The kernels match bytes, so fold ASCII case up front; other
+    // characters must match exactly in their UTF-8 form.
+    needle = text.toUtf8();
+    for (char& c : needle) {
+        if (c >= 'A' && c <= 'Z') c = char(c + ('a' - 'A'));
+    }
+
+    WorkQueues queues(qMax(2, QThread::idealThreadCount()));
+    std::vector<std::thread> scanners;
+    std::atomic<int> running(queues.size());
+    for (int i = 0; i < queues.size(); i++) {
+        scanners.emplace_back([this, &queues, &running, i]() {
+            QByteArray buffer;
+            QByteArray path;
+            while (queues.pop(i, path)) {
+                if (!superseded()) scanFile(path, buffer);
+            }
+            running--;
+        });
+    }
+
+    // Walk the tree here while the scanners work. Hidden entries are skipped
+    // like in the filename index, and symlinks are not followed.
+    QElapsedTimer flushTimer;
+    flushTimer.start();
+    QVector<QByteArray> dirs{QFile::encodeName(root)};
+    int nextLane = 0;
+    while (!dirs.isEmpty() && !superseded()) {
+        const QByteArray dir = dirs.takeLast();
+        DIR* d = ::opendir(dir.constData());
+        if (!d) continue;
+
+        const QByteArray prefix = dir.endsWith('/') ? dir : dir + '/';
+        while (struct dirent* entry = ::readdir(d)) {
+            if (entry->d_name[0] == '.') continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (::fstatat(::dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                dirs.append(prefix + entry->d_name);
+            } else if (type == DT_REG) {
+                queues.push(nextLane, prefix + entry->d_name);
+                nextLane = (nextLane + 1) % queues.size();
+            }
+        }
+        ::closedir(d);
+
+        if (flushTimer.elapsed() >= kFlushIntervalMs) {
+            flushHits();
+            flushTimer.restart();
+        }
+    }
+    queues.finish();
+
+    while (running.load() > 0) {
+        QThread::msleep(kFlushIntervalMs / 5);
+        if (flushTimer.elapsed() >= kFlushIntervalMs) {
+            flushHits();
+            flushTimer.restart();
+        }
+    }
+    for (std::thread& scanner : scanners) scanner.join();
+
+    flushHits();
+    if (gen == generation->load()) {
+        int found = qMin(matches.load(), kMaxMatches);
+        emit searchFinished(gen, found, filesScanned.load(), found >= kMaxMatches);
+    }
+}
+
+// Runs on a scanner thread. Files are read through the thread's buffer
+// rather than mapped: another process may truncate a file mid-scan (log
+// rotation, an editor rewriting it), which raises SIGBUS through a mapping
+// but only shortens a read. Each window is scanned up to its last newline
+// and the unfinished line is carried into the next, so lines are seen whole.
+void ContentSearchWorker::scanFile(const QByteArray& path, QByteArray& buffer) {
+    int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > kMaxFileSize
+        || qint64(st.st_size) < qint64(needle.size())) {
+        ::close(fd);
+        return;
+    }
+    if (st.st_size > qint64(kReadWindow)) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    filesScanned++;
+    if (buffer.size() < int(kReadWindow + kMaxCarry)) buffer.resize(int(kReadWindow + kMaxCarry));
+    char* data = buffer.data();
+    const size_t overlap = qMin(size_t(needle.size()) - 1, kMaxCarry);
+    ScanState state;
+    qint64 offset = 0;
+    size_t carried = 0;
+    while (offset < st.st_size) {
+        ssize_t n = ::pread(fd, data + carried, size_t(qMin<qint64>(kReadWindow, st.st_size - offset)), offset);
+        if (n < 0 && errno == EINTR) continue;
+        // Shrunk since the fstat
+        if (n <= 0) break;
+        if (offset == 0 && looksBinary(data, size_t(n))) break;
+        offset += n;
+
+        const size_t filled = carried + size_t(n);
+        size_t scanned = filled;
+        if (offset < st.st_size) {
+            const void* newline = ::memrchr(data, '\n', filled);
+            if (newline) scanned = size_t(static_cast<const char*>(newline) - data) + 1;
+            // A line too long to carry is scanned as far as it goes; only
+            // enough of it is kept to catch a match across the seam
+            if (filled - scanned > kMaxCarry) scanned = filled;
+        }
+        if (!scanText(path, data, scanned, state) || offset >= st.st_size) break;
+
+        const size_t keep = scanned == filled ? qMin(overlap, filled) : filled - scanned;
+        state.line += int(std::count(data, data + filled - keep, '\n'));
+        memmove(data, data + filled - keep, keep);
+        carried = keep;
+    }
+    ::close(fd);
+}
+
+// Scans one window, whose first byte is on line state.line. Returns false
+// once the file needs no more scanning.
+bool ContentSearchWorker::scanText(const QByteArray& path, const char* data, size_t size, ScanState& state) {
+    const char* end = data + size;
+    const char* pos = data;
+    const char* counted = data;
+    const size_t overlap = size_t(needle.size()) - 1;
+    int line = state.line;
+
+    // The last window ended inside a line that already had its hit
+    if (state.skipLine) {
+        const void* newline = ::memchr(data, '\n', size);
+        if (!newline) return true;
+        pos = static_cast<const char*>(newline) + 1;
+        state.skipLine = false;
+    }
+
+    while (size_t(end - pos) > overlap) {
+        const char* match = findIgnoreCase(pos, size_t(end - pos), needle.constData(), size_t(needle.size()));
+        if (!match) break;
+
+        const void* newline = ::memrchr(data, '\n', size_t(match - data));
+        const char* lineStart = newline ? static_cast<const char*>(newline) + 1 : data;
+        const void* lineEndPtr = ::memchr(match, '\n', size_t(end - match));
+        const char* lineEnd = lineEndPtr ? static_cast<const char*>(lineEndPtr) : end;
+
+        line += int(std::count(counted, lineStart, '\n'));
+        counted = lineStart;
+        addHit(path, line, lineStart, lineEnd, match);
+
+        // One hit per line; continue after it.
+        if (++state.hits >= kMaxHitsPerFile || superseded()) return false;
+        if (lineEnd == end) {
+            state.skipLine = true;
+            break;
+        }
+        pos = lineEnd + 1;
+    }
+    return !superseded();
+}
+
+void ContentSearchWorker::addHit(const QByteArray& path, int line, const char* lineStart, const char* lineEnd,
+                                 const char* match) {
+    // Long lines (minified files) are cut to a window around the match.
+    const char* from = lineStart;
+    if (lineEnd - lineStart > kContextBytes && match - lineStart > kContextLead) {
+        from = match - kContextLead;
+    }
+    int length = int(qMin<qint64>(lineEnd - from, kContextBytes));
+
+    if (matches++ >= kMaxMatches) return;
+
+    SearchHit hit{QFile::decodeName(path), false};
+    hit.line = line;
+    hit.context = QString::fromUtf8(from, length).trimmed();
+
+    QMutexLocker locker(&hitMutex);
+    pendingHits.append(hit);
+}
+
+void ContentSearchWorker::flushHits() {
+    QVector<SearchHit> batch;
+    {
+        QMutexLocker locker(&hitMutex);
+        batch.swap(pendingHits);
+    }
+    if (!batch.isEmpty() && queryGeneration == generation->load()) {
+        emit resultsReady(queryGeneration, batch);
+    }
+}
+
+bool ContentSearchWorker::superseded() const {
+    return generation->load() != queryGeneration || matches.load() >= kMaxMatches;
+}
+
+// ContentSearch
+
+ContentSearch::ContentSearch(QObject *parent)
+    : QObject(parent)
+    , generation(0)
+    , worker(new ContentSearchWorker(&generation))
+{
+    qRegisterMetaType<QVector<SearchHit>>("QVector<SearchHit>");
+
+    worker->moveToThread(&workerThread);
+    connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    connect(worker, &ContentSearchWorker::resultsReady, this, &ContentSearch::resultsReady);
+    connect(worker, &ContentSearchWorker::searchFinished, this, &ContentSearch::searchFinished);
+
+    workerThread.setObjectName("ContentSearch");
+    workerThread.start(QThread::LowPriority);
+}
+
+ContentSearch::~ContentSearch() {
+    generation++;
+    workerThread.quit();
+    workerThread.wait();
+}
+
+int ContentSearch::search(const QString& root, const QString& text) {
+    int gen = ++generation;
+    QMetaObject::invokeMethod(worker, "search", Qt::QueuedConnection,
+                              Q_ARG(int, gen), Q_ARG(QString, root), Q_ARG(QString, text));
+    return gen;
+}
+
+void ContentSearch::cancel() {
+    generation++;
+}
@@ -0,0 +1,74 @@
+#ifndef CONTENTSEARCH_H
+#define CONTENTSEARCH_H
+
+#include <QObject>
+#include <QThread>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <atomic>
+#include "searchindex.h"
+
+// Greps every text file below a root for a string (ASCII case-insensitive).
+// The worker walks the tree and feeds paths to a pool of scanner threads
+// that steal from each other's queues; hits stream back in batches.
+class ContentSearchWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ContentSearchWorker(std::atomic<int>* generation, QObject *parent = nullptr);
+
+public slots:
+    void search(int generation, const QString& root, const QString& text);
+
+signals:
+    void resultsReady(int generation, const QVector<SearchHit>& hits);
+    void searchFinished(int generation, int matches, int filesScanned, bool truncated);
+
+private:
+    // Where a file's scan stands between read windows
+    struct ScanState {
+        int line = 1;
+        int hits = 0;
+        bool skipLine = false;
+    };
+
+    void scanFile(const QByteArray& path, QByteArray& buffer);
+    bool scanText(const QByteArray& path, const char* data, size_t size, ScanState& state);
+    void addHit(const QByteArray& path, int line, const char* lineStart, const char* lineEnd, const char* match);
+    void flushHits();
+    bool superseded() const;
+
+    std::atomic<int>* generation;
+
+    // Per-query state shared with the scanner threads
+    int queryGeneration;
+    QByteArray needle;
+    std::atomic<int> matches;
+    std::atomic<int> filesScanned;
+    QMutex hitMutex;
+    QVector<SearchHit> pendingHits;
+};
+
+// GUI-side handle; same generation scheme as SearchIndex.
+class ContentSearch : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ContentSearch(QObject *parent = nullptr);
+    ~ContentSearch();
+
+    int search(const QString& root, const QString& text);
+    void cancel();
+
+signals:
+    void resultsReady(int generation, const QVector<SearchHit>& hits);
+    void searchFinished(int generation, int matches, int filesScanned, bool truncated);
+
+private:
+    QThread workerThread;
+    std::atomic<int> generation;
+    ContentSearchWorker* worker;
+};
+
+#endif // CONTENTSEARCH_H
@@ -0,0 +1,215 @@
+#include "copybackend.h"
+#include <QFile>
+#include <QByteArray>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+namespace {
+
+// Large enough to amortise syscalls, small enough that cancel and progress stay responsive.
+const qint64 kChunkSize = 8 * 1024 * 1024;
+const qint64 kBufferSize = 1024 * 1024;
+
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() { if (fd >= 0) ::close(fd); }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd; }
+    bool isValid() const { return fd >= 0; }
+
+private:
+    int fd;
+};
+
+// Errors meaning "this mechanism does not apply here", not "the copy failed".
+bool isUnsupported(int err) {
+    return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP
+        || err == ENOTSUP || err == EBADF || err == ETXTBSY;
+}
+
+bool writeAll(int fd, const char* data, qint64 length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, size_t(length), offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+class RangeCopier {
+public:
+    RangeCopier(int in, int out, const CopyBackend::Progress& progress, CopyBackend::Result& result)
+        : in(in), out(out), progress(progress), result(result) {}
+
+    // Copies [offset, end), downgrading copy_file_range -> sendfile -> read/write
+    // as soon as the kernel says a mechanism does not apply to this pair of files.
+    bool copy(off_t offset, off_t end) {
+        while (offset < end) {
+            qint64 want = qMin<qint64>(end - offset, kChunkSize);
+            ssize_t n = -1;
+
+            if (result.method == CopyBackend::CopyFileRange) {
+                loff_t inOffset = offset;
+                loff_t outOffset = offset;
+                n = ::copy_file_range(in, &inOffset, out, &outOffset, size_t(want), 0);
+                if (n < 0 && isUnsupported(errno)) {
+                    result.method = CopyBackend::SendFile;
+                    continue;
+                }
+            } else if (result.method == CopyBackend::SendFile) {
+                if (::lseek(out, offset, SEEK_SET) < 0) return fail();
+                off_t inOffset = offset;
+                n = ::sendfile(out, in, &inOffset, size_t(want));
+                if (n < 0 && isUnsupported(errno)) {
+                    result.method = CopyBackend::Buffered;
+                    continue;
+                }
+            } else {
+                if (buffer.isEmpty()) buffer.resize(int(kBufferSize));
+                n = ::pread(in, buffer.data(), size_t(qMin<qint64>(want, kBufferSize)), offset);
+                if (n > 0 && !writeAll(out, buffer.constData(), n, offset)) return fail();
+            }
+
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return fail();
+            }
+            if (n == 0) break; // source shrank underneath us
+
+            offset += n;
+            if (!advance(n)) return false;
+        }
+        return true;
+    }
+
+    // For files whose st_size is meaningless (procfs, sysfs): read until EOF.
+    bool copyUntilEof() {
+        result.method = CopyBackend::Buffered;
+        buffer.resize(int(kBufferSize));
+        off_t offset = 0;
+        while (true) {
+            ssize_t n = ::read(in, buffer.data(), size_t(buffer.size()));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return fail();
+            }
+            if (n == 0) return true;
+            if (!writeAll(out, buffer.constData(), n, offset)) return fail();
+            offset += n;
+            if (!advance(n)) return false;
+        }
+    }
+
+private:
+    bool advance(qint64 n) {
+        result.bytes += n;
+        if (progress && !progress(n)) {
+            result.aborted = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool fail() {
+        result.error = qt_error_string(errno);
+        return false;
+    }
+
+    int in;
+    int out;
+    const CopyBackend::Progress& progress;
+    CopyBackend::Result& result;
+    QByteArray buffer;
+};
+
+} // namespace
+
+CopyBackend::Result CopyBackend::copyFile(const QString& source, const QString& dest, const Progress& progress) {
+    Result result;
+    const QByteArray sourcePath = QFile::encodeName(source);
+    const QByteArray destPath = QFile::encodeName(dest);
+
+    FileDescriptor in(::open(sourcePath.constData(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (!in.isValid() || ::fstat(in.get(), &st) < 0) {
+        result.error = qt_error_string(errno);
+        return result;
+    }
+
+    FileDescriptor out(::open(destPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777));
+    if (!out.isValid()) {
+        result.error = qt_error_string(errno);
+        return result;
+    }
+
+    bool copied = false;
+    if (st.st_size > 0 && ::ioctl(out.get(), FICLONE, in.get()) == 0) {
+        result.method = Reflink;
+        result.bytes = st.st_size;
+        copied = !progress || progress(st.st_size);
+        result.aborted = !copied;
+    } else {
+        RangeCopier copier(in.get(), out.get(), progress, result);
+        result.method = CopyFileRange;
+
+        if (st.st_size == 0) {
+            copied = copier.copyUntilEof();
+        } else if (off_t(st.st_blocks) * 512 < st.st_size) {
+            // Sparse source: only copy the data extents, leave the holes alone.
+            copied = true;
+            off_t pos = 0;
+            while (copied && pos < st.st_size) {
+                off_t data = ::lseek(in.get(), pos, SEEK_DATA);
+                if (data < 0) {
+                    if (errno == ENXIO) break; // trailing hole
+                    copied = copier.copy(pos, st.st_size); // no SEEK_DATA support
+                    break;
+                }
+                off_t hole = ::lseek(in.get(), data, SEEK_HOLE);
+                if (hole < 0 || hole > st.st_size) hole = st.st_size;
+                copied = copier.copy(data, hole);
+                pos = hole;
+            }
+            if (copied && ::ftruncate(out.get(), st.st_size) < 0) {
+                result.error = qt_error_string(errno);
+                copied = false;
+            }
+        } else {
+            copied = copier.copy(0, st.st_size);
+        }
+    }
+
+    if (copied) {
+        // Permission bits only: a copy must not pick up setuid, setgid or sticky
+        ::fchmod(out.get(), st.st_mode & 0777);
+    } else {
+        ::unlink(destPath.constData());
+    }
+
+    result.ok = copied;
+    return result;
+}
+
+QString CopyBackend::methodName(Method method) {
+    switch (method) {
+    case Reflink: return "reflink";
+    case CopyFileRange: return "copy_file_range";
+    case SendFile: return "sendfile";
+    case Buffered: return "buffered";
+    case None: break;
+    }
+    return QString();
+}
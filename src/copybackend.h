@@ -0,0 +1,35 @@
+#ifndef COPYBACKEND_H
+#define COPYBACKEND_H
+
+#include <QString>
+#include <functional>
+
+// Copies regular files with the cheapest mechanism the kernel offers:
+// FICLONE reflink, then copy_file_range, then sendfile, then read/write.
+// Holes in sparse sources are skipped with SEEK_DATA/SEEK_HOLE.
+class CopyBackend {
+public:
+    enum Method {
+        None,
+        Reflink,
+        CopyFileRange,
+        SendFile,
+        Buffered
+    };
+
+    struct Result {
+        bool ok = false;
+        bool aborted = false;
+        Method method = None;
+        qint64 bytes = 0;
+        QString error;
+    };
+
+    // Called after every transferred chunk; return false to abort the copy.
+    using Progress = std::function<bool(qint64 chunkBytes)>;
+
+    static Result copyFile(const QString& source, const QString& dest, const Progress& progress);
+    static QString methodName(Method method);
+};
+
+#endif // COPYBACKEND_H
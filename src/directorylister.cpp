@@ -0,0 +1,487 @@
+#include "directorylister.h"
+#include "parallelsort.h"
+#include "iconcache.h"
+#include "perftrace.h"
+#include <QDateTime>
+#include <QFile>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace {
+
+const int kDirentBufferSize = 1024 * 1024;
+// Set while listing for DT_LNK/DT_UNKNOWN entries that still need a stat.
+const quint8 kEntryUnresolved = 0x80;
+
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+std::atomic<bool> statxMissing(false);
+
+// Fetches only the requested statx fields; AT_STATX_DONT_SYNC lets network
+// filesystems answer from their attribute cache. Symlinks report their
+// target, or the link itself when it dangles.
+bool statFields(int dirfd, const char* name, quint8 fields, qint64& size, qint64& mtime, quint32& mode) {
+    if (!statxMissing.load()) {
+        unsigned int mask = STATX_TYPE;
+        if (fields & EntrySizeLoaded) mask |= STATX_SIZE;
+        if (fields & EntryMtimeLoaded) mask |= STATX_MTIME;
+        if (fields & EntryModeLoaded) mask |= STATX_MODE;
+
+        struct statx stx;
+        int result = ::statx(dirfd, name, AT_STATX_DONT_SYNC, mask, &stx);
+        if (result < 0 && errno == ENOENT) {
+            result = ::statx(dirfd, name, AT_STATX_DONT_SYNC | AT_SYMLINK_NOFOLLOW, mask, &stx);
+        }
+        if (result == 0) {
+            size = qint64(stx.stx_size);
+            mtime = qint64(stx.stx_mtime.tv_sec) * 1000 + stx.stx_mtime.tv_nsec / 1000000;
+            mode = stx.stx_mode;
+            return true;
+        }
+        if (errno != ENOSYS) return false;
+        statxMissing = true;
+    }
+
+    struct stat st;
+    if (::fstatat(dirfd, name, &st, 0) < 0 && ::fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) return false;
+    size = qint64(st.st_size);
+    mtime = qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+    mode = quint32(st.st_mode);
+    return true;
+}
+
+inline bool isDigit(ushort c) {
+    return c >= '0' && c <= '9';
+}
+
+inline uint foldCase(ushort c) {
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    return QChar::toCaseFolded(uint(c));
+}
+
+int naturalCompare(const QChar* a, int aLength, const QChar* b, int bLength) {
+    int i = 0;
+    int j = 0;
+    while (i < aLength && j < bLength) {
+        ushort ca = a[i].unicode();
+        ushort cb = b[j].unicode();
+
+        if (isDigit(ca) && isDigit(cb)) {
+            // Compare digit runs by value: fewer significant digits is smaller.
+            int aStart = i;
+            int bStart = j;
+            while (aStart < aLength && a[aStart] == QLatin1Char('0')) aStart++;
+            while (bStart < bLength && b[bStart] == QLatin1Char('0')) bStart++;
+            int aEnd = aStart;
+            int bEnd = bStart;
+            while (aEnd < aLength && isDigit(a[aEnd].unicode())) aEnd++;
+            while (bEnd < bLength && isDigit(b[bEnd].unicode())) bEnd++;
+
+            if (aEnd - aStart != bEnd - bStart) return (aEnd - aStart) - (bEnd - bStart);
+            for (int k = 0; k < aEnd - aStart; k++) {
+                if (a[aStart + k] != b[bStart + k]) return a[aStart + k].unicode() - b[bStart + k].unicode();
+            }
+            i = aEnd;
+            j = bEnd;
+            continue;
+        }
+
+        if (ca != cb) {
+            uint fa = foldCase(ca);
+            uint fb = foldCase(cb);
+            if (fa != fb) return fa < fb ? -1 : 1;
+        }
+        i++;
+        j++;
+    }
+
+    if (i < aLength || j < bLength) return (aLength - i) - (bLength - j);
+
+    // Equal apart from case or leading zeros: fall back to code units so the order is total.
+    for (int k = 0; k < qMin(aLength, bLength); k++) {
+        if (a[k] != b[k]) return a[k].unicode() - b[k].unicode();
+    }
+    return aLength - bLength;
+}
+
+// A string whose plain code unit order is naturalCompare()'s order, up to
+// its final tie-break: characters are case folded and every digit run
+// becomes '0', its length without leading zeros, then those digits. A
+// non-digit never folds into '0'..'9', so the marker can't be confused.
+QString collationKey(const QChar* name, int length) {
+    QString key;
+    key.reserve(length + 2);
+    for (int i = 0; i < length; ) {
+        const ushort c = name[i].unicode();
+        if (!isDigit(c)) {
+            key += QChar(ushort(foldCase(c)));
+            i++;
+            continue;
+        }
+        int start = i;
+        while (start < length && name[start] == QLatin1Char('0')) start++;
+        int end = start;
+        while (end < length && isDigit(name[end].unicode())) end++;
+        key += QLatin1Char('0');
+        key += QChar(ushort(end - start));
+        key.append(name + start, end - start);
+        i = end;
+    }
+    return key;
+}
+
+// The Kind column reads "<SUFFIX> File", so kinds order by suffix.
+QString suffixKey(const QChar* name, int length) {
+    for (int i = length - 1; i > 0; i--) {
+        if (name[i] == QLatin1Char('.')) return QString(name + i + 1, length - i - 1).toCaseFolded();
+    }
+    return QString();
+}
+
+// Date groups, newest first: today, yesterday, the previous week and month,
+// earlier this year, then one group per year.
+const char* const kDateGroupTitles[] = {"Today", "Yesterday", "Previous 7 Days", "Previous 30 Days", "Earlier This Year"};
+
+const char* const kKindGroupTitles[IconCache::CategoryCount] = {
+    "Folders", "PDF Documents", "Documents", "Text", "Spreadsheets", "Images",
+    "Movies", "Music", "Archives", "Source Code", "Applications", "Other"
+};
+
+int dateGroup(qint64 mtime, qint64 todayStart, int thisYear) {
+    const qint64 kDayMs = 24 * 60 * 60 * 1000;
+    if (mtime >= todayStart) return 0;
+    if (mtime >= todayStart - kDayMs) return 1;
+    if (mtime >= todayStart - 7 * kDayMs) return 2;
+    if (mtime >= todayStart - 30 * kDayMs) return 3;
+    const int year = QDateTime::fromMSecsSinceEpoch(mtime).date().year();
+    return year >= thisYear ? 4 : 4 + thisYear - year;
+}
+
+QString groupTitle(EntryGrouping grouping, int group, int thisYear) {
+    if (grouping == GroupByKind) return QString(kKindGroupTitles[group]);
+    if (group <= 4) return QString(kDateGroupTitles[group]);
+    return QString::number(thisYear - (group - 4));
+}
+
+inline bool isDotDot(const QChar* name, int length) {
+    return length == 2 && name[0] == QLatin1Char('.') && name[1] == QLatin1Char('.');
+}
+
+// Appends a raw file name to the arena; plain ASCII names skip the codec.
+void appendName(QString& names, const char* name, int length) {
+    for (int i = 0; i < length; i++) {
+        if (static_cast<unsigned char>(name[i]) >= 0x80) {
+            names += QFile::decodeName(QByteArray::fromRawData(name, length));
+            return;
+        }
+    }
+    names.append(QLatin1String(name, length));
+}
+
+} // namespace
+
+DirectoryLister::DirectoryLister(std::atomic<int>* generation, QObject *parent)
+    : QObject(parent)
+    , generation(generation)
+    , listedGeneration(0)
+    , dirFd(-1)
+{
+}
+
+DirectoryLister::~DirectoryLister() {
+    closeDirectory();
+}
+
+int DirectoryLister::compare(const QChar* a, int aLength, bool aDir, const QChar* b, int bLength, bool bDir) {
+    bool aUp = isDotDot(a, aLength);
+    bool bUp = isDotDot(b, bLength);
+    if (aUp != bUp) return aUp ? -1 : 1;
+    if (aDir != bDir) return aDir ? -1 : 1;
+    return naturalCompare(a, aLength, b, bLength);
+}
+
+qint64 DirectoryLister::modifiedTime(const QString& path) {
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) return -1;
+    return qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+void DirectoryLister::list(int gen, const QString& path) {
+    if (gen != generation->load()) return;
+    PerfScope scope("DirectoryLister::list");
+    closeDirectory();
+
+    DirectoryListing listing;
+    listing.path = path;
+
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        emit listingReady(gen, listing);
+        return;
+    }
+    // Taken before reading, so a change made meanwhile makes it look stale
+    struct stat dirStat;
+    if (::fstat(fd, &dirStat) == 0) {
+        listing.modified = qint64(dirStat.st_mtim.tv_sec) * 1000000000 + dirStat.st_mtim.tv_nsec;
+    }
+
+    // Raw names are kept NUL-terminated for the symlink pass; decoded names
+    // go into an arena in directory order and are permuted after sorting.
+    QByteArray raw;
+    QVector<quint32> entryOffsets;
+    QString names;
+    QVector<quint32> offsets;
+    QVector<quint8> lengths;
+    QVector<quint8> flags;
+
+    if (buffer.isEmpty()) buffer.resize(kDirentBufferSize);
+    const bool isRoot = path == QLatin1String("/");
+    while (gen == generation->load()) {
+        long n = ::syscall(SYS_getdents64, fd, buffer.data(), size_t(buffer.size()));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) break;
+
+        for (long offset = 0; offset < n; ) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer.constData() + offset);
+            offset += entry->d_reclen;
+
+            // Hidden entries are not shown; ".." is, except at the root.
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] != '.' || name[2] != '\0' || isRoot)) continue;
+
+            int length = int(::strlen(name));
+            quint8 flag = 0;
+            if (entry->d_type == DT_DIR) flag = EntryDir;
+            else if (entry->d_type == DT_LNK) flag = EntrySymLink | kEntryUnresolved;
+            else if (entry->d_type == DT_UNKNOWN) flag = kEntryUnresolved;
+
+            entryOffsets.append(quint32(raw.size()));
+            raw.append(name, length + 1);
+            offsets.append(quint32(names.size()));
+            appendName(names, name, length);
+            lengths.append(quint8(qMin(names.size() - int(offsets.last()), 255)));
+            flags.append(flag);
+        }
+    }
+
+    // Symlinks to folders sort and open as folders.
+    for (int i = 0; i < flags.size(); i++) {
+        if (!(flags[i] & kEntryUnresolved)) continue;
+        const char* name = raw.constData() + entryOffsets[i];
+        struct stat st;
+        if (!(flags[i] & EntrySymLink) && ::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode)) {
+            flags[i] |= EntrySymLink;
+        }
+        if (::fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode)) flags[i] |= EntryDir;
+        flags[i] &= ~kEntryUnresolved;
+    }
+
+    if (gen != generation->load()) {
+        ::close(fd);
+        return;
+    }
+
+    QVector<quint32> order(flags.size());
+    for (int i = 0; i < order.size(); i++) order[i] = quint32(i);
+    // The comparator runs on several threads at once, so it only touches const data.
+    const QChar* nameData = names.constData();
+    const quint32* offsetData = offsets.constData();
+    const quint8* lengthData = lengths.constData();
+    const quint8* flagData = flags.constData();
+    parallelSort(order.begin(), order.end(), [=](quint32 a, quint32 b) {
+        return compare(nameData + offsetData[a], lengthData[a], flagData[a] & EntryDir,
+                       nameData + offsetData[b], lengthData[b], flagData[b] & EntryDir) < 0;
+    });
+
+    const int count = order.size();
+    listing.names.reserve(names.size());
+    listing.nameOffsets.resize(count);
+    listing.nameLengths.resize(count);
+    listing.flags.resize(count);
+    for (int row = 0; row < count; row++) {
+        quint32 i = order[row];
+        listing.nameOffsets[row] = quint32(listing.names.size());
+        listing.names.append(names.constData() + offsets[i], lengths[i]);
+        listing.nameLengths[row] = lengths[i];
+        listing.flags[row] = flags[i];
+    }
+
+    // Keep the directory open so stat requests resolve names relative to it
+    listedGeneration = gen;
+    dirFd = fd;
+
+    emit listingReady(gen, listing);
+}
+
+void DirectoryLister::openDirectory(int gen, const QString& path) {
+    if (gen != generation->load()) return;
+    closeDirectory();
+
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    listedGeneration = gen;
+    dirFd = fd;
+}
+
+void DirectoryLister::fetchStats(int gen, const QVector<int>& rows, const QStringList& names, int fields) {
+    if (gen != generation->load() || gen != listedGeneration || dirFd < 0) return;
+    PerfScope scope("DirectoryLister::fetchStats");
+
+    DirectoryStats stats;
+    stats.fields = quint8(fields);
+    stats.rows.reserve(rows.size());
+    stats.names.reserve(rows.size());
+    stats.sizes.reserve(rows.size());
+    stats.mtimes.reserve(rows.size());
+    stats.modes.reserve(rows.size());
+
+    for (int i = 0; i < rows.size() && i < names.size(); i++) {
+        // Entries that vanished since listing report zeros rather than staying unloaded
+        qint64 size = 0;
+        qint64 mtime = 0;
+        quint32 mode = 0;
+        statFields(dirFd, QFile::encodeName(names.at(i)).constData(), quint8(fields), size, mtime, mode);
+
+        stats.rows.append(rows.at(i));
+        stats.names.append(names.at(i));
+        stats.sizes.append(size);
+        stats.mtimes.append(mtime);
+        stats.modes.append(mode);
+    }
+
+    emit statsReady(gen, stats);
+}
+
+// Orders a snapshot of the model's entries by any column, optionally in
+// groups. Collation keys are built once per entry up front, so the
+// comparisons of the parallel sort are plain string compares.
+void DirectoryLister::sort(int gen, const SortRequest& request) {
+    if (gen != generation->load() || gen != listedGeneration || dirFd < 0) return;
+    PerfScope scope("DirectoryLister::sort");
+
+    const DirectoryListing& listing = request.listing;
+    const int count = listing.size();
+    SortResult result;
+    result.version = request.version;
+    result.key = request.key;
+    result.descending = request.descending;
+    result.grouping = request.grouping;
+    result.sizes = request.sizes;
+    result.mtimes = request.mtimes;
+
+    // Rows that were never painted have no stat fields yet
+    if (request.key == SortBySize) result.fields |= EntrySizeLoaded;
+    if (request.key == SortByModified || request.grouping == GroupByDate) result.fields |= EntryMtimeLoaded;
+    if (result.fields) {
+        qint64* sizeData = result.sizes.data();
+        qint64* mtimeData = result.mtimes.data();
+        const quint8 fields = result.fields;
+        const int fd = dirFd;
+        parallelFor(count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const quint8 missing = fields & ~listing.flags.at(i);
+                if (!missing) continue;
+                qint64 size = 0;
+                qint64 mtime = 0;
+                quint32 mode = 0;
+                statFields(fd, QFile::encodeName(listing.name(i)).constData(), missing, size, mtime, mode);
+                if (missing & EntrySizeLoaded) sizeData[i] = size;
+                if (missing & EntryMtimeLoaded) mtimeData[i] = mtime;
+            }
+        }, 256);
+        if (gen != generation->load()) return;
+    }
+
+    const bool byKind = request.key == SortByKind;
+    const bool grouped = request.grouping != NoGrouping;
+    const EntryGrouping grouping = request.grouping;
+    const QDate today = QDate::currentDate();
+    const qint64 todayStart = today.startOfDay().toMSecsSinceEpoch();
+    const IconCache& icons = IconCache::instance();
+
+    QVector<QString> nameKeys(count);
+    QVector<QString> kindKeys(byKind ? count : 0);
+    QVector<int> groupKeys(grouped ? count : 0);
+    QString* nameKeyData = nameKeys.data();
+    QString* kindKeyData = kindKeys.data();
+    int* groupKeyData = groupKeys.data();
+    const qint64* mtimeData = result.mtimes.constData();
+    parallelFor(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const QChar* name = listing.nameData(i);
+            const int length = listing.nameLength(i);
+            const quint8 flags = listing.flags.at(i);
+            nameKeyData[i] = collationKey(name, length);
+            if (byKind && !(flags & EntryDir)) kindKeyData[i] = suffixKey(name, length);
+            if (grouping == GroupByKind) {
+                groupKeyData[i] = icons.categoryForName(name, length, flags & EntryDir, flags & EntryExecutable);
+            } else if (grouping == GroupByDate) {
+                groupKeyData[i] = dateGroup(mtimeData[i], todayStart, today.year());
+            }
+        }
+    }, 2048);
+
+    QVector<quint32> order(count);
+    for (int i = 0; i < count; i++) order[i] = quint32(i);
+    // The listing is in name order, so ".." (if any) is entry 0; it stays on
+    // top, outside any group. Folders come first within each group.
+    const quint32 parent = count > 0 && isDotDot(listing.nameData(0), listing.nameLength(0)) ? 0 : quint32(count);
+    const bool descending = request.descending;
+    const bool bySize = request.key == SortBySize;
+    const qint64* values = bySize ? result.sizes.constData()
+                                  : request.key == SortByModified ? result.mtimes.constData() : nullptr;
+    const quint8* flagData = listing.flags.constData();
+    const QString* nameKeyValues = nameKeys.constData();
+    const QString* kindKeyValues = kindKeys.constData();
+    const int* groupKeyValues = groupKeys.constData();
+    parallelSort(order.begin(), order.end(), [=, &listing](quint32 a, quint32 b) {
+        if (a == parent || b == parent) return a == parent && b != parent;
+        if (grouped && groupKeyValues[a] != groupKeyValues[b]) return groupKeyValues[a] < groupKeyValues[b];
+        const bool aDir = flagData[a] & EntryDir;
+        if (aDir != bool(flagData[b] & EntryDir)) return aDir;
+
+        // Folder sizes aren't known here, so folders keep name order by size
+        int diff = 0;
+        if (values && !(bySize && aDir)) diff = values[a] < values[b] ? -1 : (values[a] > values[b] ? 1 : 0);
+        else if (byKind) diff = kindKeyValues[a].compare(kindKeyValues[b]);
+        if (diff == 0) diff = nameKeyValues[a].compare(nameKeyValues[b]);
+        if (diff == 0) {
+            diff = naturalCompare(listing.nameData(int(a)), listing.nameLength(int(a)),
+                                   listing.nameData(int(b)), listing.nameLength(int(b)));
+        }
+        return descending ? diff > 0 : diff < 0;
+    });
+
+    if (gen != generation->load()) return;
+
+    result.order.reserve(count + (grouped ? 16 : 0));
+    int group = -1;
+    for (quint32 entry : qAsConst(order)) {
+        if (grouped && entry != parent && groupKeys.at(int(entry)) != group) {
+            group = groupKeys.at(int(entry));
+            result.groups.append(groupTitle(grouping, group, today.year()));
+            result.order.append(-result.groups.size());
+        }
+        result.order.append(int(entry));
+    }
+
+    emit sortReady(gen, result);
+}
+
+void DirectoryLister::closeDirectory() {
+    if (dirFd >= 0) ::close(dirFd);
+    dirFd = -1;
+}
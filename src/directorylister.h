@@ -0,0 +1,141 @@
+#ifndef DIRECTORYLISTER_H
+#define DIRECTORYLISTER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QStringList>
+#include <QByteArray>
+#include <atomic>
+
+// Per-entry flags in DirectoryListing::flags.
+enum DirectoryEntryFlag : quint8 {
+    EntryDir = 0x01,
+    EntrySymLink = 0x02,
+    EntryExecutable = 0x04,
+    // Which stat fields have been fetched so far
+    EntrySizeLoaded = 0x08,
+    EntryMtimeLoaded = 0x10,
+    EntryModeLoaded = 0x20
+};
+
+// One directory's entries in display order, stored as parallel arrays: all
+// names live back to back in one string, so an entry costs a few bytes of
+// bookkeeping plus its name rather than a heap-allocated node.
+struct DirectoryListing {
+    QString path;
+    // The folder's own mtime (ns since epoch) as it was read; -1 if unknown
+    qint64 modified = -1;
+    QString names;
+    QVector<quint32> nameOffsets;
+    QVector<quint8> nameLengths;
+    QVector<quint8> flags;
+
+    int size() const { return flags.size(); }
+    const QChar* nameData(int row) const { return names.constData() + nameOffsets.at(row); }
+    int nameLength(int row) const { return nameLengths.at(row); }
+    QString name(int row) const { return QString(nameData(row), nameLength(row)); }
+};
+
+// Stat results for some rows of a listing. Only the fields named in
+// `fields` (EntrySizeLoaded etc.) were asked for; the others are zero.
+// Rows may have moved by the time this arrives, so names come along too.
+struct DirectoryStats {
+    quint8 fields = 0;
+    QVector<int> rows;
+    QStringList names;
+    QVector<qint64> sizes;
+    QVector<qint64> mtimes; // msecs since epoch
+    QVector<quint32> modes;
+};
+
+// What a sort orders by (matching FileModel's columns) and groups by.
+enum SortKey : quint8 {
+    SortByName,
+    SortBySize,
+    SortByKind,
+    SortByModified
+};
+
+enum EntryGrouping : quint8 {
+    NoGrouping,
+    GroupByKind,
+    GroupByDate
+};
+
+// A snapshot of the model's entries to put in display order. The version
+// lets the model drop results for entries that have since moved.
+struct SortRequest {
+    int version = 0;
+    SortKey key = SortByName;
+    bool descending = false;
+    EntryGrouping grouping = NoGrouping;
+    DirectoryListing listing;
+    QVector<qint64> sizes;
+    QVector<qint64> mtimes;
+};
+
+// Display order for a SortRequest: entry numbers, with a group header
+// (-1 - i, titled groups[i]) ahead of each group. Stat fields the sort
+// needed are loaded for every entry and come back in `fields`.
+struct SortResult {
+    int version = 0;
+    SortKey key = SortByName;
+    bool descending = false;
+    EntryGrouping grouping = NoGrouping;
+    QVector<int> order;
+    QStringList groups;
+    quint8 fields = 0;
+    QVector<qint64> sizes;
+    QVector<qint64> mtimes;
+};
+
+// Lists directories on a background thread: getdents64 in large batches,
+// names decoded into one arena and a parallel sort (folders first, natural
+// order). Nothing is stat'ed up front; the model asks for just the fields
+// its visible cells need (by name, since rows shift as the folder changes),
+// and the lister keeps the directory open for that. Sorting by other
+// columns and grouping happen here too, on a snapshot of the entries.
+class DirectoryLister : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectoryLister(std::atomic<int>* generation, QObject *parent = nullptr);
+    ~DirectoryLister();
+
+    // Display order: "..", then folders, then files; names compare
+    // case-insensitively with digit runs compared by value.
+    static int compare(const QChar* a, int aLength, bool aDir, const QChar* b, int bLength, bool bDir);
+    // mtime of the folder at path in ns, or -1 if it can't be stat'ed.
+    static qint64 modifiedTime(const QString& path);
+
+public slots:
+    void list(int generation, const QString& path);
+    // Opens path for stat requests and sorts without listing it, for a
+    // listing the model already has.
+    void openDirectory(int generation, const QString& path);
+    void fetchStats(int generation, const QVector<int>& rows, const QStringList& names, int fields);
+    void sort(int generation, const SortRequest& request);
+
+signals:
+    void listingReady(int generation, const DirectoryListing& listing);
+    void statsReady(int generation, const DirectoryStats& stats);
+    void sortReady(int generation, const SortResult& result);
+
+private:
+    void closeDirectory();
+
+    std::atomic<int>* generation;
+    QByteArray buffer;
+
+    // The directory last listed, kept open for stat requests
+    int listedGeneration;
+    int dirFd;
+};
+
+Q_DECLARE_METATYPE(DirectoryListing)
+Q_DECLARE_METATYPE(DirectoryStats)
+Q_DECLARE_METATYPE(SortRequest)
+Q_DECLARE_METATYPE(SortResult)
+
+#endif // DIRECTORYLISTER_H
@@ -0,0 +1,273 @@
+#include "directorysizes.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+namespace {
+
+const int kDirentBufferSize = 32 * 1024;
+// Roughly 100 bytes per record plus 40 per name; plenty for a home directory.
+const int kMaxCachedDirs = 500000;
+const int kMaxCachedNames = 4000000;
+
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+struct EntryStat {
+    bool isDir;
+    bool isRegular;
+    quint64 dev;
+    quint64 inode;
+    quint32 links;
+    qint64 size;
+    qint64 mtime;
+};
+
+std::atomic<bool> statxMissing(false);
+
+// statx() without forcing a sync on network filesystems; plain fstatat()
+// on kernels older than 4.11.
+bool statEntry(int dirfd, const char* name, EntryStat& result) {
+    if (!statxMissing.load()) {
+        struct statx stx;
+        if (::statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                    STATX_TYPE | STATX_INO | STATX_NLINK | STATX_SIZE | STATX_MTIME, &stx) == 0) {
+            result.isDir = S_ISDIR(stx.stx_mode);
+            result.isRegular = S_ISREG(stx.stx_mode);
+            result.dev = quint64(makedev(stx.stx_dev_major, stx.stx_dev_minor));
+            result.inode = stx.stx_ino;
+            result.links = stx.stx_nlink;
+            result.size = qint64(stx.stx_size);
+            result.mtime = qint64(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+            return true;
+        }
+        if (errno != ENOSYS) return false;
+        statxMissing = true;
+    }
+
+    struct stat st;
+    if (::fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) return false;
+    result.isDir = S_ISDIR(st.st_mode);
+    result.isRegular = S_ISREG(st.st_mode);
+    result.dev = quint64(st.st_dev);
+    result.inode = quint64(st.st_ino);
+    result.links = quint32(st.st_nlink);
+    result.size = qint64(st.st_size);
+    result.mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+inline bool isDotOrDotDot(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+inline QByteArray childPath(const QByteArray& dir, const QByteArray& name) {
+    return dir.endsWith('/') ? dir + name : dir + '/' + name;
+}
+
+} // namespace
+
+// Per-request totals, shared by every pool task of one walk.
+struct DirectorySizeWorker::Walk {
+    int generation;
+    std::atomic<qint64> bytes{0};
+    std::atomic<qint64> files{0};
+    QMutex linkMutex;
+    QSet<QPair<quint64, quint64>> linked;
+};
+
+// DirectorySizeWorker
+
+DirectorySizeWorker::DirectorySizeWorker(std::atomic<int>* generation, QObject *parent)
+    : QObject(parent)
+    , generation(generation)
+    , cachedNames(0)
+{
+    pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+}
+
+void DirectorySizeWorker::compute(int gen, const QString& path) {
+    if (gen != generation->load()) return;
+
+    const QByteArray encoded = QFile::encodeName(path);
+    EntryStat st;
+    if (!statEntry(AT_FDCWD, encoded.constData(), st) || !st.isDir) {
+        emit sizeReady(gen, path, 0, 0);
+        return;
+    }
+
+    Walk walk;
+    walk.generation = gen;
+    walkDir(&walk, encoded, DirKey{st.dev, st.inode}, st.mtime);
+    pool.waitForDone();
+
+    if (gen == generation->load()) {
+        emit sizeReady(gen, path, walk.bytes.load(), walk.files.load());
+    }
+}
+
+// Runs on a pool thread (the root directory runs on the worker thread).
+void DirectorySizeWorker::walkDir(Walk* walk, const QByteArray& path, const DirKey& key, qint64 mtime) {
+    if (walk->generation != generation->load()) return;
+
+    int fd = ::open(path.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) return;
+
+    DirRecord record;
+    bool cached = false;
+    {
+        QMutexLocker locker(&cacheMutex);
+        auto it = cache.constFind(key);
+        if (it != cache.constEnd() && it->mtime == mtime) {
+            record = *it;
+            cached = true;
+        }
+    }
+
+    // An unchanged directory has the same entries, so it isn't read again;
+    // a new or modified one is listed afresh. Entries are stat'ed either way.
+    if (!cached) {
+        record.mtime = mtime;
+        if (listDir(fd, record)) {
+            QMutexLocker locker(&cacheMutex);
+            const int names = record.files.size() + record.subdirs.size();
+            if (cache.size() >= kMaxCachedDirs || cachedNames + names > kMaxCachedNames) {
+                cache.clear();
+                cachedNames = 0;
+            }
+            auto previous = cache.constFind(key);
+            if (previous != cache.constEnd()) cachedNames -= previous->files.size() + previous->subdirs.size();
+            cache.insert(key, record);
+            cachedNames += names;
+        }
+    }
+
+    qint64 bytes = 0;
+    qint64 files = 0;
+    for (const QByteArray& name : qAsConst(record.files)) {
+        EntryStat st;
+        if (!statEntry(fd, name.constData(), st) || !st.isRegular) continue;
+        if (st.links > 1) {
+            QMutexLocker locker(&walk->linkMutex);
+            if (walk->linked.contains(qMakePair(st.dev, st.inode))) continue;
+            walk->linked.insert(qMakePair(st.dev, st.inode));
+        }
+        bytes += st.size;
+        files++;
+    }
+    walk->bytes += bytes;
+    walk->files += files;
+
+    // Other filesystems mounted below are not descended into, like du -x
+    QVector<SubDir> subdirs;
+    for (const QByteArray& name : qAsConst(record.subdirs)) {
+        EntryStat st;
+        if (statEntry(fd, name.constData(), st) && st.isDir && st.dev == key.dev) {
+            subdirs.append(SubDir{name, DirKey{st.dev, st.inode}, st.mtime});
+        }
+    }
+    ::close(fd);
+
+    for (const SubDir& subdir : qAsConst(subdirs)) {
+        QByteArray subdirPath = childPath(path, subdir.name);
+        pool.start([this, walk, subdirPath, subdir]() {
+            walkDir(walk, subdirPath, subdir.key, subdir.mtime);
+        });
+    }
+}
+
+// Reads the directory's names with raw getdents64, sorted into files and
+// subdirectories by d_type; only entries of unknown type are stat'ed here.
+bool DirectorySizeWorker::listDir(int fd, DirRecord& record) {
+    alignas(8) char buffer[kDirentBufferSize];
+    while (true) {
+        long n = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+
+        for (long offset = 0; offset < n; ) {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (isDotOrDotDot(name)) continue;
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                EntryStat st;
+                if (!statEntry(fd, name, st)) continue;
+                type = st.isDir ? DT_DIR : (st.isRegular ? DT_REG : DT_UNKNOWN);
+            }
+
+            if (type == DT_DIR) record.subdirs.append(QByteArray(name));
+            else if (type == DT_REG) record.files.append(QByteArray(name));
+        }
+    }
+}
+
+// DirectorySizes
+
+DirectorySizes::DirectorySizes(QObject *parent)
+    : QObject(parent)
+    , generation(0)
+    , worker(new DirectorySizeWorker(&generation))
+{
+    worker->moveToThread(&workerThread);
+    connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    connect(worker, &DirectorySizeWorker::sizeReady, this, [this](int gen, const QString& path, qint64 bytes, qint64 files) {
+        if (gen != generation.load()) return;
+        requested.remove(path);
+        totals.insert(path, Total{bytes, files});
+        emit sizeReady(path, bytes);
+    });
+
+    workerThread.setObjectName("DirectorySizes");
+    workerThread.start(QThread::LowPriority);
+}
+
+DirectorySizes::~DirectorySizes() {
+    generation++;
+    workerThread.quit();
+    workerThread.wait();
+}
+
+qint64 DirectorySizes::size(const QString& path) {
+    auto it = totals.constFind(path);
+    if (it != totals.constEnd()) return it->bytes;
+
+    if (!requested.contains(path)) {
+        requested.insert(path);
+        QMetaObject::invokeMethod(worker, "compute", Qt::QueuedConnection,
+                                  Q_ARG(int, generation.load()), Q_ARG(QString, path));
+    }
+    return -1;
+}
+
+qint64 DirectorySizes::fileCount(const QString& path) const {
+    auto it = totals.constFind(path);
+    return it != totals.constEnd() ? it->files : -1;
+}
+
+void DirectorySizes::cancelPending() {
+    generation++;
+    requested.clear();
+}
+
+void DirectorySizes::clear() {
+    cancelPending();
+    totals.clear();
+}
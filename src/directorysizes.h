@@ -0,0 +1,98 @@
+#ifndef DIRECTORYSIZES_H
+#define DIRECTORYSIZES_H
+
+#include <QObject>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Walks directory trees on a thread pool to total up file sizes. Each
+// directory's listing is cached by (dev, inode, mtime), so re-walking an
+// unchanged tree stats its entries without reading the directories again.
+// Sizes themselves are never cached: a file written in place leaves its
+// directory's mtime alone. Files with several hard links are counted once
+// per walk.
+class DirectorySizeWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectorySizeWorker(std::atomic<int>* generation, QObject *parent = nullptr);
+
+public slots:
+    void compute(int generation, const QString& path);
+
+signals:
+    void sizeReady(int generation, const QString& path, qint64 bytes, qint64 files);
+
+private:
+    struct DirKey {
+        quint64 dev;
+        quint64 inode;
+        bool operator==(const DirKey& other) const { return dev == other.dev && inode == other.inode; }
+        friend uint qHash(const DirKey& key, uint seed) { return ::qHash(key.inode ^ (key.dev << 32), seed); }
+    };
+
+    // One directory's files and subdirectories, valid while its mtime is unchanged.
+    struct DirRecord {
+        qint64 mtime = 0;
+        QVector<QByteArray> files;
+        QVector<QByteArray> subdirs;
+    };
+
+    struct SubDir {
+        QByteArray name;
+        DirKey key;
+        qint64 mtime;
+    };
+
+    struct Walk;
+    void walkDir(Walk* walk, const QByteArray& path, const DirKey& key, qint64 mtime);
+    bool listDir(int fd, DirRecord& record);
+
+    std::atomic<int>* generation;
+    QThreadPool pool;
+    QMutex cacheMutex;
+    QHash<DirKey, DirRecord> cache;
+    // Names held by the cache, to bound its memory
+    int cachedNames;
+};
+
+// GUI-side cache of folder totals. size() answers from memory or queues a walk
+// and emits sizeReady() when it is done.
+class DirectorySizes : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DirectorySizes(QObject *parent = nullptr);
+    ~DirectorySizes();
+
+    // Total bytes below path, or -1 while it is still being computed.
+    qint64 size(const QString& path);
+    qint64 fileCount(const QString& path) const;
+    // Drops queued walks, e.g. when the visible folder changes.
+    void cancelPending();
+    // Forgets all totals; unchanged directories are not read again, only re-stat'ed.
+    void clear();
+
+signals:
+    void sizeReady(const QString& path, qint64 bytes);
+
+private:
+    struct Total {
+        qint64 bytes;
+        qint64 files;
+    };
+
+    QThread workerThread;
+    std::atomic<int> generation;
+    DirectorySizeWorker* worker;
+    QHash<QString, Total> totals;
+    QSet<QString> requested;
+};
+
+#endif // DIRECTORYSIZES_H
@@ -1,79 +1,1068 @@
 #include "filemodel.h"
-#include <QFileIconProvider>
+#include "iconcache.h"
+#include "perftrace.h"
 #include <QFont>
+#include <QLocale>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
 #include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+namespace {
+
+// The first chunk fills the screen; the rest follow one chunk per event loop pass.
+const int kFirstChunkRows = 2000;
+const int kChunkRows = 50000;
+
+// Disk changes are applied once per frame, spending at most kFrameBudgetMs
+// on row inserts and removals; whatever is left waits for the next frame.
+const int kChangeIntervalMs = 16;
+const int kFrameBudgetMs = 8;
+
+const quint32 kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY
+    | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+// Pending change per name; the latest event wins.
+enum Change : quint8 {
+    ChangeAdded = 0x01,
+    ChangeRemoved = 0x02,
+    ChangeModified = 0x04,
+    ChangeIsDir = 0x08
+};
+
+const quint8 kStatLoadedFlags = EntrySizeLoaded | EntryMtimeLoaded | EntryModeLoaded;
+
+// Rows added or changed while sorted by another column wait at the bottom
+// (or in place) this long, so a burst of changes costs one re-sort.
+const int kResortDelayMs = 100;
+
+// Folders kept for instant reopening, and the entries they may hold in
+// total (a few tens of MB at most)
+const int kCachedFolders = 32;
+const int kCachedEntries = 500000;
+
+// Prefetch requests waiting behind the one in flight
+const int kPrefetchQueue = 4;
+
+// The folder on screen, the prefetch in flight and every cached folder
+// each hold a watch, all within the view's share of the watch cap
+static_assert(kCachedFolders + 2 <= WatchManager::kViewWatches, "cached folders must fit the view's watches");
+
+// data() runs for every visible cell; only calls this slow are traced.
+const qint64 kSlowDataNs = 20000;
+
+} // namespace
 
 FileModel::FileModel(QObject *parent)
-    : QFileSystemModel(parent)
+    : QAbstractTableModel(parent)
+    , generation(0)
+    , lister(new DirectoryLister(&generation))
+    , visibleRows(0)
+    , chunkTimer(new QTimer(this))
+    , pendingStatFields(0)
+    , statTimer(new QTimer(this))
+    , watcher(new WatchManager(kWatchMask, WatchManager::kViewWatches, this))
+    , watchDescriptor(-1)
+    , changeTimer(new QTimer(this))
+    , listingLoaded(false)
+    , deadNameChars(0)
+    , sortColumn(NameColumn)
+    , sortOrder(Qt::AscendingOrder)
+    , groupBy(NoGrouping)
+    , layoutVersion(0)
+    , sortTimer(new QTimer(this))
+    , cache(kCachedFolders, kCachedEntries)
+    , prefetchGeneration(0)
+    , prefetcher(new DirectoryLister(&prefetchGeneration))
+    , prefetchWatch(-1)
+    , prefetchStale(false)
+    , folderSizes(new DirectorySizes(this))
+    , thumbnails(new ThumbnailCache(this))
 {
-    setRootPath("/");
-    setFilter(QDir::AllEntries | QDir::NoDot | QDir::AllDirs);
-    setNameFilterDisables(false);
+    qRegisterMetaType<DirectoryListing>("DirectoryListing");
+    qRegisterMetaType<DirectoryStats>("DirectoryStats");
+    qRegisterMetaType<SortRequest>("SortRequest");
+    qRegisterMetaType<SortResult>("SortResult");
+    qRegisterMetaType<QVector<int>>("QVector<int>");
+
+    QFont font;
+    font.setPointSize(11);
+    fontValue = font;
+    font.setBold(true);
+    groupFontValue = font;
+
+    chunkTimer->setSingleShot(true);
+    chunkTimer->setInterval(0);
+    connect(chunkTimer, &QTimer::timeout, this, &FileModel::insertNextChunk);
+
+    // Collects every cell painted in one pass into a single stat request
+    statTimer->setSingleShot(true);
+    statTimer->setInterval(0);
+    connect(statTimer, &QTimer::timeout, this, &FileModel::flushStatRequests);
+
+    changeTimer->setSingleShot(true);
+    changeTimer->setInterval(kChangeIntervalMs);
+    connect(changeTimer, &QTimer::timeout, this, &FileModel::flushChanges);
+    connect(watcher, &WatchManager::eventsReady, this, &FileModel::handleEvents);
+    // Events were lost; only a fresh listing is sure to be right
+    connect(watcher, &WatchManager::overflowed, this, [this]() {
+        prefetchStale = true;
+        for (int wd : cache.clear()) releaseWatch(wd);
+        if (!listing.path.isEmpty()) setRootPath(listing.path);
+    });
+    // A cached folder whose watch made room for another can't be trusted
+    connect(watcher, &WatchManager::evicted, this, [this](int wd) {
+        if (wd == prefetchWatch) {
+            prefetchWatch = -1;
+            prefetchStale = true;
+        }
+        cache.invalidate(wd);
+    });
+
+    sortTimer->setSingleShot(true);
+    sortTimer->setInterval(kResortDelayMs);
+    connect(sortTimer, &QTimer::timeout, this, &FileModel::resort);
+
+    lister->moveToThread(&listerThread);
+    connect(&listerThread, &QThread::finished, lister, &QObject::deleteLater);
+    connect(lister, &DirectoryLister::listingReady, this, &FileModel::handleListing);
+    connect(lister, &DirectoryLister::statsReady, this, &FileModel::handleStats);
+    connect(lister, &DirectoryLister::sortReady, this, &FileModel::handleSorted);
+    listerThread.setObjectName("DirectoryLister");
+    listerThread.start();
+
+    prefetcher->moveToThread(&prefetchThread);
+    connect(&prefetchThread, &QThread::finished, prefetcher, &QObject::deleteLater);
+    connect(prefetcher, &DirectoryLister::listingReady, this, &FileModel::handlePrefetched);
+    prefetchThread.setObjectName("DirectoryPrefetcher");
+    prefetchThread.start();
+
+    connect(folderSizes, &DirectorySizes::sizeReady, this, [this](const QString& path) {
+        QModelIndex sizeIndex = index(path, SizeColumn);
+        if (sizeIndex.isValid()) emit dataChanged(sizeIndex, sizeIndex, {Qt::DisplayRole});
+    });
+    connect(thumbnails, &ThumbnailCache::thumbnailReady, this, [this](const QString& path) {
+        QModelIndex nameIndex = index(path, NameColumn);
+        if (nameIndex.isValid()) emit dataChanged(nameIndex, nameIndex, {Qt::DecorationRole});
+    });
+}
+
+FileModel::~FileModel() {
+    generation++;
+    prefetchGeneration++;
+    listerThread.quit();
+    prefetchThread.quit();
+    listerThread.wait();
+    prefetchThread.wait();
+}
+
+int FileModel::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid()) return 0;
+    return viewToEntry.isEmpty() ? visibleRows : viewToEntry.size();
+}
+
+int FileModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
 }
 
 QVariant FileModel::data(const QModelIndex& index, int role) const {
-    if (!index.isValid()) return QVariant();
-    
-    if (role == Qt::DisplayRole && index.column() == 0) {
-        return QFileSystemModel::data(index, Qt::DisplayRole);
+    PerfScope scope("FileModel::data", kSlowDataNs);
+    if (!index.isValid() || index.row() >= rowCount()) return QVariant();
+
+    const int row = entryForRow(index.row());
+    if (row < 0) {
+        // Group header: a bold title spanning the row
+        if (role == Qt::FontRole) return groupFontValue;
+        if (role == Qt::DisplayRole && index.column() == NameColumn) return groupTitles.at(-1 - row);
+        return QVariant();
     }
-    
-    if (role == Qt::DecorationRole && index.column() == 0) {
-        QFileInfo info = fileInfo(index);
-        return getFileIcon(info);
+    const quint8 flags = listing.flags.at(row);
+    const bool dir = flags & EntryDir;
+
+    // Called once per visible cell per repaint: icons come straight from the
+    // name arena and the flags, without building a QString or QFileInfo.
+    // Only files without a known suffix need their mode, to spot executables.
+    // Images and videos show the type icon until their thumbnail is loaded.
+    if (role == Qt::DecorationRole && index.column() == NameColumn) {
+        const IconCache& icons = IconCache::instance();
+        IconCache::Category category = icons.categoryForName(listing.nameData(row), listing.nameLength(row),
+                                                             dir, flags & EntryExecutable);
+        if (category == IconCache::Generic) needsField(row, EntryModeLoaded);
+        if (ThumbnailCache::canThumbnail(category) && !needsField(row, EntryMtimeLoaded)) {
+            if (thumbnailHandles.at(row) < 0) thumbnailHandles[row] = thumbnails->handle(filePath(row));
+            if (const QVariant* thumbnail = thumbnails->thumbnail(thumbnailHandles.at(row), mtimes.at(row))) return *thumbnail;
+        }
+        return icons.iconValue(category);
     }
-    
+
     if (role == Qt::FontRole) {
-        QFont font;
-        font.setPointSize(11);
-        return font;
-    }
-    
-    return QFileSystemModel::data(index, role);
-}
-
-QIcon FileModel::getFileIcon(const QFileInfo& info) const {
-    static QFileIconProvider iconProvider;
-    
-    if (info.isDir()) {
-        return QIcon(":/icons/folder.png");
-    }
-    
-    QString suffix = info.suffix().toLower();
-    
-    // Document icons
-    if (suffix == "pdf") return QIcon(":/icons/pdf.png");
-    if (suffix == "doc" || suffix == "docx") return QIcon(":/icons/doc.png");
-    if (suffix == "txt") return QIcon(":/icons/text.png");
-    if (suffix == "xls" || suffix == "xlsx") return QIcon(":/icons/spreadsheet.png");
-    
-    // Image icons
-    if (suffix == "png" || suffix == "jpg" || suffix == "jpeg" || suffix == "gif" || suffix == "bmp") {
-        return QIcon(":/icons/image.png");
-    }
-    
-    // Video icons
-    if (suffix == "mp4" || suffix == "avi" || suffix == "mkv" || suffix == "mov") {
-        return QIcon(":/icons/video.png");
-    }
-    
-    // Audio icons
-    if (suffix == "mp3" || suffix == "wav" || suffix == "flac" || suffix == "aac") {
-        return QIcon(":/icons/audio.png");
-    }
-    
-    // Archive icons
-    if (suffix == "zip" || suffix == "rar" || suffix == "tar" || suffix == "gz" || suffix == "7z") {
-        return QIcon(":/icons/archive.png");
-    }
-    
-    // Code icons
-    if (suffix == "cpp" || suffix == "c" || suffix == "h" || suffix == "hpp" || suffix == "py" || suffix == "js") {
-        return QIcon(":/icons/code.png");
-    }
-    
-    // Executable
-    if (info.isExecutable()) return QIcon(":/icons/executable.png");
-    
-    return iconProvider.icon(info);
+        return fontValue;
+    }
+
+    if (role == Qt::TextAlignmentRole && index.column() == SizeColumn) {
+        return int(Qt::AlignTrailing | Qt::AlignVCenter);
+    }
+
+    if (role != Qt::DisplayRole) return QVariant();
+
+    switch (index.column()) {
+    case NameColumn:
+        return listing.name(row);
+    case SizeColumn:
+        // Folder sizes are only asked for by visible rows of the list view,
+        // so trees get walked lazily and only when someone looks.
+        if (dir) {
+            if (isParentLink(row)) return QVariant();
+            qint64 bytes = folderSizes->size(filePath(row));
+            return bytes < 0 ? QVariant() : QVariant(QLocale::system().formattedDataSize(bytes));
+        }
+        if (needsField(row, EntrySizeLoaded)) return QVariant();
+        return QLocale::system().formattedDataSize(sizes.at(row));
+    case KindColumn: {
+        if (dir) return QString("Folder");
+        QString name = listing.name(row);
+        int dot = name.lastIndexOf('.');
+        return dot > 0 ? name.mid(dot + 1).toUpper() + " File" : QString("File");
+    }
+    case ModifiedColumn:
+        if (needsField(row, EntryMtimeLoaded)) return QVariant();
+        return QLocale::system().toString(QDateTime::fromMSecsSinceEpoch(mtimes.at(row)), QLocale::ShortFormat);
+    }
+    return QVariant();
+}
+
+QVariant FileModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case NameColumn: return QString("Name");
+        case SizeColumn: return QString("Size");
+        case KindColumn: return QString("Kind");
+        case ModifiedColumn: return QString("Date Modified");
+        }
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+Qt::ItemFlags FileModel::flags(const QModelIndex& index) const {
+    if (index.isValid() && index.row() < rowCount() && entryForRow(index.row()) < 0) return Qt::ItemIsEnabled;
+    return QAbstractTableModel::flags(index);
+}
+
+void FileModel::sort(int column, Qt::SortOrder order) {
+    sortColumn = column >= 0 && column < ColumnCount ? column : NameColumn;
+    sortOrder = order;
+    resort();
+}
+
+void FileModel::setGrouping(EntryGrouping grouping) {
+    if (grouping == groupBy) return;
+    groupBy = grouping;
+    resort();
+}
+
+QVector<int> FileModel::groupHeaderRows() const {
+    QVector<int> rows;
+    for (int row = 0; row < viewToEntry.size(); row++) {
+        if (viewToEntry.at(row) < 0) rows.append(row);
+    }
+    return rows;
+}
+
+// Name order is the order entries are stored in, so it needs no permutation.
+bool FileModel::isNameOrder() const {
+    return sortColumn == NameColumn && sortOrder == Qt::AscendingOrder && groupBy == NoGrouping;
+}
+
+bool FileModel::sortUsesStats() const {
+    return sortColumn == SizeColumn || sortColumn == ModifiedColumn || groupBy == GroupByDate;
+}
+
+void FileModel::scheduleSort() {
+    layoutVersion++;
+    if (!isNameOrder() && !sortTimer->isActive()) sortTimer->start();
+}
+
+void FileModel::resort() {
+    sortTimer->stop();
+    // handleListing() sorts once the listing is in
+    if (!listingLoaded) return;
+
+    if (isNameOrder()) {
+        if (!viewToEntry.isEmpty()) applyOrder(QVector<int>(), QStringList());
+        return;
+    }
+    requestSort();
+}
+
+// Hands the lister a snapshot: the arrays are implicitly shared, so this
+// costs a few refcounts until the model next changes them.
+void FileModel::requestSort() {
+    SortRequest request;
+    request.version = layoutVersion;
+    request.key = SortKey(sortColumn);
+    request.descending = sortOrder == Qt::DescendingOrder;
+    request.grouping = groupBy;
+    request.listing = listing;
+    request.sizes = sizes;
+    request.mtimes = mtimes;
+    QMetaObject::invokeMethod(lister, "sort", Qt::QueuedConnection, Q_ARG(int, generation.load()),
+                              Q_ARG(SortRequest, request));
+}
+
+void FileModel::handleSorted(int gen, const SortResult& result) {
+    if (gen != generation.load()) return;
+    // Entries moved or the order was changed meanwhile; a newer sort is on its way
+    if (result.version != layoutVersion || result.key != SortKey(sortColumn)
+        || result.descending != (sortOrder == Qt::DescendingOrder) || result.grouping != groupBy) {
+        return;
+    }
+
+    // Keep the stat fields the sort had to fetch
+    for (int row = 0; row < listing.size(); row++) {
+        const quint8 missing = result.fields & ~listing.flags.at(row);
+        if (!missing) continue;
+        if (missing & EntrySizeLoaded) sizes[row] = result.sizes.at(row);
+        if (missing & EntryMtimeLoaded) mtimes[row] = result.mtimes.at(row);
+        listing.flags[row] |= missing;
+    }
+
+    applyOrder(result.order, result.groups);
+}
+
+// Moves every row to its new place in one layout change, so views keep
+// their selection and current item. Group headers can change the row
+// count; the difference is inserted or removed at the bottom around the
+// layout change.
+void FileModel::applyOrder(const QVector<int>& order, const QStringList& groups) {
+    // A sorted view shows every entry; finish the chunked insertion first
+    if (visibleRows < listing.size()) {
+        chunkTimer->stop();
+        beginInsertRows(QModelIndex(), visibleRows, listing.size() - 1);
+        visibleRows = listing.size();
+        endInsertRows();
+    }
+
+    QVector<int> nameOrder(listing.size());
+    for (int row = 0; row < nameOrder.size(); row++) nameOrder[row] = row;
+    QVector<int> newOrder = order.isEmpty() ? nameOrder : order;
+    const int oldRows = rowCount();
+    const int newRows = newOrder.size();
+
+    // Padding rows are headers with an empty title
+    QStringList titles = groups;
+    titles.append(QString());
+    if (newRows > oldRows) {
+        if (viewToEntry.isEmpty()) setOrder(nameOrder);
+        groupTitles.append(QString());
+        beginInsertRows(QModelIndex(), oldRows, newRows - 1);
+        viewToEntry.insert(oldRows, newRows - oldRows, -groupTitles.size());
+        endInsertRows();
+    } else if (newRows < oldRows) {
+        newOrder.insert(newRows, oldRows - newRows, -titles.size());
+    }
+
+    emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+    const QModelIndexList from = persistentIndexList();
+    QVector<int> entries;
+    entries.reserve(from.size());
+    for (const QModelIndex& index : from) entries.append(entryForRow(index.row()));
+
+    groupTitles = titles;
+    setOrder(newOrder);
+    QModelIndexList to;
+    to.reserve(from.size());
+    for (int i = 0; i < from.size(); i++) {
+        to.append(entries.at(i) >= 0 ? createIndex(rowForEntry(entries.at(i)), from.at(i).column()) : QModelIndex());
+    }
+    changePersistentIndexList(from, to);
+    emit layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+    if (newRows < oldRows) {
+        beginRemoveRows(QModelIndex(), newRows, oldRows - 1);
+        viewToEntry.resize(newRows);
+        endRemoveRows();
+    }
+    groupTitles = groups;
+    if (order.isEmpty()) {
+        viewToEntry.clear();
+        entryToView.clear();
+    }
+    emit groupsChanged();
+}
+
+void FileModel::setOrder(const QVector<int>& order) {
+    viewToEntry = order;
+    indexEntries();
+}
+
+void FileModel::indexEntries() {
+    entryToView.fill(-1, listing.size());
+    for (int row = 0; row < viewToEntry.size(); row++) {
+        if (viewToEntry.at(row) >= 0) entryToView[viewToEntry.at(row)] = row;
+    }
+}
+
+void FileModel::setRootPath(const QString& path) {
+    // A folder being left is kept for the way back; one being reloaded is
+    // listed afresh
+    if (path != listing.path) {
+        cacheCurrent();
+    } else if (watchDescriptor >= 0) {
+        const int wd = watchDescriptor;
+        watchDescriptor = -1;
+        releaseWatch(wd);
+    }
+
+    int gen = ++generation;
+    chunkTimer->stop();
+    changeTimer->stop();
+    sortTimer->stop();
+    pendingChanges.clear();
+    listingLoaded = false;
+    thumbnails->cancelPending();
+
+    // The folder on screen is pinned. It is watched before listing, so
+    // nothing that changes meanwhile is missed; a cached folder has been
+    // watched all along and keeps its watch.
+    watchDescriptor = watcher->watch(path, true);
+    CachedListing cached;
+    const bool isCached = cache.take(path, &cached);
+
+    beginResetModel();
+    listing = DirectoryListing();
+    listing.path = path;
+    sizes.clear();
+    mtimes.clear();
+    modes.clear();
+    statRequested.clear();
+    thumbnailHandles.clear();
+    pendingStatRows.clear();
+    pendingStatFields = 0;
+    visibleRows = 0;
+    viewToEntry.clear();
+    entryToView.clear();
+    groupTitles.clear();
+    layoutVersion++;
+    endResetModel();
+    emit groupsChanged();
+
+    if (isCached) {
+        QMetaObject::invokeMethod(lister, "openDirectory", Qt::QueuedConnection, Q_ARG(int, gen), Q_ARG(QString, path));
+        showListing(cached);
+        return;
+    }
+    QMetaObject::invokeMethod(lister, "list", Qt::QueuedConnection, Q_ARG(int, gen), Q_ARG(QString, path));
+}
+
+void FileModel::handleListing(int gen, const DirectoryListing& result) {
+    if (gen != generation.load()) return;
+    if (listingLoaded && result.path == listing.path) {
+        diffListing(result);
+        return;
+    }
+
+    CachedListing entry;
+    entry.listing = result;
+    entry.sizes.fill(0, result.size());
+    entry.mtimes.fill(0, result.size());
+    entry.modes.fill(0, result.size());
+    showListing(entry);
+}
+
+// Shows a complete listing: a screenful of rows now, the rest in chunks.
+void FileModel::showListing(const CachedListing& entry) {
+    const int count = entry.listing.size();
+    beginResetModel();
+    listing = entry.listing;
+    sizes = entry.sizes;
+    mtimes = entry.mtimes;
+    modes = entry.modes;
+    statRequested.fill(0, count);
+    thumbnailHandles.fill(-1, count);
+    visibleRows = qMin(count, kFirstChunkRows);
+    listingLoaded = true;
+    deadNameChars = 0;
+    endResetModel();
+
+    if (visibleRows < count) chunkTimer->start();
+    if (!pendingChanges.isEmpty()) changeTimer->start();
+    // Shown in name order until the lister has sorted it
+    if (!isNameOrder()) requestSort();
+    emit directoryLoaded(listing.path);
+}
+
+void FileModel::refreshIfUnwatched() {
+    if (listing.path.isEmpty() || watchDescriptor >= 0) return;
+    QMetaObject::invokeMethod(lister, "list", Qt::QueuedConnection,
+                              Q_ARG(int, generation.load()), Q_ARG(QString, listing.path));
+}
+
+// Turns the difference between the rows and a fresh listing of the same
+// folder into pending changes, applied by flushChanges like watch events.
+// Both are in name order, so one merge pass finds them.
+void FileModel::diffListing(const DirectoryListing& fresh) {
+    int row = 0;
+    int freshRow = 0;
+    while (row < listing.size() || freshRow < fresh.size()) {
+        int order;
+        if (row == listing.size()) order = 1;
+        else if (freshRow == fresh.size()) order = -1;
+        else order = DirectoryLister::compare(listing.nameData(row), listing.nameLength(row), listing.flags.at(row) & EntryDir,
+                                              fresh.nameData(freshRow), fresh.nameLength(freshRow), fresh.flags.at(freshRow) & EntryDir);
+        if (order < 0) {
+            pendingChanges[listing.name(row++)] = ChangeRemoved;
+        } else if (order > 0) {
+            pendingChanges[fresh.name(freshRow)] = ChangeAdded | ((fresh.flags.at(freshRow) & EntryDir) ? ChangeIsDir : 0);
+            freshRow++;
+        } else {
+            row++;
+            freshRow++;
+        }
+    }
+
+    // Files kept may have been written to; their stat fields are fetched
+    // again the next time they are painted
+    for (int entry = 0; entry < listing.size(); entry++) {
+        listing.flags[entry] &= ~(kStatLoadedFlags | EntryExecutable);
+        statRequested[entry] = 0;
+    }
+    if (rowCount() > 0) {
+        emit dataChanged(index(0, 0), index(rowCount() - 1, ColumnCount - 1));
+        if (sortUsesStats()) scheduleSort();
+    }
+
+    if (!pendingChanges.isEmpty() && !changeTimer->isActive()) changeTimer->start();
+}
+
+// Hands the folder on screen, and its watch, to the cache. Only a complete
+// listing with every change applied is worth keeping.
+void FileModel::cacheCurrent() {
+    const int wd = watchDescriptor;
+    watchDescriptor = -1;
+    if (wd < 0) return;
+    if (!listingLoaded || !pendingChanges.isEmpty()) {
+        releaseWatch(wd);
+        return;
+    }
+
+    CachedListing entry;
+    entry.listing = listing;
+    entry.sizes = sizes;
+    entry.mtimes = mtimes;
+    entry.modes = modes;
+    entry.watchDescriptor = wd;
+    watcher->setPinned(wd, false);
+    for (int released : cache.insert(entry)) releaseWatch(released);
+}
+
+// Drops a watch nothing needs anymore.
+void FileModel::releaseWatch(int wd) {
+    if (wd < 0 || wd == watchDescriptor || wd == prefetchWatch || cache.holdsWatch(wd)) return;
+    watcher->unwatch(wd);
+}
+
+bool FileModel::saveListing(const QString& fileName) const {
+    if (!listingLoaded || !pendingChanges.isEmpty()) return false;
+    CachedListing entry;
+    entry.listing = listing;
+    return ListingCache::save(entry, fileName);
+}
+
+bool FileModel::restoreListing(const QString& fileName) {
+    CachedListing entry;
+    if (!ListingCache::load(fileName, &entry) || entry.listing.path == listing.path) return false;
+    for (int released : cache.insert(entry)) releaseWatch(released);
+    return true;
+}
+
+void FileModel::prefetch(const QString& path) {
+    if (path.isEmpty() || path == listing.path || path == prefetchPath || cache.contains(path)) return;
+    prefetchQueue.removeOne(path);
+    prefetchQueue.prepend(path);
+    while (prefetchQueue.size() > kPrefetchQueue) prefetchQueue.removeLast();
+    if (prefetchPath.isEmpty()) startPrefetch();
+}
+
+void FileModel::startPrefetch() {
+    while (!prefetchQueue.isEmpty()) {
+        const QString path = prefetchQueue.takeFirst();
+        if (path == listing.path || cache.contains(path)) continue;
+
+        // Watched before listing, like the folder on screen
+        prefetchWatch = watcher->watch(path);
+        if (prefetchWatch < 0) continue;
+        prefetchPath = path;
+        prefetchStale = false;
+        QMetaObject::invokeMethod(prefetcher, "list", Qt::QueuedConnection,
+                                  Q_ARG(int, prefetchGeneration.load()), Q_ARG(QString, path));
+        return;
+    }
+}
+
+void FileModel::handlePrefetched(int gen, const DirectoryListing& result) {
+    if (gen != prefetchGeneration.load()) return;
+
+    const int wd = prefetchWatch;
+    prefetchPath.clear();
+    prefetchWatch = -1;
+    // Unreadable, changed while being read, or opened (and listed) meanwhile
+    if (result.modified < 0 || prefetchStale || wd < 0 || result.path == listing.path) {
+        releaseWatch(wd);
+    } else {
+        CachedListing entry;
+        entry.listing = result;
+        entry.sizes.fill(0, result.size());
+        entry.mtimes.fill(0, result.size());
+        entry.modes.fill(0, result.size());
+        entry.watchDescriptor = wd;
+        for (int released : cache.insert(entry)) releaseWatch(released);
+    }
+    startPrefetch();
+}
+
+void FileModel::handleStats(int gen, const DirectoryStats& stats) {
+    if (gen != generation.load() || stats.rows.isEmpty()) return;
+
+    int firstRow = listing.size();
+    int lastRow = -1;
+    for (int i = 0; i < stats.rows.size(); i++) {
+        // Rows shift as files come and go; follow the name if this one moved
+        int row = stats.rows.at(i);
+        const QString& name = stats.names.at(i);
+        if (row >= listing.size() || listing.nameLength(row) != name.size()
+            || !std::equal(name.constData(), name.constData() + name.size(), listing.nameData(row))) {
+            row = rowForName(name);
+            if (row < 0) continue;
+        }
+
+        if (stats.fields & EntrySizeLoaded) sizes[row] = stats.sizes.at(i);
+        if (stats.fields & EntryMtimeLoaded) mtimes[row] = stats.mtimes.at(i);
+        if (stats.fields & EntryModeLoaded) {
+            modes[row] = stats.modes.at(i);
+            if (!(listing.flags.at(row) & EntryDir) && (stats.modes.at(i) & S_IXUSR)) {
+                listing.flags[row] |= EntryExecutable;
+            }
+        }
+        listing.flags[row] |= stats.fields;
+        statRequested[row] &= ~stats.fields;
+
+        firstRow = qMin(firstRow, rowForEntry(row));
+        lastRow = qMax(lastRow, rowForEntry(row));
+    }
+
+    lastRow = qMin(lastRow, rowCount() - 1);
+    if (lastRow >= firstRow) {
+        emit dataChanged(index(firstRow, 0), index(lastRow, ColumnCount - 1));
+    }
+}
+
+// Returns true (and queues a fetch) while the field is not loaded yet.
+bool FileModel::needsField(int row, quint8 field) const {
+    if (listing.flags.at(row) & field) return false;
+    if (statRequested.at(row) & field) return true;
+
+    pendingStatRows.append(row);
+    statRequested[row] |= field;
+    pendingStatFields |= field;
+    if (!statTimer->isActive()) statTimer->start();
+    return true;
+}
+
+void FileModel::flushStatRequests() {
+    if (pendingStatRows.isEmpty()) return;
+
+    std::sort(pendingStatRows.begin(), pendingStatRows.end());
+    pendingStatRows.erase(std::unique(pendingStatRows.begin(), pendingStatRows.end()), pendingStatRows.end());
+    QStringList names;
+    names.reserve(pendingStatRows.size());
+    for (int row : qAsConst(pendingStatRows)) names.append(listing.name(row));
+    QMetaObject::invokeMethod(lister, "fetchStats", Qt::QueuedConnection, Q_ARG(int, generation.load()),
+                              Q_ARG(QVector<int>, pendingStatRows), Q_ARG(QStringList, names),
+                              Q_ARG(int, pendingStatFields));
+    pendingStatRows.clear();
+    pendingStatFields = 0;
+}
+
+void FileModel::insertNextChunk() {
+    if (visibleRows >= listing.size()) return;
+
+    int last = qMin(visibleRows + kChunkRows, listing.size()) - 1;
+    beginInsertRows(QModelIndex(), visibleRows, last);
+    visibleRows = last + 1;
+    endInsertRows();
+
+    if (visibleRows < listing.size()) chunkTimer->start();
+}
+
+void FileModel::handleEvents(const QVector<InotifyEvent>& events) {
+    for (const InotifyEvent& event : events) {
+        if (event.wd != watchDescriptor) {
+            // A folder kept for later changed: it gets listed afresh
+            if (event.wd == prefetchWatch) prefetchStale = true;
+            else if (cache.invalidate(event.wd)) releaseWatch(event.wd);
+            continue;
+        }
+
+        // The folder itself was deleted or moved away
+        if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            setRootPath(listing.path);
+            return;
+        }
+        if (event.name.isEmpty() || event.name.startsWith('.')) continue;
+
+        quint8& change = pendingChanges[event.name];
+        if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+            change = ChangeAdded | ((event.mask & IN_ISDIR) ? ChangeIsDir : 0);
+        } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            change = ChangeRemoved;
+        } else if (!change) {
+            change = ChangeModified;
+        }
+    }
+
+    if (!pendingChanges.isEmpty() && listingLoaded && !changeTimer->isActive()) changeTimer->start();
+}
+
+// Turns the changes collected over the last frame into row removals,
+// insertions and dataChanged, so views keep their scroll position and
+// selection instead of being reset.
+void FileModel::flushChanges() {
+    if (!listingLoaded || pendingChanges.isEmpty()) return;
+
+    // Queued stat requests name rows by position, which is about to change
+    flushStatRequests();
+
+    QStringList removed;
+    QStringList added;
+    QStringList modified;
+    for (auto it = pendingChanges.constBegin(); it != pendingChanges.constEnd(); ++it) {
+        if (it.value() & ChangeRemoved) removed.append(it.key());
+        else if (it.value() & ChangeAdded) added.append(it.key());
+        else modified.append(it.key());
+    }
+
+    QElapsedTimer budget;
+    budget.start();
+    applyModifications(modified);
+    if (applyRemovals(removed, budget)) applyAdditions(added, budget);
+
+    if (deadNameChars > 4096 && deadNameChars > listing.names.size() / 2) compactNames();
+    if (!pendingChanges.isEmpty()) changeTimer->start();
+}
+
+bool FileModel::applyRemovals(const QStringList& names, const QElapsedTimer& budget) {
+    QVector<int> rows;
+    for (const QString& name : names) {
+        int row = rowForName(name);
+        if (row >= 0) rows.append(row);
+        else pendingChanges.remove(name);
+    }
+
+    // Bottom up, one removal per run of adjacent rows
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    for (int i = 0; i < rows.size(); ) {
+        if (budget.elapsed() >= kFrameBudgetMs) return false;
+
+        const int last = rows.at(i);
+        int first = last;
+        int j = i + 1;
+        while (j < rows.size() && rows.at(j) == first - 1) {
+            first--;
+            j++;
+        }
+        for (int row = first; row <= last; row++) pendingChanges.remove(listing.name(row));
+        removeEntries(first, last);
+        i = j;
+    }
+    return true;
+}
+
+bool FileModel::applyAdditions(const QStringList& names, const QElapsedTimer& budget) {
+    struct Addition {
+        QString name;
+        quint8 flags;
+        int position;
+    };
+
+    // inotify marks folders; files only need a look to spot symlinks
+    const QByteArray dir = QFile::encodeName(listing.path.endsWith('/') ? listing.path : listing.path + '/');
+    QVector<Addition> additions;
+    QStringList modified;
+    for (const QString& name : names) {
+        if (budget.elapsed() >= kFrameBudgetMs) break;
+
+        const QByteArray path = dir + QFile::encodeName(name);
+        quint8 flags = 0;
+        struct stat st;
+        if (pendingChanges.value(name) & ChangeIsDir) {
+            flags = EntryDir;
+        } else if (::lstat(path.constData(), &st) != 0) {
+            // Created and gone again before we looked
+            pendingChanges.remove(name);
+            continue;
+        } else if (S_ISDIR(st.st_mode)) {
+            flags = EntryDir;
+        } else if (S_ISLNK(st.st_mode)) {
+            flags = EntrySymLink;
+            if (::stat(path.constData(), &st) == 0 && S_ISDIR(st.st_mode)) flags |= EntryDir;
+        }
+
+        int existing = rowForName(name);
+        if (existing >= 0) {
+            if ((listing.flags.at(existing) & (EntryDir | EntrySymLink)) == flags) {
+                // Replaced by an entry of the same kind, e.g. an atomic save
+                modified.append(name);
+                continue;
+            }
+            // A file replaced by a folder (or back) sorts elsewhere
+            removeEntries(existing, existing);
+        }
+        additions.append(Addition{name, flags, 0});
+    }
+    applyModifications(modified);
+
+    std::sort(additions.begin(), additions.end(), [](const Addition& a, const Addition& b) {
+        return DirectoryLister::compare(a.name.constData(), a.name.size(), a.flags & EntryDir,
+                                        b.name.constData(), b.name.size(), b.flags & EntryDir) < 0;
+    });
+    for (Addition& addition : additions) {
+        addition.position = insertPosition(addition.name, addition.flags & EntryDir);
+    }
+
+    // Names landing between the same two existing rows go in as one insert;
+    // earlier inserts push later positions down.
+    int shift = 0;
+    for (int i = 0; i < additions.size(); ) {
+        if (i > 0 && budget.elapsed() >= kFrameBudgetMs) return false;
+
+        int j = i;
+        QStringList groupNames;
+        QVector<quint8> groupFlags;
+        while (j < additions.size() && additions.at(j).position == additions.at(i).position) {
+            groupNames.append(additions.at(j).name);
+            groupFlags.append(additions.at(j).flags);
+            pendingChanges.remove(additions.at(j).name);
+            j++;
+        }
+        insertEntries(additions.at(i).position + shift, groupNames, groupFlags);
+        shift += groupNames.size();
+        i = j;
+    }
+    return true;
+}
+
+void FileModel::applyModifications(const QStringList& names) {
+    int firstRow = INT_MAX;
+    int lastRow = -1;
+    for (const QString& name : names) {
+        pendingChanges.remove(name);
+        int row = rowForName(name);
+        if (row < 0) continue;
+
+        // Stat fields are fetched again the next time the row is painted
+        listing.flags[row] &= ~(kStatLoadedFlags | EntryExecutable);
+        statRequested[row] = 0;
+        firstRow = qMin(firstRow, rowForEntry(row));
+        lastRow = qMax(lastRow, rowForEntry(row));
+    }
+
+    lastRow = qMin(lastRow, rowCount() - 1);
+    if (lastRow >= firstRow) {
+        emit dataChanged(index(firstRow, 0), index(lastRow, ColumnCount - 1));
+        // New sizes or dates may move the rows
+        if (sortUsesStats()) scheduleSort();
+    }
+}
+
+void FileModel::removeEntries(int first, int last) {
+    scheduleSort();
+    if (!viewToEntry.isEmpty()) {
+        // Sorted: the entries' rows are scattered, remove them bottom up
+        QVector<int> rows;
+        for (int entry = first; entry <= last; entry++) rows.append(entryToView.at(entry));
+        std::sort(rows.begin(), rows.end(), std::greater<int>());
+        for (int i = 0; i < rows.size(); ) {
+            int j = i + 1;
+            while (j < rows.size() && rows.at(j) == rows.at(j - 1) - 1) j++;
+            beginRemoveRows(QModelIndex(), rows.at(j - 1), rows.at(i));
+            viewToEntry.remove(rows.at(j - 1), j - i);
+            endRemoveRows();
+            i = j;
+        }
+
+        const int count = last - first + 1;
+        eraseEntries(first, last);
+        for (int& entry : viewToEntry) {
+            if (entry > last) entry -= count;
+        }
+        indexEntries();
+        visibleRows -= count;
+        return;
+    }
+
+    // Rows the chunked insertion has not shown yet just disappear
+    if (last >= visibleRows) {
+        const int hiddenFirst = qMax(first, visibleRows);
+        eraseEntries(hiddenFirst, last);
+        last = hiddenFirst - 1;
+        if (last < first) return;
+    }
+
+    beginRemoveRows(QModelIndex(), first, last);
+    eraseEntries(first, last);
+    visibleRows -= last - first + 1;
+    endRemoveRows();
+}
+
+void FileModel::eraseEntries(int first, int last) {
+    const int count = last - first + 1;
+    for (int row = first; row <= last; row++) deadNameChars += listing.nameLength(row);
+
+    listing.nameOffsets.remove(first, count);
+    listing.nameLengths.remove(first, count);
+    listing.flags.remove(first, count);
+    sizes.remove(first, count);
+    mtimes.remove(first, count);
+    modes.remove(first, count);
+    statRequested.remove(first, count);
+    thumbnailHandles.remove(first, count);
+}
+
+void FileModel::insertEntries(int position, const QStringList& names, const QVector<quint8>& flags) {
+    const int count = names.size();
+    scheduleSort();
+    // Past the rows shown so far, the chunked insertion will get to them.
+    // While sorted, new rows go at the bottom until the re-sort places them.
+    const bool sorted = !viewToEntry.isEmpty();
+    const bool visible = sorted || position < visibleRows || visibleRows == listing.size();
+    const int first = sorted ? viewToEntry.size() : position;
+    if (visible) beginInsertRows(QModelIndex(), first, first + count - 1);
+
+    listing.nameOffsets.insert(position, count, 0);
+    listing.nameLengths.insert(position, count, 0);
+    listing.flags.insert(position, count, 0);
+    sizes.insert(position, count, 0);
+    mtimes.insert(position, count, 0);
+    modes.insert(position, count, 0);
+    statRequested.insert(position, count, 0);
+    thumbnailHandles.insert(position, count, -1);
+    for (int i = 0; i < count; i++) {
+        const int row = position + i;
+        listing.nameOffsets[row] = quint32(listing.names.size());
+        listing.names += names.at(i);
+        listing.nameLengths[row] = quint8(qMin(names.at(i).size(), 255));
+        listing.flags[row] = flags.at(i);
+    }
+    if (sorted) {
+        for (int& entry : viewToEntry) {
+            if (entry >= position) entry += count;
+        }
+        for (int i = 0; i < count; i++) viewToEntry.append(position + i);
+        indexEntries();
+    }
+
+    if (visible) {
+        visibleRows += count;
+        endInsertRows();
+    }
+}
+
+// Removed rows leave their names behind in the arena; rebuild it once
+// enough of it is dead. Row numbers don't change, so views aren't told.
+void FileModel::compactNames() {
+    QString names;
+    names.reserve(listing.names.size() - deadNameChars);
+    for (int row = 0; row < listing.size(); row++) {
+        const quint32 offset = quint32(names.size());
+        names.append(listing.nameData(row), listing.nameLength(row));
+        listing.nameOffsets[row] = offset;
+    }
+    listing.names = names;
+    deadNameChars = 0;
+}
+
+QString FileModel::fileName(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rowCount()) return QString();
+    const int row = entryForRow(index.row());
+    return row >= 0 ? listing.name(row) : QString();
+}
+
+// Empty for group headers, which stand for no file.
+QString FileModel::filePath(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rowCount()) return QString();
+    const int row = entryForRow(index.row());
+    return row >= 0 ? filePath(row) : QString();
+}
+
+QString FileModel::filePath(int row) const {
+    // ".." opens the parent folder, so hand out its real path
+    if (isParentLink(row)) return QFileInfo(listing.path).absolutePath();
+
+    QString name = listing.name(row);
+    return listing.path.endsWith('/') ? listing.path + name : listing.path + '/' + name;
+}
+
+QFileInfo FileModel::fileInfo(const QModelIndex& index) const {
+    return QFileInfo(filePath(index));
+}
+
+bool FileModel::isDir(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rowCount()) return false;
+    const int row = entryForRow(index.row());
+    return row >= 0 && (listing.flags.at(row) & EntryDir);
+}
+
+QModelIndex FileModel::index(const QString& path, int column) const {
+    int slash = path.lastIndexOf('/');
+    QString dir = slash > 0 ? path.left(slash) : QString("/");
+    if (slash < 0 || QDir::cleanPath(dir) != QDir::cleanPath(listing.path)) return QModelIndex();
+
+    // Entries are sorted with folders first, so try both halves
+    int row = rowForName(path.mid(slash + 1));
+    return row >= 0 && row < visibleRows ? index(rowForEntry(row), column) : QModelIndex();
+}
+
+bool FileModel::isParentLink(int row) const {
+    return listing.nameLength(row) == 2 && listing.nameData(row)[0] == QLatin1Char('.')
+        && listing.nameData(row)[1] == QLatin1Char('.');
+}
+
+int FileModel::rowForName(const QString& name) const {
+    int row = rowForName(name, true);
+    return row >= 0 ? row : rowForName(name, false);
+}
+
+// Where an entry that is not listed yet belongs in display order.
+int FileModel::insertPosition(const QString& name, bool isDir) const {
+    int low = 0;
+    int high = listing.size();
+    while (low < high) {
+        int middle = (low + high) / 2;
+        int order = DirectoryLister::compare(listing.nameData(middle), listing.nameLength(middle),
+                                             listing.flags.at(middle) & EntryDir,
+                                             name.constData(), name.size(), isDir);
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Binary search in display order, using the lister's comparison.
+int FileModel::rowForName(const QString& name, bool isDir) const {
+    int low = 0;
+    int high = listing.size() - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        int order = DirectoryLister::compare(listing.nameData(middle), listing.nameLength(middle),
+                                             listing.flags.at(middle) & EntryDir,
+                                             name.constData(), name.size(), isDir);
+        if (order == 0) return middle;
+        if (order < 0) low = middle + 1;
+        else high = middle - 1;
+    }
+    return -1;
 }
@@ -1,19 +1,194 @@
 #ifndef FILEMODEL_H
 #define FILEMODEL_H
 
-#include <QFileSystemModel>
-#include <QSortFilterProxyModel>
+#include <QAbstractTableModel>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <atomic>
+#include "directorylister.h"
+#include "directorysizes.h"
+#include "listingcache.h"
+#include "thumbnailcache.h"
+#include "watchmanager.h"
 
-class FileModel : public QFileSystemModel {
+// Flat model of one directory. Listing, sorting and stat calls happen on a
+// background thread; the model keeps entries as parallel arrays and inserts
+// rows in chunks so huge folders show their first screenful right away.
+// Entries are always stored in name order; other sort orders and grouping
+// are a permutation computed off-thread and applied as one layout change.
+// Stat fields are fetched lazily, only for the cells views actually paint.
+// Changes on disk arrive through inotify and are applied as row inserts,
+// removals and dataChanged, a frame's worth at a time. Folders left behind
+// and folders prefetched (on a second lister, so navigation never waits
+// behind a guess) stay in a ListingCache and open without being re-listed.
+class FileModel : public QAbstractTableModel {
     Q_OBJECT
 
 public:
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        KindColumn,
+        ModifiedColumn,
+        ColumnCount
+    };
+
     explicit FileModel(QObject *parent = nullptr);
-    
+    ~FileModel();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
-    
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    // Returns right away; rows are reordered once the lister has sorted them.
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    // Splits the rows into groups, each under a header row that has no file.
+    void setGrouping(EntryGrouping grouping);
+    EntryGrouping grouping() const { return groupBy; }
+    QVector<int> groupHeaderRows() const;
+
+    // Starts listing path; rows appear once the sorted listing is ready,
+    // or right away if the folder is cached and unchanged.
+    void setRootPath(const QString& path);
+    // Lists path in the background so opening it later is instant. The
+    // latest requests go first; older ones are dropped if more pile up.
+    void prefetch(const QString& path);
+    // Catches the folder on screen up with changes the app made itself when
+    // it has no watch to report them (the inotify limit was reached): it is
+    // listed again in the background and the difference applied in place.
+    void refreshIfUnwatched();
+    // Writes the folder on screen to fileName for the next session, and
+    // caches one written earlier (used by setRootPath if still current).
+    bool saveListing(const QString& fileName) const;
+    bool restoreListing(const QString& fileName);
+    QString rootPath() const { return listing.path; }
+
+    QString fileName(const QModelIndex& index) const;
+    QString filePath(const QModelIndex& index) const;
+    QFileInfo fileInfo(const QModelIndex& index) const;
+    bool isDir(const QModelIndex& index) const;
+    using QAbstractTableModel::index;
+    QModelIndex index(const QString& path, int column = 0) const;
+
+    // Entries listed, including rows the chunked insertion hasn't shown yet
+    int entryCount() const { return listing.size(); }
+
+    // Recursive folder totals shown in the Size column and in Get Info
+    DirectorySizes* directorySizes() const { return folderSizes; }
+    ThumbnailCache* thumbnailCache() const { return thumbnails; }
+
+signals:
+    void directoryLoaded(const QString& path);
+    // Header rows were added, removed or moved (see groupHeaderRows())
+    void groupsChanged();
+
+private slots:
+    void handleListing(int generation, const DirectoryListing& listing);
+    void handlePrefetched(int generation, const DirectoryListing& listing);
+    void handleStats(int generation, const DirectoryStats& stats);
+    void handleSorted(int generation, const SortResult& result);
+    void resort();
+    void insertNextChunk();
+    void flushStatRequests();
+    void handleEvents(const QVector<InotifyEvent>& events);
+    void flushChanges();
+
 private:
-    QIcon getFileIcon(const QFileInfo& info) const;
+    bool isNameOrder() const;
+    bool sortUsesStats() const;
+    int entryForRow(int row) const { return viewToEntry.isEmpty() ? row : viewToEntry.at(row); }
+    int rowForEntry(int entry) const { return entryToView.isEmpty() ? entry : entryToView.at(entry); }
+    void scheduleSort();
+    void requestSort();
+    void applyOrder(const QVector<int>& order, const QStringList& groups);
+    void setOrder(const QVector<int>& order);
+    void indexEntries();
+    void showListing(const CachedListing& entry);
+    void diffListing(const DirectoryListing& fresh);
+    void cacheCurrent();
+    void releaseWatch(int wd);
+    void startPrefetch();
+    QString filePath(int row) const;
+    bool isParentLink(int row) const;
+    bool needsField(int row, quint8 field) const;
+    int rowForName(const QString& name, bool isDir) const;
+    int rowForName(const QString& name) const;
+    int insertPosition(const QString& name, bool isDir) const;
+    bool applyRemovals(const QStringList& names, const QElapsedTimer& budget);
+    bool applyAdditions(const QStringList& names, const QElapsedTimer& budget);
+    void applyModifications(const QStringList& names);
+    void removeEntries(int first, int last);
+    void eraseEntries(int first, int last);
+    void insertEntries(int position, const QStringList& names, const QVector<quint8>& flags);
+    void compactNames();
+
+    QThread listerThread;
+    std::atomic<int> generation;
+    DirectoryLister* lister;
+
+    // Current directory: names and flags from the listing, stat fields
+    // filled in as batches arrive. Rows past visibleRows are not inserted yet.
+    DirectoryListing listing;
+    QVector<qint64> sizes;
+    QVector<qint64> mtimes;
+    QVector<quint32> modes;
+    int visibleRows;
+    QTimer* chunkTimer;
+
+    // Stat fields requested per row (in flight or pending), and the rows
+    // data() asked about during this event loop pass.
+    mutable QVector<quint8> statRequested;
+    // ThumbnailCache handle per row, taken the first time it is painted (-1 until then)
+    mutable QVector<int> thumbnailHandles;
+    mutable QVector<int> pendingStatRows;
+    mutable quint8 pendingStatFields;
+    QTimer* statTimer;
+
+    // Names changed on disk since the last flush and how (see flushChanges)
+    WatchManager* watcher;
+    int watchDescriptor;
+    QHash<QString, quint8> pendingChanges;
+    QTimer* changeTimer;
+    bool listingLoaded;
+    // Arena characters no longer referenced by any row
+    int deadNameChars;
+
+    // Display order. viewToEntry maps rows to entries, with group headers
+    // as -1 - group; both maps are empty while rows are in name order.
+    // layoutVersion changes whenever entries move, so sorts of an older
+    // snapshot are dropped.
+    int sortColumn;
+    Qt::SortOrder sortOrder;
+    EntryGrouping groupBy;
+    QVector<int> viewToEntry;
+    QVector<int> entryToView;
+    QStringList groupTitles;
+    int layoutVersion;
+    QTimer* sortTimer;
+
+    // Folders to open without listing. Each keeps an unpinned watch, so the
+    // WatchManager's limit bounds them too. The prefetch in flight has its
+    // watch already; a change meanwhile makes its result stale.
+    ListingCache cache;
+    QThread prefetchThread;
+    std::atomic<int> prefetchGeneration;
+    DirectoryLister* prefetcher;
+    QStringList prefetchQueue;
+    QString prefetchPath;
+    int prefetchWatch;
+    bool prefetchStale;
+
+    // Returned by data() as-is: copying a QVariant only bumps a refcount.
+    QVariant fontValue;
+    QVariant groupFontValue;
+
+    DirectorySizes* folderSizes;
+    ThumbnailCache* thumbnails;
 };
 
 #endif // FILEMODEL_H
@@ -0,0 +1,512 @@
+#include "fileoperations.h"
+#include "copybackend.h"
+#include "trashbackend.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace {
+
+const int kProgressIntervalMs = 100;
+
+// Tree copy tuning: files below kSmallFileLimit are grouped into batches of
+// up to kBatchFiles files or kBatchBytes bytes per pool task.
+const qint64 kSmallFileLimit = 256 * 1024;
+const int kBatchFiles = 64;
+const qint64 kBatchBytes = 4 * 1024 * 1024;
+const int kBatchesPerWorker = 4;
+const int kMaxCopyWorkers = 32;
+
+// Finder-style "name copy.ext", "name copy 2.ext" when the target already exists.
+QString uniqueDestination(const QString& dir, const QString& name) {
+    QString candidate = dir + "/" + name;
+    if (!QFileInfo(candidate).exists() && !QFileInfo(candidate).isSymLink()) return candidate;
+
+    QString base = name;
+    QString ext;
+    int dot = name.lastIndexOf('.');
+    if (dot > 0) {
+        base = name.left(dot);
+        ext = name.mid(dot);
+    }
+
+    for (int n = 1; ; n++) {
+        QString suffix = n == 1 ? QString(" copy") : QString(" copy %1").arg(n);
+        candidate = dir + "/" + base + suffix + ext;
+        if (!QFileInfo(candidate).exists() && !QFileInfo(candidate).isSymLink()) return candidate;
+    }
+}
+
+} // namespace
+
+// FileOperationControl
+
+void FileOperationControl::requestCancel(int jobId) {
+    QMutexLocker locker(&mutex);
+    cancelled.insert(jobId);
+    resumed.wakeAll();
+}
+
+bool FileOperationControl::isCancelled(int jobId) const {
+    QMutexLocker locker(&mutex);
+    return cancelled.contains(jobId);
+}
+
+void FileOperationControl::clearCancel(int jobId) {
+    QMutexLocker locker(&mutex);
+    cancelled.remove(jobId);
+}
+
+void FileOperationControl::setPaused(bool value) {
+    QMutexLocker locker(&mutex);
+    paused.store(value);
+    if (!value) resumed.wakeAll();
+}
+
+bool FileOperationControl::waitIfPaused(int jobId) {
+    QMutexLocker locker(&mutex);
+    while (paused.load() && !cancelled.contains(jobId)) {
+        resumed.wait(&mutex);
+    }
+    return !cancelled.contains(jobId);
+}
+
+// FileOperationWorker
+
+FileOperationWorker::FileOperationWorker(FileOperationControl* control, QObject *parent)
+    : QObject(parent)
+    , control(control)
+    , batchSlots(nullptr)
+    , batchBytes(0)
+    , bytesDone(0)
+    , bytesTotal(0)
+    , filesDone(0)
+    , filesTotal(0)
+    , pausedMs(0)
+{
+}
+
+void FileOperationWorker::run(const FileOperationJob& job) {
+    current = job;
+    errors.clear();
+    bytesDone = 0;
+    bytesTotal = 0;
+    filesDone = 0;
+    filesTotal = 0;
+    pausedMs = 0;
+
+    if (job.kind == FileOperationJob::Trash || job.kind == FileOperationJob::Delete) {
+        remove(job);
+        return;
+    }
+
+    bool isMove = job.kind == FileOperationJob::Move;
+    emit jobStarted(job.id, QString("%1 %2 item(s) to %3")
+                    .arg(isMove ? "Moving" : "Copying")
+                    .arg(job.sources.size())
+                    .arg(job.destDir));
+
+    if (aborted()) {
+        control->clearCancel(job.id);
+        emit jobFinished(job.id, true, errors);
+        return;
+    }
+
+    // Keep a few batches queued per thread so the disk always has work,
+    // without letting enumeration of a huge tree run unboundedly ahead.
+    int workers = FileOperationQueue::copyWorkers();
+    pool.setMaxThreadCount(workers);
+    QSemaphore capacity(workers * kBatchesPerWorker);
+    batchSlots = &capacity;
+
+    progressTimer.start();
+    transferTimer.start();
+    reportProgress(true);
+
+    // Moves within one filesystem are a plain rename; everything else is copied.
+    QStringList copiedSources;
+    for (const QString& source : job.sources) {
+        QFileInfo info(source);
+        QString name = info.fileName();
+
+        if (isMove && info.absolutePath() == QDir(job.destDir).absolutePath()) {
+            continue;
+        }
+
+        if (info.isDir() && !info.isSymLink()
+            && (job.destDir + "/").startsWith(info.absoluteFilePath() + "/")) {
+            addError(QString("Cannot copy \"%1\" into itself").arg(name));
+            continue;
+        }
+
+        QString dest = uniqueDestination(job.destDir, name);
+        if (isMove && dest == job.destDir + "/" + name && QFile::rename(source, dest)) {
+            filesTotal++;
+            filesDone++;
+            continue;
+        }
+
+        if (transfer(info, dest)) {
+            copiedSources.append(source);
+        }
+        if (aborted()) break;
+    }
+
+    flushBatch();
+    waitForPool();
+    batchSlots = nullptr;
+
+    bool cancelled = aborted();
+    if (isMove && !cancelled && errors.isEmpty()) {
+        for (const QString& source : copiedSources) {
+            QFileInfo info(source);
+            bool removed = info.isDir() && !info.isSymLink()
+                ? QDir(source).removeRecursively()
+                : QFile::remove(source);
+            if (!removed) {
+                errors.append(QString("Could not remove \"%1\" after moving it").arg(source));
+            }
+        }
+    }
+
+    reportProgress(true);
+    control->clearCancel(job.id);
+    emit jobFinished(job.id, cancelled, errors);
+}
+
+void FileOperationWorker::remove(const FileOperationJob& job) {
+    const bool toTrash = job.kind == FileOperationJob::Trash;
+    emit jobStarted(job.id, toTrash ? QString("Moving %1 item(s) to Trash").arg(job.sources.size())
+                                    : QString("Deleting %1 item(s)").arg(job.sources.size()));
+
+    progressTimer.start();
+    transferTimer.start();
+
+    if (toTrash) {
+        // One rename per selected item, so the total is known up front
+        filesTotal = job.sources.size();
+        reportProgress(true);
+        errors += TrashBackend::moveToTrash(job.sources, [this]() {
+            filesDone++;
+            reportProgress();
+            return control->waitIfPaused(current.id);
+        });
+    } else {
+        // Trees are walked in parallel, so the total stays unknown (0)
+        reportProgress(true);
+        pool.setMaxThreadCount(FileOperationQueue::copyWorkers());
+        for (const QString& source : job.sources) {
+            if (aborted()) break;
+            removePath(source);
+        }
+        waitForPool();
+        removeDirectories();
+    }
+
+    bool cancelled = aborted();
+    reportProgress(true);
+    control->clearCancel(job.id);
+    emit jobFinished(job.id, cancelled, errors);
+}
+
+void FileOperationWorker::removePath(const QString& path) {
+    const QByteArray nativePath = QFile::encodeName(path);
+    struct stat st;
+    if (lstat(nativePath.constData(), &st) != 0) {
+        addError(QString("\"%1\" no longer exists").arg(path));
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        pool.start([this, nativePath]() { removeDirectory(nativePath, 0); });
+    } else if (unlink(nativePath.constData()) == 0) {
+        filesDone++;
+    } else {
+        addError(QString("Could not delete \"%1\": %2").arg(path, QString::fromLocal8Bit(strerror(errno))));
+    }
+}
+
+// Runs on a pool thread. Unlinks a folder's files through its fd and hands
+// each subfolder to the pool as a task of its own; the emptied folder itself
+// is removed later by removeDirectories().
+void FileOperationWorker::removeDirectory(const QByteArray& path, int depth) {
+    if (!control->waitIfPaused(current.id)) return;
+
+    int fd = open(path.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        addError(QString("Could not open \"%1\": %2").arg(QFile::decodeName(path), QString::fromLocal8Bit(strerror(errno))));
+        return;
+    }
+
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if (isDir) {
+            QByteArray child = path + '/' + name;
+            pool.start([this, child, depth]() { removeDirectory(child, depth + 1); });
+        } else if (unlinkat(fd, name, 0) == 0) {
+            filesDone++;
+        } else {
+            addError(QString("Could not delete \"%1\": %2").arg(QFile::decodeName(path + '/' + name),
+                                                                 QString::fromLocal8Bit(strerror(errno))));
+        }
+        if (aborted()) break;
+    }
+    closedir(dir);
+
+    QMutexLocker locker(&removedMutex);
+    removedDirs.append(RemovedDir{path, depth});
+}
+
+void FileOperationWorker::removeDirectories() {
+    // Children before parents; rmdir is cheap enough to run serially
+    std::sort(removedDirs.begin(), removedDirs.end(), [](const RemovedDir& a, const RemovedDir& b) {
+        return a.depth > b.depth;
+    });
+    for (const RemovedDir& dir : qAsConst(removedDirs)) {
+        if (aborted()) break;
+        if (rmdir(dir.path.constData()) == 0) {
+            filesDone++;
+        } else if (errno != ENOTEMPTY) {
+            // Not empty means something inside failed, and that was reported already
+            addError(QString("Could not delete \"%1\": %2").arg(QFile::decodeName(dir.path),
+                                                                 QString::fromLocal8Bit(strerror(errno))));
+        }
+        reportProgress();
+    }
+    removedDirs.clear();
+}
+
+// Pre-order walk: a directory is created before any of its files are handed
+// to the pool, so copies never race their parent's mkdir.
+bool FileOperationWorker::transfer(const QFileInfo& source, const QString& dest) {
+    if (!source.exists() && !source.isSymLink()) {
+        addError(QString("\"%1\" no longer exists").arg(source.filePath()));
+        return false;
+    }
+
+    if (source.isSymLink() || !source.isDir()) {
+        addFile(source, dest);
+        return true;
+    }
+
+    if (!QDir().mkpath(dest)) {
+        addError(QString("Could not create folder \"%1\"").arg(dest));
+        return false;
+    }
+
+    if (control->isPaused()) {
+        QElapsedTimer timer;
+        timer.start();
+        control->waitIfPaused(current.id);
+        pausedMs += timer.elapsed();
+    }
+
+    const QFileInfoList children = QDir(source.filePath()).entryInfoList(
+        QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDir::NoSort);
+    for (const QFileInfo& child : children) {
+        if (aborted()) return false;
+        transfer(child, dest + "/" + child.fileName());
+    }
+    reportProgress();
+    return true;
+}
+
+void FileOperationWorker::addFile(const QFileInfo& source, const QString& dest) {
+    qint64 size = source.isSymLink() ? 0 : source.size();
+    bytesTotal += size;
+    filesTotal++;
+
+    // Large files get a task of their own; small ones share one so the
+    // per-task overhead is paid once per batch rather than once per file.
+    Entry entry{source.filePath(), dest, size, source.isSymLink()};
+    if (size >= kSmallFileLimit) {
+        submit({entry});
+        return;
+    }
+
+    batch.append(entry);
+    batchBytes += size;
+    if (batch.size() >= kBatchFiles || batchBytes >= kBatchBytes) {
+        flushBatch();
+    }
+}
+
+void FileOperationWorker::flushBatch() {
+    if (batch.isEmpty()) return;
+    submit(batch);
+    batch.clear();
+    batchBytes = 0;
+}
+
+void FileOperationWorker::submit(const QList<Entry>& entries) {
+    while (!batchSlots->tryAcquire(1, kProgressIntervalMs)) {
+        reportProgress(true);
+    }
+
+    QSemaphore* capacity = batchSlots;
+    pool.start([this, entries, capacity]() {
+        for (const Entry& entry : entries) {
+            if (aborted()) break;
+            if (copyEntry(entry)) filesDone++;
+        }
+        capacity->release();
+    });
+    reportProgress();
+}
+
+void FileOperationWorker::waitForPool() {
+    QElapsedTimer pauseTimer;
+    while (!pool.waitForDone(kProgressIntervalMs)) {
+        if (control->isPaused()) {
+            if (!pauseTimer.isValid()) pauseTimer.start();
+        } else if (pauseTimer.isValid()) {
+            pausedMs += pauseTimer.elapsed();
+            pauseTimer.invalidate();
+        }
+        reportProgress(true);
+    }
+    if (pauseTimer.isValid()) pausedMs += pauseTimer.elapsed();
+}
+
+// Runs on a pool thread.
+bool FileOperationWorker::copyEntry(const Entry& entry) {
+    if (entry.isSymLink) {
+        // The link text is copied as written, so relative and dangling links
+        // stay what they were; QFile only offers the resolved absolute target.
+        const QByteArray source = QFile::encodeName(entry.source);
+        QByteArray target(PATH_MAX, Qt::Uninitialized);
+        ssize_t length = ::readlinkat(AT_FDCWD, source.constData(), target.data(), size_t(target.size()));
+        if (length >= 0 && length < target.size()) {
+            target.truncate(int(length));
+        } else {
+            target = QFile::encodeName(QFile::symLinkTarget(entry.source));
+        }
+        if (target.isEmpty() || ::symlinkat(target.constData(), AT_FDCWD, QFile::encodeName(entry.dest).constData()) < 0) {
+            addError(QString("Could not copy link \"%1\"").arg(entry.source));
+            return false;
+        }
+        return true;
+    }
+
+    if (!control->waitIfPaused(current.id)) return false;
+
+    CopyBackend::Result result = CopyBackend::copyFile(entry.source, entry.dest, [this](qint64 chunk) {
+        bytesDone += chunk;
+        return control->waitIfPaused(current.id);
+    });
+
+    if (!result.ok && !result.aborted) {
+        addError(QString("Error copying \"%1\": %2").arg(entry.source, result.error));
+    }
+    return result.ok;
+}
+
+void FileOperationWorker::addError(const QString& error) {
+    QMutexLocker locker(&errorMutex);
+    errors.append(error);
+}
+
+bool FileOperationWorker::aborted() const {
+    return control->isCancelled(current.id);
+}
+
+// Only called from the worker thread; pool threads just bump the counters.
+void FileOperationWorker::reportProgress(bool force) {
+    if (!force && progressTimer.elapsed() < kProgressIntervalMs) return;
+    progressTimer.restart();
+
+    qint64 done = bytesDone;
+    qint64 activeMs = transferTimer.isValid() ? transferTimer.elapsed() - pausedMs : 0;
+    double megabytesPerSecond = activeMs > 0 ? (done / (1024.0 * 1024.0)) / (activeMs / 1000.0) : 0.0;
+    emit jobProgress(current.id, done, bytesTotal, filesDone, filesTotal, megabytesPerSecond);
+}
+
+// FileOperationQueue
+
+FileOperationQueue::FileOperationQueue(QObject *parent)
+    : QObject(parent)
+    , worker(new FileOperationWorker(&control))
+    , nextJobId(1)
+{
+    qRegisterMetaType<FileOperationJob>("FileOperationJob");
+
+    worker->moveToThread(&workerThread);
+    connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    connect(worker, &FileOperationWorker::jobStarted, this, &FileOperationQueue::jobStarted);
+    connect(worker, &FileOperationWorker::jobProgress, this, &FileOperationQueue::jobProgress);
+    connect(worker, &FileOperationWorker::jobFinished, this, [this](int jobId, bool cancelled, const QStringList& errors) {
+        activeJobs.remove(jobId);
+        emit jobFinished(jobId, cancelled, errors);
+    });
+
+    workerThread.setObjectName("FileOperations");
+    workerThread.start();
+}
+
+FileOperationQueue::~FileOperationQueue() {
+    cancelAll();
+    control.setPaused(false);
+    workerThread.quit();
+    workerThread.wait();
+}
+
+int FileOperationQueue::enqueue(FileOperationJob::Kind kind, const QStringList& sources, const QString& destDir) {
+    FileOperationJob job;
+    job.id = nextJobId++;
+    job.kind = kind;
+    job.sources = sources;
+    job.destDir = destDir;
+
+    activeJobs.insert(job.id);
+    QMetaObject::invokeMethod(worker, "run", Qt::QueuedConnection, Q_ARG(FileOperationJob, job));
+    return job.id;
+}
+
+void FileOperationQueue::cancel(int jobId) {
+    if (activeJobs.contains(jobId)) {
+        control.requestCancel(jobId);
+    }
+}
+
+void FileOperationQueue::cancelAll() {
+    for (int jobId : qAsConst(activeJobs)) {
+        control.requestCancel(jobId);
+    }
+}
+
+void FileOperationQueue::setPaused(bool paused) {
+    control.setPaused(paused);
+}
+
+bool FileOperationQueue::isPaused() const {
+    return control.isPaused();
+}
+
+int FileOperationQueue::copyWorkers() {
+    // More threads than cores still helps: small-file copies mostly wait on I/O.
+    int fallback = qBound(2, QThread::idealThreadCount(), 8);
+    int workers = QSettings().value("FileOperations/copyWorkers", fallback).toInt();
+    return qBound(1, workers, kMaxCopyWorkers);
+}
@@ -0,0 +1,144 @@
+#ifndef FILEOPERATIONS_H
+#define FILEOPERATIONS_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QFileInfo>
+#include <QVector>
+#include <atomic>
+
+// A single queued request. Trash and Delete jobs have no destDir.
+struct FileOperationJob {
+    enum Kind { Copy, Move, Trash, Delete };
+
+    int id = 0;
+    Kind kind = Copy;
+    QStringList sources;
+    QString destDir;
+};
+
+// Shared cancel/pause state, read by the worker between chunks.
+class FileOperationControl {
+public:
+    void requestCancel(int jobId);
+    bool isCancelled(int jobId) const;
+    void clearCancel(int jobId);
+
+    void setPaused(bool paused);
+    bool isPaused() const { return paused.load(); }
+    // Blocks the calling worker while paused; returns false if the job got cancelled.
+    bool waitIfPaused(int jobId);
+
+private:
+    mutable QMutex mutex;
+    QWaitCondition resumed;
+    QSet<int> cancelled;
+    std::atomic<bool> paused{false};
+};
+
+class FileOperationWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileOperationWorker(FileOperationControl* control, QObject *parent = nullptr);
+
+public slots:
+    void run(const FileOperationJob& job);
+
+signals:
+    void jobStarted(int jobId, const QString& description);
+    void jobProgress(int jobId, qint64 bytesDone, qint64 bytesTotal, int filesDone, int filesTotal, double megabytesPerSecond);
+    void jobFinished(int jobId, bool cancelled, const QStringList& errors);
+
+private:
+    struct Entry {
+        QString source;
+        QString dest;
+        qint64 size;
+        bool isSymLink;
+    };
+
+    struct RemovedDir {
+        QByteArray path;
+        int depth;
+    };
+
+    void remove(const FileOperationJob& job);
+    void removePath(const QString& path);
+    void removeDirectory(const QByteArray& path, int depth);
+    void removeDirectories();
+    bool transfer(const QFileInfo& source, const QString& dest);
+    void addFile(const QFileInfo& source, const QString& dest);
+    void flushBatch();
+    void submit(const QList<Entry>& entries);
+    void waitForPool();
+    bool copyEntry(const Entry& entry);
+    void addError(const QString& error);
+    bool aborted() const;
+    void reportProgress(bool force = false);
+
+    FileOperationControl* control;
+    FileOperationJob current;
+
+    // Enumeration runs on the worker thread, file copies on the pool.
+    QThreadPool pool;
+    QSemaphore* batchSlots;
+    QList<Entry> batch;
+    qint64 batchBytes;
+
+    // Folders emptied by a permanent delete, removed deepest first at the end
+    QMutex removedMutex;
+    QVector<RemovedDir> removedDirs;
+
+    QMutex errorMutex;
+    QStringList errors;
+    std::atomic<qint64> bytesDone;
+    qint64 bytesTotal;
+    std::atomic<int> filesDone;
+    int filesTotal;
+    QElapsedTimer progressTimer;
+    QElapsedTimer transferTimer;
+    qint64 pausedMs;
+};
+
+// Queues copy/move/trash/delete jobs and runs them one after another on a worker thread.
+class FileOperationQueue : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileOperationQueue(QObject *parent = nullptr);
+    ~FileOperationQueue();
+
+    int enqueue(FileOperationJob::Kind kind, const QStringList& sources, const QString& destDir);
+    void cancel(int jobId);
+    void cancelAll();
+    void setPaused(bool paused);
+    bool isPaused() const;
+    int pendingJobs() const { return activeJobs.size(); }
+
+    // Number of pool threads copying files concurrently (FileOperations/copyWorkers).
+    static int copyWorkers();
+
+signals:
+    void jobStarted(int jobId, const QString& description);
+    void jobProgress(int jobId, qint64 bytesDone, qint64 bytesTotal, int filesDone, int filesTotal, double megabytesPerSecond);
+    void jobFinished(int jobId, bool cancelled, const QStringList& errors);
+
+private:
+    QThread workerThread;
+    FileOperationControl control;
+    FileOperationWorker* worker;
+    int nextJobId;
+    QSet<int> activeJobs;
+};
+
+Q_DECLARE_METATYPE(FileOperationJob)
+
+#endif // FILEOPERATIONS_H
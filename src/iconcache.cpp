@@ -0,0 +1,124 @@
+#include "iconcache.h"
+#include <QFileIconProvider>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QPixmap>
+#include <QStringList>
+
+IconCache& IconCache::instance() {
+    static IconCache cache;
+    return cache;
+}
+
+IconCache::IconCache() {
+    const struct {
+        Category category;
+        const char* icon;
+        QStringList suffixes;
+    } table[] = {
+        {Folder, ":/icons/folder.svg", {}},
+        {Pdf, ":/icons/pdf.svg", {"pdf"}},
+        {Document, ":/icons/doc.svg", {"doc", "docx"}},
+        {Text, ":/icons/text.svg", {"txt"}},
+        {Spreadsheet, ":/icons/spreadsheet.svg", {"xls", "xlsx"}},
+        {Image, ":/icons/image.svg", {"png", "jpg", "jpeg", "gif", "bmp"}},
+        {Video, ":/icons/video.svg", {"mp4", "avi", "mkv", "mov"}},
+        {Audio, ":/icons/audio.svg", {"mp3", "wav", "flac", "aac"}},
+        {Archive, ":/icons/archive.svg", {"zip", "rar", "tar", "gz", "7z"}},
+        {Code, ":/icons/code.svg", {"cpp", "c", "h", "hpp", "py", "js"}},
+        {Executable, ":/icons/executable.svg", {}},
+    };
+
+    for (const auto& row : table) {
+        sources[row.category] = QIcon(row.icon);
+        for (const QString& suffix : row.suffixes) {
+            suffixes.insert(suffixKey(suffix.constData(), suffix.size()), row.category);
+        }
+    }
+
+    // The platform's generic file icon, resolved once instead of per file.
+    sources[Generic] = QFileIconProvider().icon(QFileIconProvider::File);
+
+    for (int i = 0; i < CategoryCount; i++) {
+        icons[i] = sources[i];
+        values[i] = icons[i];
+    }
+}
+
+// Packs up to eight ASCII characters, lowercased, into one integer so a
+// suffix can be looked up without building a QString. Returns 0 (never a
+// key in the table) for anything longer or non-ASCII.
+quint64 IconCache::suffixKey(const QChar* chars, int length) {
+    if (length <= 0 || length > 8) return 0;
+
+    quint64 key = 0;
+    for (int i = 0; i < length; i++) {
+        ushort c = chars[i].unicode();
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        } else if (c == 0 || c >= 0x80) {
+            return 0;
+        }
+        key = (key << 8) | c;
+    }
+    return key;
+}
+
+IconCache::Category IconCache::categoryForSuffix(const QString& suffix) const {
+    return suffixes.value(suffixKey(suffix.constData(), suffix.size()), Generic);
+}
+
+IconCache::Category IconCache::categoryForName(const QString& fileName, bool isDir, bool isExecutable) const {
+    return categoryForName(fileName.constData(), fileName.size(), isDir, isExecutable);
+}
+
+IconCache::Category IconCache::categoryForName(const QChar* name, int length, bool isDir, bool isExecutable) const {
+    if (isDir) return Folder;
+
+    Category result = Generic;
+    int dot = length - 1;
+    while (dot >= 0 && name[dot] != QLatin1Char('.')) dot--;
+    if (dot >= 0) {
+        result = suffixes.value(suffixKey(name + dot + 1, length - dot - 1), Generic);
+    }
+    if (result == Generic && isExecutable) return Executable;
+    return result;
+}
+
+IconCache::Category IconCache::category(const QFileInfo& info) const {
+    if (info.isDir()) return Folder;
+
+    Category result = categoryForSuffix(info.suffix());
+    if (result == Generic && info.isExecutable()) return Executable;
+    return result;
+}
+
+void IconCache::prepare(const QList<QSize>& sizes) {
+    for (int i = 0; i < CategoryCount; i++) {
+        QIcon rendered;
+        for (const QSize& size : sizes) {
+            if (size.isValid()) {
+                rendered.addPixmap(sources[i].pixmap(size));
+            }
+        }
+        icons[i] = rendered.isNull() ? sources[i] : rendered;
+        values[i] = icons[i];
+    }
+}
+
+QIcon IconCache::rasterize(const QString& resource, const QList<QSize>& sizes) {
+    const qreal ratio = qApp->devicePixelRatio();
+    QIcon icon;
+    for (const QSize& size : sizes) {
+        // The SVG reader renders at the scaled size; nothing is resampled
+        QImageReader reader(resource);
+        reader.setScaledSize(size * ratio);
+        QImage image = reader.read();
+        if (image.isNull()) continue;
+
+        QPixmap pixmap = QPixmap::fromImage(image);
+        pixmap.setDevicePixelRatio(ratio);
+        icon.addPixmap(pixmap);
+    }
+    return icon.isNull() ? QIcon(resource) : icon;
+}
@@ -0,0 +1,64 @@
+#ifndef ICONCACHE_H
+#define ICONCACHE_H
+
+#include <QIcon>
+#include <QHash>
+#include <QList>
+#include <QSize>
+#include <QFileInfo>
+#include <QVariant>
+
+// File-type icons resolved once: suffixes map to a category through a hash
+// table, and each category holds a QIcon pre-rendered at the sizes the views
+// draw, so lookups never touch the resource system or the SVG renderer.
+class IconCache {
+public:
+    enum Category {
+        Folder,
+        Pdf,
+        Document,
+        Text,
+        Spreadsheet,
+        Image,
+        Video,
+        Audio,
+        Archive,
+        Code,
+        Executable,
+        Generic,
+        CategoryCount
+    };
+
+    static IconCache& instance();
+
+    Category categoryForSuffix(const QString& suffix) const;
+    // Allocation-free: looks at the text after the last '.' in place.
+    Category categoryForName(const QString& fileName, bool isDir, bool isExecutable) const;
+    Category categoryForName(const QChar* name, int length, bool isDir, bool isExecutable) const;
+    Category category(const QFileInfo& info) const;
+    const QIcon& icon(Category category) const { return icons[category]; }
+    const QIcon& icon(const QFileInfo& info) const { return icons[category(info)]; }
+    // The same icon wrapped once in a QVariant, for model data() hot paths.
+    const QVariant& iconValue(Category category) const { return values[category]; }
+
+    // Rasterizes every category at the given sizes (the views' iconSize()).
+    void prepare(const QList<QSize>& sizes);
+
+    // Renders an SVG resource straight to pixmaps at the screen's pixel
+    // ratio, for icons (like the toolbar's) that are only ever shown at
+    // known sizes.
+    static QIcon rasterize(const QString& resource, const QList<QSize>& sizes);
+
+private:
+    IconCache();
+
+    static quint64 suffixKey(const QChar* chars, int length);
+
+    // Keyed by the suffix packed into an integer, see suffixKey().
+    QHash<quint64, Category> suffixes;
+    QIcon sources[CategoryCount];
+    QIcon icons[CategoryCount];
+    QVariant values[CategoryCount];
+};
+
+#endif // ICONCACHE_H
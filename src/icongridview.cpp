@@ -0,0 +1,345 @@
+#include "icongridview.h"
+#include <QMouseEvent>
+#include <QHoverEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QRubberBand>
+#include <QScrollBar>
+#include <QStyleOptionRubberBand>
+
+namespace {
+
+// Decorations scaled to the icon size, one per distinct source icon
+const int kDecorationCacheSize = 2048;
+
+} // namespace
+
+IconGridView::IconGridView(QWidget *parent)
+    : QAbstractItemView(parent)
+    , grid(90, 90)
+    , margin(10)
+    , columns(1)
+    , bandOrigin(-1, -1)
+    , decorations(kDecorationCacheSize)
+{
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollMode(ScrollPerPixel);
+    setMouseTracking(true);
+    viewport()->setAttribute(Qt::WA_Hover);
+    connect(this, &QAbstractItemView::iconSizeChanged, this, [this]() { decorations.clear(); });
+}
+
+void IconGridView::setGridSize(const QSize& size) {
+    grid = size.expandedTo(QSize(1, 1));
+    doItemsLayout();
+}
+
+void IconGridView::setSpacing(int spacing) {
+    margin = qMax(0, spacing);
+    doItemsLayout();
+}
+
+int IconGridView::itemCount() const {
+    return model() ? model()->rowCount(rootIndex()) : 0;
+}
+
+int IconGridView::columnCount(int width) const {
+    return qMax(1, (width - 2 * margin) / grid.width());
+}
+
+QRect IconGridView::itemRect(int item) const {
+    return QRect(margin + (item % columns) * grid.width(), margin + (item / columns) * grid.height(),
+                 grid.width(), grid.height());
+}
+
+QRect IconGridView::visualRect(const QModelIndex& index) const {
+    if (!index.isValid() || index.parent() != rootIndex() || isIndexHidden(index)) return QRect();
+    return itemRect(index.row()).translated(0, -verticalOffset());
+}
+
+void IconGridView::scrollTo(const QModelIndex& index, ScrollHint hint) {
+    const QRect rect = visualRect(index);
+    if (!rect.isValid()) return;
+
+    const int height = viewport()->height();
+    const int top = rect.top() + verticalOffset();
+    int value = verticalOffset();
+    switch (hint) {
+    case PositionAtTop:
+        value = top;
+        break;
+    case PositionAtBottom:
+        value = top + rect.height() - height;
+        break;
+    case PositionAtCenter:
+        value = top + (rect.height() - height) / 2;
+        break;
+    case EnsureVisible:
+        if (rect.top() < 0) value = top;
+        else if (rect.bottom() >= height) value = top + rect.height() - height;
+        break;
+    }
+    verticalScrollBar()->setValue(value);
+}
+
+QModelIndex IconGridView::indexAt(const QPoint& point) const {
+    const int x = point.x() - margin;
+    const int y = point.y() + verticalOffset() - margin;
+    if (x < 0 || y < 0) return QModelIndex();
+
+    const int column = x / grid.width();
+    if (column >= columns) return QModelIndex();
+    const int item = (y / grid.height()) * columns + column;
+    if (item >= itemCount()) return QModelIndex();
+    return model()->index(item, 0, rootIndex());
+}
+
+// Nothing to lay out: the column count is all the grid depends on.
+void IconGridView::doItemsLayout() {
+    columns = columnCount(viewport()->width());
+    QAbstractItemView::doItemsLayout();
+}
+
+QModelIndex IconGridView::moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) {
+    Q_UNUSED(modifiers);
+    const int count = itemCount();
+    if (count == 0) return QModelIndex();
+
+    const QModelIndex current = currentIndex();
+    if (!current.isValid()) return model()->index(0, 0, rootIndex());
+
+    const int pageItems = qMax(1, viewport()->height() / grid.height()) * columns;
+    int item = current.row();
+    switch (cursorAction) {
+    case MoveLeft:
+    case MovePrevious:
+        item--;
+        break;
+    case MoveRight:
+    case MoveNext:
+        item++;
+        break;
+    case MoveUp:
+        if (item >= columns) item -= columns;
+        break;
+    case MoveDown:
+        // From the next-to-last row, land on the last item even if the
+        // column below is empty
+        if (item / columns < (count - 1) / columns) item = qMin(item + columns, count - 1);
+        break;
+    case MovePageUp:
+        item -= pageItems;
+        break;
+    case MovePageDown:
+        item += pageItems;
+        break;
+    case MoveHome:
+        item = 0;
+        break;
+    case MoveEnd:
+        item = count - 1;
+        break;
+    }
+    return model()->index(qBound(0, item, count - 1), 0, rootIndex());
+}
+
+int IconGridView::horizontalOffset() const {
+    return 0;
+}
+
+int IconGridView::verticalOffset() const {
+    return verticalScrollBar()->value();
+}
+
+bool IconGridView::isIndexHidden(const QModelIndex& index) const {
+    return index.column() != 0;
+}
+
+// Selects every cell the rectangle touches: one range per grid row, or a
+// single range when whole rows are covered.
+void IconGridView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) {
+    if (!model() || !selectionModel()) return;
+
+    const QRect area = rect.normalized().translated(-margin, verticalOffset() - margin);
+    const int count = itemCount();
+    const int lastGridRow = (count - 1) / columns;
+    const int firstRow = qMax(0, area.top() / grid.height());
+    const int lastRow = area.bottom() < 0 ? -1 : qMin(lastGridRow, area.bottom() / grid.height());
+    const int firstColumn = qMax(0, area.left() / grid.width());
+    const int lastColumn = area.right() < 0 ? -1 : qMin(columns - 1, area.right() / grid.width());
+
+    QItemSelection selection;
+    if (count > 0 && firstRow <= lastRow && firstColumn <= lastColumn) {
+        if (firstColumn == 0 && lastColumn == columns - 1) {
+            const int last = qMin(count - 1, (lastRow + 1) * columns - 1);
+            selection.append(QItemSelectionRange(model()->index(firstRow * columns, 0, rootIndex()),
+                                                 model()->index(last, 0, rootIndex())));
+        } else {
+            for (int row = firstRow; row <= lastRow; row++) {
+                const int first = row * columns + firstColumn;
+                const int last = qMin(count - 1, row * columns + lastColumn);
+                if (first > last) break;
+                selection.append(QItemSelectionRange(model()->index(first, 0, rootIndex()),
+                                                     model()->index(last, 0, rootIndex())));
+            }
+        }
+    }
+    selectionModel()->select(selection, command);
+}
+
+QRegion IconGridView::visualRegionForSelection(const QItemSelection& selection) const {
+    // Only cells on screen can need a repaint
+    const int firstVisible = qMax(0, (verticalOffset() - margin) / grid.height()) * columns;
+    const int lastVisible = qMin(itemCount() - 1,
+                                 ((verticalOffset() + viewport()->height() - margin) / grid.height() + 1) * columns - 1);
+
+    QRegion region;
+    for (const QItemSelectionRange& range : selection) {
+        if (range.parent() != rootIndex() || range.left() > 0) continue;
+        const int top = qMax(range.top(), firstVisible);
+        const int bottom = qMin(range.bottom(), lastVisible);
+        for (int item = top; item <= bottom; item++) {
+            region += itemRect(item).translated(0, -verticalOffset());
+        }
+    }
+    return region;
+}
+
+void IconGridView::updateGeometries() {
+    const int rows = (itemCount() + columns - 1) / columns;
+    const int contentHeight = rows * grid.height() + 2 * margin;
+    verticalScrollBar()->setSingleStep(qMax(1, grid.height() / 3));
+    verticalScrollBar()->setPageStep(viewport()->height());
+    verticalScrollBar()->setRange(0, qMax(0, contentHeight - viewport()->height()));
+    QAbstractItemView::updateGeometries();
+}
+
+void IconGridView::resizeEvent(QResizeEvent* event) {
+    const int newColumns = columnCount(viewport()->width());
+    if (newColumns == columns) {
+        QAbstractItemView::resizeEvent(event);
+        return;
+    }
+
+    // Reflowing keeps the first item on screen at the top
+    const int anchor = qMax(0, (verticalOffset() - margin) / grid.height()) * columns;
+    columns = newColumns;
+    QAbstractItemView::resizeEvent(event);
+    const int row = anchor / columns;
+    verticalScrollBar()->setValue(row == 0 ? 0 : margin + row * grid.height());
+    viewport()->update();
+}
+
+QIcon IconGridView::decoration(const QModelIndex& index) {
+    const QIcon source = qvariant_cast<QIcon>(index.data(Qt::DecorationRole));
+    if (source.isNull()) return source;
+
+    if (const QIcon* cached = decorations.object(source.cacheKey())) return *cached;
+    QIcon* scaled = new QIcon(source.pixmap(iconSize()));
+    decorations.insert(source.cacheKey(), scaled);
+    return *scaled;
+}
+
+void IconGridView::paintEvent(QPaintEvent* event) {
+    QPainter painter(viewport());
+    const int count = itemCount();
+
+    if (count > 0) {
+        const QRect area = event->rect().translated(0, verticalOffset() - margin);
+        const int first = qMax(0, area.top() / grid.height()) * columns;
+        const int last = qMin(count - 1, (qMax(0, area.bottom()) / grid.height() + 1) * columns - 1);
+
+        QStyleOptionViewItem option = viewOptions();
+        option.features = QStyleOptionViewItem::HasDisplay | QStyleOptionViewItem::HasDecoration
+            | QStyleOptionViewItem::WrapText;
+        option.decorationPosition = QStyleOptionViewItem::Top;
+        option.decorationAlignment = Qt::AlignCenter;
+        option.displayAlignment = Qt::AlignHCenter | Qt::AlignTop;
+        option.decorationSize = iconSize();
+        option.textElideMode = textElideMode();
+        const QFont viewFont = option.font;
+        const QModelIndex current = currentIndex();
+        const QItemSelectionModel* selection = selectionModel();
+        const int inset = margin / 2;
+
+        for (int item = first; item <= last; item++) {
+            const QModelIndex index = model()->index(item, 0, rootIndex());
+            QStyleOptionViewItem itemOption = option;
+            itemOption.rect = itemRect(item).translated(0, -verticalOffset()).adjusted(inset, inset, -inset, -inset);
+            itemOption.index = index;
+            itemOption.text = index.data(Qt::DisplayRole).toString();
+            itemOption.icon = decoration(index);
+
+            const QVariant font = index.data(Qt::FontRole);
+            if (font.isValid()) {
+                itemOption.font = qvariant_cast<QFont>(font).resolve(viewFont);
+                itemOption.fontMetrics = QFontMetrics(itemOption.font);
+            }
+            if (selection && selection->isSelected(index)) itemOption.state |= QStyle::State_Selected;
+            if (index == current && hasFocus()) itemOption.state |= QStyle::State_HasFocus;
+            if (index == hoverIndex) itemOption.state |= QStyle::State_MouseOver;
+            if (!(model()->flags(index) & Qt::ItemIsEnabled)) itemOption.state &= ~QStyle::State_Enabled;
+
+            style()->drawControl(QStyle::CE_ItemViewItem, &itemOption, &painter, this);
+        }
+    }
+
+    if (!band.isNull()) {
+        QStyleOptionRubberBand bandOption;
+        bandOption.initFrom(this);
+        bandOption.shape = QRubberBand::Rectangle;
+        bandOption.opaque = false;
+        bandOption.rect = band.translated(0, -verticalOffset());
+        style()->drawControl(QStyle::CE_RubberBand, &bandOption, &painter, this);
+    }
+}
+
+bool IconGridView::viewportEvent(QEvent* event) {
+    switch (event->type()) {
+    case QEvent::HoverEnter:
+    case QEvent::HoverMove: {
+        const QModelIndex index = indexAt(static_cast<QHoverEvent*>(event)->pos());
+        if (index != hoverIndex) {
+            update(hoverIndex);
+            hoverIndex = index;
+            update(index);
+        }
+        break;
+    }
+    case QEvent::HoverLeave:
+        update(hoverIndex);
+        hoverIndex = QPersistentModelIndex();
+        break;
+    default:
+        break;
+    }
+    return QAbstractItemView::viewportEvent(event);
+}
+
+void IconGridView::mousePressEvent(QMouseEvent* event) {
+    QAbstractItemView::mousePressEvent(event);
+    // A press on empty space starts a rubber band
+    if (event->button() == Qt::LeftButton && selectionMode() == ExtendedSelection && !indexAt(event->pos()).isValid()) {
+        bandOrigin = event->pos() + QPoint(0, verticalOffset());
+    } else {
+        bandOrigin = QPoint(-1, -1);
+    }
+}
+
+void IconGridView::mouseMoveEvent(QMouseEvent* event) {
+    QAbstractItemView::mouseMoveEvent(event);
+    if ((event->buttons() & Qt::LeftButton) && bandOrigin.x() >= 0) {
+        const QRect previous = band;
+        band = QRect(bandOrigin, event->pos() + QPoint(0, verticalOffset())).normalized();
+        viewport()->update((previous | band).translated(0, -verticalOffset()).adjusted(-1, -1, 1, 1));
+    }
+}
+
+void IconGridView::mouseReleaseEvent(QMouseEvent* event) {
+    QAbstractItemView::mouseReleaseEvent(event);
+    if (!band.isNull()) {
+        viewport()->update(band.translated(0, -verticalOffset()).adjusted(-1, -1, 1, 1));
+        band = QRect();
+    }
+    bandOrigin = QPoint(-1, -1);
+}
@@ -0,0 +1,65 @@
+#ifndef ICONGRIDVIEW_H
+#define ICONGRIDVIEW_H
+
+#include <QAbstractItemView>
+#include <QCache>
+#include <QIcon>
+#include <QPersistentModelIndex>
+
+// Icon view for folders of any size. Every item occupies one cell of a
+// uniform grid, so positions are computed from the row number instead of
+// being laid out: resizing, scrolling and model changes cost the same for
+// ten items as for half a million, and only the cells on screen are ever
+// looked at or painted. Decorations are scaled to the icon size once and
+// kept by QIcon::cacheKey(), so thumbnails aren't resampled every frame.
+class IconGridView : public QAbstractItemView {
+    Q_OBJECT
+
+public:
+    explicit IconGridView(QWidget *parent = nullptr);
+
+    void setGridSize(const QSize& size);
+    QSize gridSize() const { return grid; }
+    // Margin around the grid, in pixels.
+    void setSpacing(int spacing);
+    int spacing() const { return margin; }
+
+    QRect visualRect(const QModelIndex& index) const override;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) override;
+    QModelIndex indexAt(const QPoint& point) const override;
+    void doItemsLayout() override;
+
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex& index) const override;
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) override;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const override;
+    void updateGeometries() override;
+
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    bool viewportEvent(QEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+
+private:
+    int itemCount() const;
+    int columnCount(int width) const;
+    // Cell of the item in content coordinates (not scrolled).
+    QRect itemRect(int item) const;
+    QIcon decoration(const QModelIndex& index);
+
+    QSize grid;
+    int margin;
+    int columns;
+    QPersistentModelIndex hoverIndex;
+    // Rubber band, in content coordinates while a drag selects
+    QPoint bandOrigin;
+    QRect band;
+    QCache<qint64, QIcon> decorations;
+};
+
+#endif // ICONGRIDVIEW_H
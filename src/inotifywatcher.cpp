@@ -0,0 +1,69 @@
+#include "inotifywatcher.h"
+#include <QFile>
+#include <QDebug>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+
+InotifyWatcher::InotifyWatcher(quint32 mask, QObject *parent)
+    : QObject(parent)
+    , fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    , mask(mask)
+    , notifier(nullptr)
+{
+    if (fd < 0) {
+        qWarning() << "inotify unavailable:" << qt_error_string(errno);
+        return;
+    }
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &InotifyWatcher::readEvents);
+}
+
+InotifyWatcher::~InotifyWatcher() {
+    if (fd >= 0) ::close(fd);
+}
+
+int InotifyWatcher::addWatch(const QString& path) {
+    if (fd < 0) return -1;
+
+    int wd = ::inotify_add_watch(fd, QFile::encodeName(path).constData(), mask);
+    if (wd >= 0) {
+        paths.insert(wd, path);
+    }
+    return wd;
+}
+
+void InotifyWatcher::removeWatch(int wd) {
+    if (fd < 0 || !paths.contains(wd)) return;
+    ::inotify_rm_watch(fd, wd);
+    paths.remove(wd);
+}
+
+void InotifyWatcher::readEvents() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    QVector<InotifyEvent> events;
+    bool overflow = false;
+
+    while (true) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+
+        for (char* p = buffer; p < buffer + n; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                paths.remove(event->wd);
+            }
+            events.append({event->wd, event->mask,
+                           event->len ? QFile::decodeName(event->name) : QString()});
+        }
+    }
+
+    if (!events.isEmpty()) emit eventsReady(events);
+    if (overflow) emit overflowed();
+}
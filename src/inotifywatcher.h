@@ -0,0 +1,47 @@
+#ifndef INOTIFYWATCHER_H
+#define INOTIFYWATCHER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+struct InotifyEvent {
+    int wd;
+    quint32 mask;
+    QString name;
+};
+
+// Thin wrapper around one inotify instance. Events are read in bulk from a
+// socket notifier and delivered as one batch per read, so must be created
+// in the thread that consumes them.
+class InotifyWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit InotifyWatcher(quint32 mask, QObject *parent = nullptr);
+    ~InotifyWatcher();
+
+    bool isValid() const { return fd >= 0; }
+    int addWatch(const QString& path);
+    void removeWatch(int wd);
+    int watchCount() const { return paths.size(); }
+    QString pathForWatch(int wd) const { return paths.value(wd); }
+
+signals:
+    void eventsReady(const QVector<InotifyEvent>& events);
+    // The kernel queue overflowed; anything watched may have changed.
+    void overflowed();
+
+private slots:
+    void readEvents();
+
+private:
+    int fd;
+    quint32 mask;
+    QSocketNotifier* notifier;
+    QHash<int, QString> paths;
+};
+
+#endif // INOTIFYWATCHER_H
@@ -0,0 +1,179 @@
+#include "listingcache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+#include <climits>
+#include <string.h>
+
+namespace {
+
+// On-disk layout: header, path and name arena (UTF-16), name offsets,
+// name lengths, then flags.
+const char kFileMagic[8] = {'L', 'D', 'I', 'R', 'L', 'S', 'T', '1'};
+const quint32 kFileVersion = 1;
+
+struct ListingFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 count;
+    qint64 modified;
+    quint32 pathLength;
+    quint32 namesLength;
+};
+
+const quint8 kStatLoadedFlags = EntrySizeLoaded | EntryMtimeLoaded | EntryModeLoaded;
+
+} // namespace
+
+ListingCache::ListingCache(int maxFolders, int maxEntries)
+    : maxFolders(maxFolders)
+    , maxEntries(maxEntries)
+    , entryCount(0)
+{
+}
+
+bool ListingCache::take(const QString& path, CachedListing* entry) {
+    auto it = entries.find(path);
+    if (it == entries.end()) return false;
+
+    *entry = it->entry;
+    remove(it);
+    return entry->listing.modified >= 0
+        && entry->listing.modified == DirectoryLister::modifiedTime(path);
+}
+
+bool ListingCache::holdsWatch(int wd) const {
+    for (const Node& node : entries) {
+        if (node.entry.watchDescriptor == wd) return true;
+    }
+    return false;
+}
+
+QVector<int> ListingCache::insert(const CachedListing& entry) {
+    QVector<int> released;
+    const QString& path = entry.listing.path;
+    auto existing = entries.find(path);
+    if (existing != entries.end()) {
+        const int wd = remove(existing);
+        if (wd != entry.watchDescriptor) released.append(wd);
+    }
+    if (entry.listing.size() > maxEntries) {
+        released.append(entry.watchDescriptor);
+        return released;
+    }
+
+    Node node;
+    node.entry = entry;
+    node.use = lru.insert(lru.end(), path);
+    entries.insert(path, node);
+    entryCount += entry.listing.size();
+
+    while (entries.size() > maxFolders || entryCount > maxEntries) {
+        released.append(remove(entries.find(lru.front())));
+    }
+    return released;
+}
+
+bool ListingCache::invalidate(int wd) {
+    QStringList stale;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (it->entry.watchDescriptor == wd) stale.append(it.key());
+    }
+    for (const QString& path : qAsConst(stale)) remove(entries.find(path));
+    return !stale.isEmpty();
+}
+
+QVector<int> ListingCache::clear() {
+    QVector<int> released;
+    for (const Node& node : qAsConst(entries)) released.append(node.entry.watchDescriptor);
+    entries.clear();
+    lru.clear();
+    entryCount = 0;
+    return released;
+}
+
+bool ListingCache::save(const CachedListing& entry, const QString& fileName) {
+    const DirectoryListing& listing = entry.listing;
+    ListingFileHeader header;
+    memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.count = quint32(listing.size());
+    header.modified = listing.modified;
+    header.pathLength = quint32(listing.path.size());
+    header.namesLength = quint32(listing.names.size());
+
+    QVector<quint8> flags = listing.flags;
+    for (quint8& flag : flags) flag &= ~(kStatLoadedFlags | EntryExecutable);
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write listing" << fileName << file.errorString();
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(listing.path.constData()), qint64(listing.path.size()) * 2);
+    file.write(reinterpret_cast<const char*>(listing.names.constData()), qint64(listing.names.size()) * 2);
+    file.write(reinterpret_cast<const char*>(listing.nameOffsets.constData()), qint64(listing.size()) * 4);
+    file.write(reinterpret_cast<const char*>(listing.nameLengths.constData()), listing.size());
+    file.write(reinterpret_cast<const char*>(flags.constData()), flags.size());
+    return file.commit();
+}
+
+bool ListingCache::load(const QString& fileName, CachedListing* entry) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(ListingFileHeader))) return false;
+    const uchar* data = file.map(0, file.size());
+    if (!data) return false;
+
+    ListingFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    const qint64 count = header.count;
+    const qint64 pathAt = sizeof(header);
+    const qint64 namesAt = pathAt + qint64(header.pathLength) * 2;
+    const qint64 offsetsAt = namesAt + qint64(header.namesLength) * 2;
+    const qint64 lengthsAt = offsetsAt + count * 4;
+    const qint64 flagsAt = lengthsAt + count;
+    const bool valid = memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) == 0
+        && header.version == kFileVersion
+        && count < INT_MAX / 4
+        && header.namesLength < quint32(INT_MAX)
+        && flagsAt + count == file.size();
+    if (!valid) return false;
+
+    DirectoryListing& listing = entry->listing;
+    listing = DirectoryListing();
+    listing.path = QString(reinterpret_cast<const QChar*>(data + pathAt), int(header.pathLength));
+    listing.modified = header.modified;
+    listing.names = QString(reinterpret_cast<const QChar*>(data + namesAt), int(header.namesLength));
+    listing.nameOffsets.resize(int(count));
+    listing.nameLengths.resize(int(count));
+    listing.flags.resize(int(count));
+    memcpy(listing.nameOffsets.data(), data + offsetsAt, size_t(count) * 4);
+    memcpy(listing.nameLengths.data(), data + lengthsAt, size_t(count));
+    memcpy(listing.flags.data(), data + flagsAt, size_t(count));
+    for (int row = 0; row < int(count); row++) {
+        if (quint64(listing.nameOffsets.at(row)) + listing.nameLengths.at(row) > header.namesLength) {
+            qWarning() << "Discarding corrupt listing" << fileName;
+            return false;
+        }
+    }
+
+    entry->sizes.fill(0, int(count));
+    entry->mtimes.fill(0, int(count));
+    entry->modes.fill(0, int(count));
+    entry->watchDescriptor = -1;
+    return true;
+}
+
+// Returns the entry's watch.
+int ListingCache::remove(QHash<QString, Node>::iterator it) {
+    const int wd = it->entry.watchDescriptor;
+    entryCount -= it->entry.listing.size();
+    lru.erase(it->use);
+    entries.erase(it);
+    return wd;
+}
@@ -0,0 +1,68 @@
+#ifndef LISTINGCACHE_H
+#define LISTINGCACHE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <list>
+#include "directorylister.h"
+
+// A folder as FileModel last had it: the listing plus the stat fields
+// loaded so far (see DirectoryEntryFlag).
+struct CachedListing {
+    DirectoryListing listing;
+    QVector<qint64> sizes;
+    QVector<qint64> mtimes;
+    QVector<quint32> modes;
+    // Watch kept on the folder while it is cached, or -1
+    int watchDescriptor = -1;
+};
+
+// Folders visited or prefetched lately, least recently used dropped first.
+// Entries are kept current two ways: the owner drops a folder as soon as
+// its watch reports a change (invalidate), and a folder is only handed out
+// while its mtime still matches the listing's, which also catches changes
+// inotify can't see, such as those made on the far side of a network mount.
+// Bounded by folders and by total entries, so one huge folder can't keep
+// the rest alive. Watches are the owner's to release: calls that drop
+// entries return theirs.
+class ListingCache {
+public:
+    ListingCache(int maxFolders, int maxEntries);
+
+    // Moves path's listing out of the cache; false if it wasn't cached or
+    // the folder changed since (the stale copy is dropped either way).
+    bool take(const QString& path, CachedListing* entry);
+    bool contains(const QString& path) const { return entries.contains(path); }
+    // Whether any cached folder holds the watch wd.
+    bool holdsWatch(int wd) const;
+    // Caches entry as the most recent; returns the watches of the entries
+    // it pushed out (possibly its own, if it is too big to keep).
+    QVector<int> insert(const CachedListing& entry);
+    // Drops every folder held under the watch wd.
+    bool invalidate(int wd);
+    QVector<int> clear();
+
+    // Keeps a listing across sessions. Only names and types are written:
+    // the mtime check covers those, but not files changed in place, so
+    // stat fields are fetched afresh.
+    static bool save(const CachedListing& entry, const QString& fileName);
+    static bool load(const QString& fileName, CachedListing* entry);
+
+private:
+    struct Node {
+        CachedListing entry;
+        std::list<QString>::iterator use;
+    };
+
+    int remove(QHash<QString, Node>::iterator it);
+
+    int maxFolders;
+    int maxEntries;
+    int entryCount;
+    QHash<QString, Node> entries;
+    // Least recently used first
+    std::list<QString> lru;
+};
+
+#endif // LISTINGCACHE_H
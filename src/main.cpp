@@ -1,35 +1,29 @@
 #include <QApplication>
-#include <QFile>
-#include <QTextStream>
-#include <QDebug>
 #include "mainwindow.h"
-
-void loadStyleSheet(QApplication& app, bool darkMode) {
-    QString styleFile = darkMode ? ":/qss/dark.qss" : ":/qss/light.qss";
-    QFile file(styleFile);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream stream(&file);
-        app.setStyleSheet(stream.readAll());
-        file.close();
-    } else {
-        qWarning() << "Failed to load stylesheet:" << styleFile;
-    }
-}
+#include "startuptrace.h"
+#include "themeengine.h"
 
 int main(int argc, char *argv[]) {
+    // --startup-trace prints how long each start-up phase took
+    StartupTrace::start(argc, argv);
+    
     QApplication app(argc, argv);
+    StartupTrace::mark("application created");
     
     app.setApplicationName("Lotus-DIR");
     app.setApplicationDisplayName("Lotus-DIR");
     app.setOrganizationName("Lotus-DIR");
     app.setOrganizationDomain("lotus-dir.local");
-    app.setWindowIcon(QIcon(":/icons/app.png"));
+    app.setWindowIcon(QIcon(":/icons/app.svg"));
     
-    // Load default style (light)
-    loadStyleSheet(app, false);
+    // Both themes go in at once; the light one is active by default
+    ThemeEngine::instance().install(app, ThemeEngine::Light);
+    StartupTrace::mark("stylesheet loaded");
     
     MainWindow window;
+    StartupTrace::mark("main window built");
     window.show();
+    StartupTrace::mark("window shown");
     
     return app.exec();
 }
@@ -1,4 +1,8 @@
 #include "mainwindow.h"
+#include "iconcache.h"
+#include "perftrace.h"
+#include "startuptrace.h"
+#include "themeengine.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QListView>
@@ -8,8 +12,6 @@
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QFileDialog>
-#include <QFileSystemModel>
-#include <QSortFilterProxyModel>
 #include <QMimeData>
 #include <QUrl>
 #include <QClipboard>
@@ -25,26 +27,79 @@
 #include <QLocale>
 #include <QDir>
 #include <QFile>
+#include <QCloseEvent>
+#include <QSettings>
+#include <QStandardPaths>
+
+namespace {
+
+// The folder on screen at exit, reopened without listing at the next start
+QString sessionListingFile() {
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        + "/Lotus-DIR/session-listing.bin";
+}
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , fileModel(new FileModel(this))
-    , proxyModel(new QSortFilterProxyModel(this))
+    , previewPane(nullptr)
+    , searchIndex(new SearchIndex(this))
+    , accessLog(new AccessLog(this))
+    , contentSearch(new ContentSearch(this))
+    , searchResults(new SearchResultsModel(this))
+    , searchTimer(new QTimer(this))
+    , searchGeneration(0)
+    , searchingContents(false)
+    , fileOperations(new FileOperationQueue(this))
+    , activeJobId(0)
+    , lastThroughput(0.0)
+    , perfHudTimer(new QTimer(this))
+    , navigationStart(PerfTrace::now())
+    , navigationMs(-1)
+    , rowsPerSecond(0)
+    , searchStart(0)
+    , searchMs(-1)
     , isDarkMode(false)
     , sidebarVisible(true)
     , previewVisible(false)
     , currentPath(QDir::homePath())
 {
-    proxyModel->setSourceModel(fileModel);
-    proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
-    proxyModel->setFilterKeyColumn(0);
+    // Tagged before any child is polished, so the first paint is themed
+    ThemeEngine::instance().attach(this);
+    
+    // Back where the last session left off, or home. The last folder's
+    // listing was saved too, so unless it changed it shows up at once;
+    // otherwise it is listed on the lister thread while the widgets are built.
+    restoreSession();
+    fileModel->setRootPath(currentPath);
+    StartupTrace::mark("listing started");
+    
+    // Debounce keystrokes before querying the search index
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(150);
     
     setupUI();
+    StartupTrace::mark("widgets built");
     setupToolbar();
+    StartupTrace::mark("toolbar built");
     setupConnections();
     
-    // Start at home directory
-    goToDirectory(QDir::homePath());
+    pathLabel->setText(currentPath);
+    updateWindowTitle();
+    updateNavigationState();
+    StartupTrace::watchFirstPaint(iconView->viewport());
+    
+    // Map in the persisted home index once the first folder is up, so it
+    // doesn't compete with the listing for the disk
+    QMetaObject::Connection* firstListing = new QMetaObject::Connection;
+    *firstListing = connect(fileModel, &FileModel::directoryLoaded, this, [this, firstListing]() {
+        disconnect(*firstListing);
+        delete firstListing;
+        StartupTrace::mark("first listing loaded");
+        searchIndex->preload(QDir::homePath());
+    });
 }
 
 MainWindow::~MainWindow() {}
@@ -64,7 +119,7 @@ void MainWindow::setupUI() {
     mainLayout->addWidget(pathLabel);
     
     // Main content area with sidebar
-    QSplitter* splitter = new QSplitter(Qt::Horizontal, this);
+    splitter = new QSplitter(Qt::Horizontal, this);
     splitter->setObjectName("mainSplitter");
     splitter->setHandleWidth(1);
     
@@ -75,36 +130,77 @@ void MainWindow::setupUI() {
     // View stack (Icon view + List view)
     viewStack = new QStackedWidget(this);
     
-    iconView = new QListView(this);
+    // Uniform grid positioned by arithmetic, so huge folders lay out in constant time
+    iconView = new IconGridView(this);
     iconView->setObjectName("iconView");
-    iconView->setModel(proxyModel);
-    iconView->setViewMode(QListView::IconMode);
+    iconView->setModel(fileModel);
     iconView->setGridSize(QSize(90, 90));
+    // Large enough for thumbnails to be recognizable
+    iconView->setIconSize(QSize(56, 56));
     iconView->setSpacing(10);
-    iconView->setResizeMode(QListView::Adjust);
-    iconView->setSelectionMode(QListView::ExtendedSelection);
-    iconView->setAlternatingRowColors(false);
-    iconView->setWrapping(true);
+    iconView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     
     listView = new QTableView(this);
     listView->setObjectName("listView");
-    listView->setModel(proxyModel);
+    listView->setModel(fileModel);
     listView->setSelectionMode(QListView::ExtendedSelection);
     listView->setShowGrid(false);
     listView->setAlternatingRowColors(true);
+    // For entered(), which prefetches hovered folders
+    listView->setMouseTracking(true);
     listView->horizontalHeader()->setStretchLastSection(true);
     listView->verticalHeader()->setVisible(false);
+    listView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    // The model sorts on the lister thread and reorders the rows when done
+    listView->horizontalHeader()->setSortIndicator(FileModel::NameColumn, Qt::AscendingOrder);
+    listView->setSortingEnabled(true);
+    
+    // Rasterize file-type icons once at the sizes both views paint them
+    IconCache::instance().prepare({iconView->iconSize(), listView->iconSize()});
     
     viewStack->addWidget(iconView);
     viewStack->addWidget(listView);
     splitter->addWidget(viewStack);
     
+    // The preview pane is only created once it is first shown (togglePreview)
     splitter->setSizes({220, 780});
     mainLayout->addWidget(splitter);
     
     // Status bar
     statusBar()->setFixedHeight(24);
     
+    // File operation progress (hidden while the queue is idle)
+    operationLabel = new QLabel(this);
+    operationLabel->setObjectName("operationLabel");
+    operationProgress = new QProgressBar(this);
+    operationProgress->setObjectName("operationProgress");
+    operationProgress->setFixedWidth(160);
+    operationProgress->setMaximumHeight(14);
+    operationProgress->setTextVisible(false);
+    operationPauseButton = new QToolButton(this);
+    operationPauseButton->setText("Pause");
+    operationPauseButton->setCheckable(true);
+    operationPauseButton->setAutoRaise(true);
+    operationCancelButton = new QToolButton(this);
+    operationCancelButton->setText("Cancel");
+    operationCancelButton->setAutoRaise(true);
+    statusBar()->addPermanentWidget(operationLabel);
+    statusBar()->addPermanentWidget(operationProgress);
+    statusBar()->addPermanentWidget(operationPauseButton);
+    statusBar()->addPermanentWidget(operationCancelButton);
+    operationLabel->hide();
+    operationProgress->hide();
+    operationPauseButton->hide();
+    operationCancelButton->hide();
+    
+    // Performance HUD (Ctrl+Shift+H); refreshed while shown since queue
+    // depths change without telling anyone
+    perfHud = new QLabel(this);
+    perfHud->setObjectName("perfHud");
+    statusBar()->addPermanentWidget(perfHud);
+    perfHud->hide();
+    perfHudTimer->setInterval(500);
+    
     setCentralWidget(centralWidget);
     setWindowTitle("Lotus-DIR");
     resize(1000, 700);
@@ -118,20 +214,26 @@ void MainWindow::setupToolbar() {
     toolbar->setObjectName("mainToolbar");
     addToolBar(toolbar);
     
+    // Rendered once at the toolbar's size instead of on every paint
+    const QList<QSize> iconSizes{toolbar->iconSize()};
+    auto toolbarIcon = [&iconSizes](const char* name) {
+        return IconCache::rasterize(QString(":/icons/%1.svg").arg(name), iconSizes);
+    };
+    
     // Navigation actions
-    actionBack = new QAction(QIcon(":/icons/back.png"), "Back", this);
+    actionBack = new QAction(toolbarIcon("back"), "Back", this);
     actionBack->setShortcut(QKeySequence::Back);
     toolbar->addAction(actionBack);
     
-    actionForward = new QAction(QIcon(":/icons/forward.png"), "Forward", this);
+    actionForward = new QAction(toolbarIcon("forward"), "Forward", this);
     actionForward->setShortcut(QKeySequence::Forward);
     toolbar->addAction(actionForward);
     
-    actionUp = new QAction(QIcon(":/icons/up.png"), "Up", this);
+    actionUp = new QAction(toolbarIcon("up"), "Up", this);
     actionUp->setShortcut(QKeySequence::Backspace);
     toolbar->addAction(actionUp);
     
-    actionHome = new QAction(QIcon(":/icons/home.png"), "Home", this);
+    actionHome = new QAction(toolbarIcon("home"), "Home", this);
     toolbar->addAction(actionHome);
     
     toolbar->addSeparator();
@@ -143,59 +245,80 @@ void MainWindow::setupToolbar() {
     searchBar->setObjectName("searchBar");
     toolbar->addWidget(searchBar);
     
+    // Toggles between searching names and searching inside files
+    actionSearchContents = new QAction(toolbarIcon("text"), "Search Contents", this);
+    actionSearchContents->setCheckable(true);
+    actionSearchContents->setToolTip("Search file contents");
+    searchBar->addAction(actionSearchContents, QLineEdit::TrailingPosition);
+    
     toolbar->addSeparator();
     
     // View toggle actions
-    actionViewIcons = new QAction(QIcon(":/icons/icon-view.png"), "Icon View", this);
+    actionViewIcons = new QAction(toolbarIcon("icon-view"), "Icon View", this);
     actionViewIcons->setCheckable(true);
     actionViewIcons->setChecked(true);
     toolbar->addAction(actionViewIcons);
     
-    actionViewList = new QAction(QIcon(":/icons/list-view.png"), "List View", this);
+    actionViewList = new QAction(toolbarIcon("list-view"), "List View", this);
     actionViewList->setCheckable(true);
     toolbar->addAction(actionViewList);
     
     toolbar->addSeparator();
     
     // File operations
-    actionCopy = new QAction(QIcon(":/icons/copy.png"), "Copy", this);
+    actionCopy = new QAction(toolbarIcon("copy"), "Copy", this);
     actionCopy->setShortcut(QKeySequence::Copy);
     toolbar->addAction(actionCopy);
     
-    actionCut = new QAction(QIcon(":/icons/cut.png"), "Cut", this);
+    actionCut = new QAction(toolbarIcon("cut"), "Cut", this);
     actionCut->setShortcut(QKeySequence::Cut);
     toolbar->addAction(actionCut);
     
-    actionPaste = new QAction(QIcon(":/icons/paste.png"), "Paste", this);
+    actionPaste = new QAction(toolbarIcon("paste"), "Paste", this);
     actionPaste->setShortcut(QKeySequence::Paste);
     toolbar->addAction(actionPaste);
     
-    actionDelete = new QAction(QIcon(":/icons/delete.png"), "Delete", this);
+    actionDelete = new QAction(toolbarIcon("delete"), "Delete", this);
     actionDelete->setShortcut(QKeySequence::Delete);
     toolbar->addAction(actionDelete);
     
+    // Shortcut only, like Finder's Option-Command-Delete
+    actionDeletePermanently = new QAction(toolbarIcon("delete"), "Delete Permanently", this);
+    actionDeletePermanently->setShortcut(QKeySequence(Qt::SHIFT | Qt::Key_Delete));
+    addAction(actionDeletePermanently);
+    
+    // Diagnostics, also offered in the background context menu
+    actionPerfHud = new QAction("Performance HUD", this);
+    actionPerfHud->setCheckable(true);
+    actionPerfHud->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_H));
+    addAction(actionPerfHud);
+    
+    actionDumpTrace = new QAction("Dump Trace...", this);
+    actionDumpTrace->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_T));
+    addAction(actionDumpTrace);
+    
     toolbar->addSeparator();
     
     // Refresh action
-    actionRefresh = new QAction(QIcon(":/icons/refresh.png"), "Refresh", this);
+    actionRefresh = new QAction(toolbarIcon("refresh"), "Refresh", this);
     actionRefresh->setShortcut(QKeySequence::Refresh);
     toolbar->addAction(actionRefresh);
     
     toolbar->addSeparator();
     
     // Toggle actions
-    actionToggleSidebar = new QAction(QIcon(":/icons/sidebar.png"), "Toggle Sidebar", this);
+    actionToggleSidebar = new QAction(toolbarIcon("sidebar"), "Toggle Sidebar", this);
     actionToggleSidebar->setCheckable(true);
     actionToggleSidebar->setChecked(true);
     toolbar->addAction(actionToggleSidebar);
     
-    actionTogglePreview = new QAction(QIcon(":/icons/preview.png"), "Toggle Preview", this);
+    actionTogglePreview = new QAction(toolbarIcon("preview"), "Toggle Preview", this);
     actionTogglePreview->setCheckable(true);
     toolbar->addAction(actionTogglePreview);
     
     toolbar->addSeparator();
     
-    actionDarkMode = new QAction(QIcon(":/icons/dark.png"), "Dark Mode", this);
+    actionDarkMode = new QAction(toolbarIcon("dark"), "Dark Mode", this);
     actionDarkMode->setCheckable(true);
     toolbar->addAction(actionDarkMode);
 }
@@ -213,31 +336,43 @@ void MainWindow::setupConnections() {
     connect(sidebar, &Sidebar::navigateToDesktop, this, &MainWindow::navigateToDesktop);
     connect(sidebar, &Sidebar::navigateToDocuments, this, &MainWindow::navigateToDocuments);
     connect(sidebar, &Sidebar::navigateToDownloads, this, &MainWindow::navigateToDownloads);
+    connect(sidebar, &Sidebar::showRecents, this, &MainWindow::showRecents);
     
     // File view connections
-    connect(iconView, &QListView::doubleClicked, this, &MainWindow::handleFileDoubleClick);
+    connect(iconView, &QAbstractItemView::doubleClicked, this, &MainWindow::handleFileDoubleClick);
     connect(listView, &QTableView::doubleClicked, this, &MainWindow::handleFileDoubleClick);
     
     // Context menu
     iconView->setContextMenuPolicy(Qt::CustomContextMenu);
     listView->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(iconView, &QListView::customContextMenuRequested, this, &MainWindow::showContextMenu);
+    connect(iconView, &QWidget::customContextMenuRequested, this, &MainWindow::showContextMenu);
     connect(listView, &QListView::customContextMenuRequested, this, &MainWindow::showContextMenu);
     
     // Search
     connect(searchBar, &QLineEdit::textChanged, this, &MainWindow::searchFiles);
+    connect(searchTimer, &QTimer::timeout, this, &MainWindow::runSearch);
+    connect(searchIndex, &SearchIndex::resultsReady, this, &MainWindow::handleSearchResults);
+    connect(searchIndex, &SearchIndex::searchFinished, this, &MainWindow::handleSearchFinished);
+    connect(contentSearch, &ContentSearch::resultsReady, this, &MainWindow::handleContentResults);
+    connect(contentSearch, &ContentSearch::searchFinished, this, &MainWindow::handleContentSearchFinished);
+    connect(actionSearchContents, &QAction::toggled, [this](bool checked) {
+        searchBar->setPlaceholderText(checked ? "Search Contents" : "Search");
+        if (!searchBar->text().isEmpty()) runSearch();
+    });
     
     // View toggle
     connect(actionViewIcons, &QAction::triggered, [this]() {
         viewStack->setCurrentIndex(0);
         actionViewIcons->setChecked(true);
         actionViewList->setChecked(false);
+        updatePreview();
     });
     
     connect(actionViewList, &QAction::triggered, [this]() {
         viewStack->setCurrentIndex(1);
         actionViewIcons->setChecked(false);
         actionViewList->setChecked(true);
+        updatePreview();
     });
     
     // Toggle actions
@@ -246,6 +381,29 @@ void MainWindow::setupConnections() {
         sidebarVisible = checked;
     });
     
+    connect(actionTogglePreview, &QAction::toggled, this, &MainWindow::togglePreview);
+    watchSelection(iconView);
+    watchSelection(listView);
+    // A folder under the pointer is likely to be opened next
+    connect(iconView, &QAbstractItemView::entered, this, &MainWindow::prefetchIndex);
+    connect(listView, &QAbstractItemView::entered, this, &MainWindow::prefetchIndex);
+    // Resets (a new folder) drop the current item without telling the selection model's listeners
+    connect(fileModel, &QAbstractItemModel::modelReset, this, &MainWindow::updatePreview);
+    connect(fileModel, &FileModel::groupsChanged, this, &MainWindow::updateGroupSpans);
+    connect(fileModel, &FileModel::directoryLoaded, this, &MainWindow::handleDirectoryLoaded);
+    
+    connect(actionPerfHud, &QAction::toggled, [this](bool checked) {
+        perfHud->setVisible(checked);
+        if (checked) {
+            updatePerfHud();
+            perfHudTimer->start();
+        } else {
+            perfHudTimer->stop();
+        }
+    });
+    connect(perfHudTimer, &QTimer::timeout, this, &MainWindow::updatePerfHud);
+    connect(actionDumpTrace, &QAction::triggered, this, &MainWindow::dumpTrace);
+    
     connect(actionDarkMode, &QAction::toggled, this, &MainWindow::toggleDarkMode);
     
     // File operations connections
@@ -253,26 +411,44 @@ void MainWindow::setupConnections() {
     connect(actionCut, &QAction::triggered, this, &MainWindow::cutFiles);
     connect(actionPaste, &QAction::triggered, this, &MainWindow::pasteFiles);
     connect(actionDelete, &QAction::triggered, this, &MainWindow::deleteFiles);
+    connect(actionDeletePermanently, &QAction::triggered, this, &MainWindow::deleteFilesPermanently);
     
     // Refresh action connection
     connect(actionRefresh, &QAction::triggered, this, &MainWindow::refreshView);
+    
+    // Background file operations
+    connect(fileOperations, &FileOperationQueue::jobStarted, this, &MainWindow::handleOperationStarted);
+    connect(fileOperations, &FileOperationQueue::jobProgress, this, &MainWindow::handleOperationProgress);
+    connect(fileOperations, &FileOperationQueue::jobFinished, this, &MainWindow::handleOperationFinished);
+    connect(operationPauseButton, &QToolButton::toggled, [this](bool checked) {
+        fileOperations->setPaused(checked);
+        operationPauseButton->setText(checked ? "Resume" : "Pause");
+    });
+    connect(operationCancelButton, &QToolButton::clicked, [this]() {
+        fileOperations->cancelAll();
+    });
 }
 
+// Folders deleted since they were visited are skipped over and forgotten.
 void MainWindow::navigateBack() {
-    if (backHistory.isEmpty()) return;
-    
-    forwardHistory.append(currentPath);
-    QString targetPath = backHistory.takeLast();
-    goToDirectory(targetPath);
+    for (QString target = history.backPath(); !target.isEmpty(); target = history.backPath()) {
+        if (showDirectory(target)) {
+            history.goBack();
+            break;
+        }
+        history.remove(target);
+    }
     updateNavigationState();
 }
 
 void MainWindow::navigateForward() {
-    if (forwardHistory.isEmpty()) return;
-    
-    backHistory.append(currentPath);
-    QString targetPath = forwardHistory.takeLast();
-    goToDirectory(targetPath);
+    for (QString target = history.forwardPath(); !target.isEmpty(); target = history.forwardPath()) {
+        if (showDirectory(target)) {
+            history.goForward();
+            break;
+        }
+        history.remove(target);
+    }
     updateNavigationState();
 }
 
@@ -300,53 +476,71 @@ void MainWindow::navigateToDownloads() {
 }
 
 void MainWindow::refreshView() {
+    PerfScope scope("MainWindow::refreshView");
+    // The search index follows the disk through inotify; just re-run the query
+    if (isSearchActive()) {
+        if (!searchBar->text().isEmpty()) runSearch();
+        return;
+    }
+    
+    // Folder totals are recomputed on demand; unchanged folders are not read again
+    fileModel->directorySizes()->clear();
+    listView->viewport()->update();
+    
+    navigationStart = PerfTrace::now();
     fileModel->setRootPath(currentPath);
-    QModelIndex rootIndex = fileModel->index(currentPath);
-    iconView->setRootIndex(proxyModel->mapFromSource(rootIndex));
-    listView->setRootIndex(proxyModel->mapFromSource(rootIndex));
 }
 
 void MainWindow::toggleDarkMode() {
     isDarkMode = !isDarkMode;
     actionDarkMode->setChecked(isDarkMode);
     
-    QApplication* app = qApp;
-    QString styleFile = isDarkMode ? ":/qss/dark.qss" : ":/qss/light.qss";
-    QFile file(styleFile);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream stream(&file);
-        app->setStyleSheet(stream.readAll());
-        file.close();
-    }
+    // Flips the theme property and re-polishes; the style sheet stays parsed
+    ThemeEngine::instance().setTheme(isDarkMode ? ThemeEngine::Dark : ThemeEngine::Light);
 }
 
 void MainWindow::showContextMenu(const QPoint& pos) {
     QAbstractItemView* view = currentView();
     QModelIndex index = view->indexAt(pos);
     
-    if (!index.isValid()) {
+    // Group headers stand for no file
+    if (!index.isValid() || filePathForIndex(index).isEmpty()) {
         // Right-click on empty area - show general menu
         QMenu contextMenu(this);
         contextMenu.addAction(actionPaste);
         contextMenu.addSeparator();
         contextMenu.addAction(actionRefresh);
+        if (!isSearchActive()) {
+            QMenu* groupMenu = contextMenu.addMenu("Group By");
+            const QList<QPair<QString, EntryGrouping>> groupings = {
+                {"None", NoGrouping}, {"Kind", GroupByKind}, {"Date Modified", GroupByDate}
+            };
+            for (const auto& grouping : groupings) {
+                QAction* action = groupMenu->addAction(grouping.first, this, [this, grouping]() {
+                    fileModel->setGrouping(grouping.second);
+                });
+                action->setCheckable(true);
+                action->setChecked(fileModel->grouping() == grouping.second);
+            }
+        }
+        contextMenu.addSeparator();
+        contextMenu.addAction(actionPerfHud);
+        contextMenu.addAction(actionDumpTrace);
         contextMenu.exec(QCursor::pos());
         return;
     }
     
-    QModelIndex sourceIndex = proxyModel->mapToSource(index);
-    QFileInfo fileInfo = fileModel->fileInfo(sourceIndex);
-    bool isDir = fileInfo.isDir();
+    bool isDir = isDirIndex(index);
     
     QMenu contextMenu(this);
     
     // Open/Open With
     if (isDir) {
-        contextMenu.addAction(QIcon(":/icons/open.png"), "Open", this, [this, index]() {
+        contextMenu.addAction(QIcon(":/icons/open.svg"), "Open", this, [this, index]() {
             handleFileDoubleClick(index);
         });
     } else {
-        contextMenu.addAction(QIcon(":/icons/open.png"), "Open", this, [this, index]() {
+        contextMenu.addAction(QIcon(":/icons/open.svg"), "Open", this, [this, index]() {
             handleFileDoubleClick(index);
         });
         contextMenu.addAction("Open With...");
@@ -354,36 +548,27 @@ void MainWindow::showContextMenu(const QPoint& pos) {
     contextMenu.addSeparator();
     
     // Cut/Copy/Paste
-    contextMenu.addAction(QIcon(":/icons/cut.png"), "Cut", this, &MainWindow::cutFiles);
-    contextMenu.addAction(QIcon(":/icons/copy.png"), "Copy", this, &MainWindow::copyFiles);
-    contextMenu.addAction(QIcon(":/icons/paste.png"), "Paste", this, &MainWindow::pasteFiles);
+    contextMenu.addAction(QIcon(":/icons/cut.svg"), "Cut", this, &MainWindow::cutFiles);
+    contextMenu.addAction(QIcon(":/icons/copy.svg"), "Copy", this, &MainWindow::copyFiles);
+    contextMenu.addAction(QIcon(":/icons/paste.svg"), "Paste", this, &MainWindow::pasteFiles);
     contextMenu.addSeparator();
     
     // Rename/Delete
-    contextMenu.addAction(QIcon(":/icons/rename.png"), "Rename", this, &MainWindow::renameFile);
-    contextMenu.addAction(QIcon(":/icons/delete.png"), "Move to Trash", this, &MainWindow::deleteFiles);
+    contextMenu.addAction(QIcon(":/icons/rename.svg"), "Rename", this, &MainWindow::renameFile);
+    contextMenu.addAction(QIcon(":/icons/delete.svg"), "Move to Trash", this, &MainWindow::deleteFiles);
+    contextMenu.addAction(QIcon(":/icons/delete.svg"), "Delete Permanently", this, &MainWindow::deleteFilesPermanently);
     contextMenu.addSeparator();
     
     // Get Info
-    contextMenu.addAction(QIcon(":/icons/info.png"), "Get Info", this, &MainWindow::showFileInfo);
+    contextMenu.addAction(QIcon(":/icons/info.svg"), "Get Info", this, &MainWindow::showFileInfo);
     
     contextMenu.exec(QCursor::pos());
 }
 
 void MainWindow::cutFiles() {
-    QItemSelectionModel* selection = iconView->selectionModel();
-    if (!selection->hasSelection()) {
-        selection = listView->selectionModel();
-    }
-    
     QList<QUrl> urls;
-    QModelIndexList indexes = selection->selectedIndexes();
-    
-    for (const QModelIndex& idx : indexes) {
-        if (idx.column() == 0) {
-            QModelIndex sourceIdx = proxyModel->mapToSource(idx);
-            urls.append(QUrl::fromLocalFile(fileModel->filePath(sourceIdx)));
-        }
+    for (const QString& path : selectedFilePaths()) {
+        urls.append(QUrl::fromLocalFile(path));
     }
     
     QMimeData* mimeData = new QMimeData();
@@ -401,17 +586,14 @@ void MainWindow::cutFiles() {
 void MainWindow::handleFileDoubleClick(const QModelIndex& index) {
     if (!index.isValid()) return;
     
-    // Map through proxy model if needed
-    QModelIndex sourceIndex = proxyModel->mapToSource(index);
-    QFileSystemModel* model = qobject_cast<QFileSystemModel*>(fileModel);
-    QFileInfo fileInfo = model->fileInfo(sourceIndex);
+    // The models already know the entry type; no need to stat it again
+    QString path = filePathForIndex(index);
+    if (path.isEmpty()) return;
     
-    if (fileInfo.isDir()) {
-        backHistory.append(currentPath);
-        forwardHistory.clear();
-        goToDirectory(fileInfo.absoluteFilePath());
-    } else {
-        QDesktopServices::openUrl(QUrl::fromLocalFile(fileInfo.absoluteFilePath()));
+    if (isDirIndex(index)) {
+        goToDirectory(path);
+    } else if (QDesktopServices::openUrl(QUrl::fromLocalFile(path))) {
+        accessLog->record(path, false);
     }
 }
 
@@ -424,23 +606,131 @@ void MainWindow::updateCurrentPath(const QModelIndex& index) {
 }
 
 void MainWindow::searchFiles(const QString& text) {
-    proxyModel->setFilterFixedString(text);
+    PerfScope scope("MainWindow::searchFiles");
+    if (text.isEmpty()) {
+        searchTimer->stop();
+        searchIndex->cancel();
+        contentSearch->cancel();
+        setSearchActive(false);
+        return;
+    }
+    // Stop scanning files for the old text right away, not after the debounce
+    if (searchingContents) contentSearch->cancel();
+    searchTimer->start();
 }
 
-void MainWindow::copyFiles() {
-    QItemSelectionModel* selection = iconView->selectionModel();
-    if (!selection->hasSelection()) {
-        selection = listView->selectionModel();
+void MainWindow::runSearch() {
+    QString text = searchBar->text();
+    if (text.isEmpty()) return;
+    
+    setSearchActive(true);
+    searchResults->clear();
+    searchStart = PerfTrace::now();
+    searchingContents = actionSearchContents->isChecked();
+    if (searchingContents) {
+        searchIndex->cancel();
+        searchGeneration = contentSearch->search(currentPath, text);
+    } else {
+        contentSearch->cancel();
+        searchGeneration = searchIndex->search(currentPath, text);
+    }
+    statusBar()->showMessage("Searching...");
+}
+
+void MainWindow::showRecents() {
+    searchBar->blockSignals(true);
+    searchBar->clear();
+    searchBar->blockSignals(false);
+    searchTimer->stop();
+    contentSearch->cancel();
+    
+    setSearchActive(true);
+    searchResults->clear();
+    searchingContents = false;
+    pathLabel->setText("Recents");
+    setWindowTitle("Recents - Lotus-DIR");
+    
+    // What was opened most, and most lately. Until anything has been, the
+    // most recently modified files stand in.
+    const QVector<SearchHit> recents = accessLog->recents(200);
+    if (!recents.isEmpty()) {
+        searchIndex->cancel();
+        searchGeneration = 0;
+        searchResults->append(recents);
+        statusBar()->showMessage(QString("%1 recent item(s)").arg(recents.size()));
+        return;
+    }
+    searchStart = PerfTrace::now();
+    searchGeneration = searchIndex->recent(QDir::homePath(), 200);
+    statusBar()->showMessage("Loading recent files...");
+}
+
+void MainWindow::handleSearchResults(int generation, const QVector<SearchHit>& hits) {
+    if (searchingContents || generation != searchGeneration) return;
+    searchResults->append(hits);
+}
+
+void MainWindow::handleSearchFinished(int generation, int matches, bool partial) {
+    if (searchingContents || generation != searchGeneration) return;
+    if (!partial && searchStart) {
+        const qint64 duration = PerfTrace::now() - searchStart;
+        PerfTrace::record("search", searchStart, duration);
+        searchMs = duration / 1e6;
+        searchStart = 0;
+    }
+    statusBar()->showMessage(partial
+        ? QString("%1 match(es) so far, still indexing...").arg(matches)
+        : QString("%1 match(es)").arg(matches));
+}
+
+void MainWindow::handleContentResults(int generation, const QVector<SearchHit>& hits) {
+    if (!searchingContents || generation != searchGeneration) return;
+    searchResults->append(hits);
+    statusBar()->showMessage(QString("Searching... %1 match(es)").arg(searchResults->rowCount()));
+}
+
+void MainWindow::handleContentSearchFinished(int generation, int matches, int filesScanned, bool truncated) {
+    if (!searchingContents || generation != searchGeneration) return;
+    if (searchStart) {
+        const qint64 duration = PerfTrace::now() - searchStart;
+        PerfTrace::record("search", searchStart, duration);
+        searchMs = duration / 1e6;
+        searchStart = 0;
+    }
+    statusBar()->showMessage(truncated
+        ? QString("First %1 matches in %2 file(s) scanned").arg(matches).arg(filesScanned)
+        : QString("%1 match(es) in %2 file(s) scanned").arg(matches).arg(filesScanned));
+}
+
+bool MainWindow::isSearchActive() const {
+    return iconView->model() == searchResults;
+}
+
+void MainWindow::setSearchActive(bool active) {
+    if (active == isSearchActive()) return;
+    
+    QAbstractItemModel* model = active ? static_cast<QAbstractItemModel*>(searchResults)
+                                       : static_cast<QAbstractItemModel*>(fileModel);
+    for (QAbstractItemView* view : {static_cast<QAbstractItemView*>(iconView), static_cast<QAbstractItemView*>(listView)}) {
+        // setModel() does not delete the old selection model
+        QItemSelectionModel* oldSelection = view->selectionModel();
+        view->setModel(model);
+        delete oldSelection;
+        watchSelection(view);
     }
+    updateGroupSpans();
+    updatePreview();
     
+    if (!active) {
+        searchResults->clear();
+        statusBar()->clearMessage();
+    }
+}
+
+void MainWindow::copyFiles() {
     QList<QUrl> urls;
-    QModelIndexList indexes = selection->selectedIndexes();
-    
-    for (const QModelIndex& index : indexes) {
-        if (index.column() == 0) {
-            QModelIndex sourceIndex = proxyModel->mapToSource(index);
-            urls.append(QUrl::fromLocalFile(fileModel->filePath(sourceIndex)));
-        }
+    for (const QString& path : selectedFilePaths()) {
+        urls.append(QUrl::fromLocalFile(path));
     }
     
     QMimeData* mimeData = new QMimeData();
@@ -453,57 +743,59 @@ void MainWindow::copyFiles() {
 }
 
 void MainWindow::pasteFiles() {
+    PerfScope scope("MainWindow::pasteFiles");
     QClipboard* clipboard = QApplication::clipboard();
     const QMimeData* mimeData = clipboard->mimeData();
     
     if (mimeData->hasUrls()) {
-        QList<QUrl> urls = mimeData->urls();
-        for (const QUrl& url : urls) {
+        QStringList sources;
+        for (const QUrl& url : mimeData->urls()) {
             if (url.isLocalFile()) {
-                QString sourcePath = url.toLocalFile();
-                QString destPath = currentPath + "/" + QFileInfo(sourcePath).fileName();
-                
-                QFileInfo sourceInfo(sourcePath);
-                if (sourceInfo.isDir()) {
-                    copyDirectory(sourcePath, destPath);
-                } else {
-                    QFile::copy(sourcePath, destPath);
-                }
+                sources.append(url.toLocalFile());
             }
         }
-        refreshView();
+        if (sources.isEmpty()) return;
+        
+        bool isCut = clipboard->text(QClipboard::Selection) == "CUT_OPERATION";
+        fileOperations->enqueue(isCut ? FileOperationJob::Move : FileOperationJob::Copy, sources, currentPath);
+        
+        // Cut items can only be pasted once
+        if (isCut) {
+            clipboard->clear();
+            clipboard->clear(QClipboard::Selection);
+        }
     }
 }
 
 void MainWindow::deleteFiles() {
-    QItemSelectionModel* selection = iconView->selectionModel();
-    if (!selection->hasSelection()) {
-        selection = listView->selectionModel();
-    }
-    
-    QModelIndexList indexes = selection->selectedIndexes();
-    if (indexes.isEmpty()) return;
-    
-    int itemCount = 0;
-    for (const QModelIndex& index : indexes) {
-        if (index.column() == 0) itemCount++;
-    }
+    QStringList paths = selectedFilePaths();
+    if (paths.isEmpty()) return;
     
     QMessageBox::StandardButton reply = QMessageBox::question(
         this, "Delete Files",
-        QString("Move %1 item(s) to Trash?").arg(itemCount),
+        QString("Move %1 item(s) to Trash?").arg(paths.size()),
         QMessageBox::Yes | QMessageBox::No
     );
     
+    // The folder model picks the removals up through its watch, or lists
+    // the folder again once the job finishes if it has none
     if (reply == QMessageBox::Yes) {
-        for (const QModelIndex& index : indexes) {
-            if (index.column() == 0) {
-                QModelIndex sourceIndex = proxyModel->mapToSource(index);
-                QString filePath = fileModel->filePath(sourceIndex);
-                QFile::moveToTrash(filePath);
-            }
-        }
-        refreshView();
+        fileOperations->enqueue(FileOperationJob::Trash, paths, QString());
+    }
+}
+
+void MainWindow::deleteFilesPermanently() {
+    QStringList paths = selectedFilePaths();
+    if (paths.isEmpty()) return;
+    
+    QMessageBox::StandardButton reply = QMessageBox::warning(
+        this, "Delete Permanently",
+        QString("Permanently delete %1 item(s)? This cannot be undone.").arg(paths.size()),
+        QMessageBox::Yes | QMessageBox::No, QMessageBox::No
+    );
+    
+    if (reply == QMessageBox::Yes) {
+        fileOperations->enqueue(FileOperationJob::Delete, paths, QString());
     }
 }
 
@@ -513,8 +805,9 @@ void MainWindow::renameFile() {
     
     if (!index.isValid()) return;
     
-    QModelIndex sourceIndex = proxyModel->mapToSource(index);
-    QString oldName = fileModel->fileName(sourceIndex);
+    QString oldPath = filePathForIndex(index);
+    if (oldPath.isEmpty()) return;
+    QString oldName = QFileInfo(oldPath).fileName();
     bool ok;
     QString newName = QInputDialog::getText(
         this, "Rename",
@@ -525,10 +818,10 @@ void MainWindow::renameFile() {
     );
     
     if (ok && !newName.isEmpty() && newName != oldName) {
-        QString oldPath = fileModel->filePath(sourceIndex);
         QString newPath = QFileInfo(oldPath).absolutePath() + "/" + newName;
+        // The folder model picks the rename up through inotify, if it has a watch
         QFile::rename(oldPath, newPath);
-        refreshView();
+        fileModel->refreshIfUnwatched();
     }
 }
 
@@ -538,50 +831,79 @@ void MainWindow::showFileInfo() {
     
     if (!index.isValid()) return;
     
-    QModelIndex sourceIndex = proxyModel->mapToSource(index);
-    QFileInfo fileInfo = fileModel->fileInfo(sourceIndex);
+    if (filePathForIndex(index).isEmpty()) return;
+    QFileInfo fileInfo(filePathForIndex(index));
+    DirectorySizes* sizes = fileModel->directorySizes();
     
     QString modifiedDate = fileInfo.lastModified().toString(QLocale::system().dateTimeFormat(QLocale::ShortFormat));
     
-    QString info = QString(
-        "<b>Name:</b> %1<br>"
-        "<b>Path:</b> %2<br>"
-        "<b>Size:</b> %3<br>"
-        "<b>Type:</b> %4<br>"
-        "<b>Modified:</b> %5"
-    ).arg(fileInfo.fileName())
-     .arg(fileInfo.absoluteFilePath())
-     .arg(fileInfo.isDir() ? "Folder" : QString::number(fileInfo.size()) + " bytes")
-     .arg(fileInfo.isDir() ? "Folder" : fileInfo.suffix())
-     .arg(modifiedDate);
-    
-    QMessageBox::information(this, "File Info", info);
+    // Folder sizes come from the background walker; the dialog updates itself when it finishes
+    auto infoText = [fileInfo, sizes, modifiedDate]() {
+        QString size;
+        if (fileInfo.isDir()) {
+            qint64 bytes = sizes->size(fileInfo.absoluteFilePath());
+            size = bytes < 0 ? QString("Calculating...")
+                             : QString("%1 bytes in %2 file(s)").arg(bytes).arg(sizes->fileCount(fileInfo.absoluteFilePath()));
+        } else {
+            size = QString::number(fileInfo.size()) + " bytes";
+        }
+        
+        return QString(
+            "<b>Name:</b> %1<br>"
+            "<b>Path:</b> %2<br>"
+            "<b>Size:</b> %3<br>"
+            "<b>Type:</b> %4<br>"
+            "<b>Modified:</b> %5"
+        ).arg(fileInfo.fileName())
+         .arg(fileInfo.absoluteFilePath())
+         .arg(size)
+         .arg(fileInfo.isDir() ? "Folder" : fileInfo.suffix())
+         .arg(modifiedDate);
+    };
+    
+    QMessageBox box(QMessageBox::Information, "File Info", infoText(), QMessageBox::Ok, this);
+    connect(sizes, &DirectorySizes::sizeReady, &box, [&box, &infoText, fileInfo](const QString& path) {
+        if (path == fileInfo.absoluteFilePath()) box.setText(infoText());
+    });
+    box.exec();
 }
 
 QAbstractItemView* MainWindow::currentView() const {
     return viewStack->currentIndex() == 0 ? static_cast<QAbstractItemView*>(iconView) : static_cast<QAbstractItemView*>(listView);
 }
 
-void MainWindow::copyDirectory(const QString& src, const QString& dst) {
-    QDir sourceDir(src);
-    QDir destDir(dst);
-    
-    if (!destDir.exists()) {
-        destDir.mkpath(".");
+QString MainWindow::filePathForIndex(const QModelIndex& index) const {
+    if (!index.isValid()) return QString();
+    if (index.model() == searchResults) {
+        return searchResults->filePath(index);
+    }
+    return fileModel->filePath(index);
+}
+
+bool MainWindow::isDirIndex(const QModelIndex& index) const {
+    if (!index.isValid()) return false;
+    if (index.model() == searchResults) {
+        return searchResults->isDir(index);
+    }
+    return fileModel->isDir(index);
+}
+
+// Traced on its own, so deletes are timed without the confirmation dialog;
+// the jobs themselves are traced as "fileOperation".
+QStringList MainWindow::selectedFilePaths() const {
+    PerfScope scope("MainWindow::selectedFilePaths");
+    QItemSelectionModel* selection = iconView->selectionModel();
+    if (!selection->hasSelection()) {
+        selection = listView->selectionModel();
     }
     
-    QStringList entries = sourceDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot);
-    for (const QString& entry : entries) {
-        QString sourcePath = src + "/" + entry;
-        QString destPath = dst + "/" + entry;
-        QFileInfo info(sourcePath);
-        
-        if (info.isDir()) {
-            copyDirectory(sourcePath, destPath);
-        } else {
-            QFile::copy(sourcePath, destPath);
+    QStringList paths;
+    for (const QModelIndex& index : selection->selectedIndexes()) {
+        if (index.column() == 0) {
+            paths.append(filePathForIndex(index));
         }
     }
+    return paths;
 }
 
 void MainWindow::toggleSidebar() {
@@ -589,11 +911,183 @@ void MainWindow::toggleSidebar() {
 }
 
 void MainWindow::togglePreview() {
-    // Preview panel toggle - can be extended
-    previewVisible = !previewVisible;
+    previewVisible = actionTogglePreview->isChecked();
+    if (previewVisible && !previewPane) {
+        previewPane = new PreviewPane(this);
+        splitter->addWidget(previewPane);
+        QList<int> sizes = splitter->sizes();
+        sizes[1] = qMax(0, sizes[1] - 320);
+        sizes[2] = 320;
+        splitter->setSizes(sizes);
+    }
+    if (previewPane) previewPane->setVisible(previewVisible);
+    updatePreview();
+}
+
+void MainWindow::updatePreview() {
+    // A hidden pane keeps nothing mapped or decoding
+    if (!previewVisible) {
+        if (previewPane) previewPane->clear();
+        return;
+    }
+    previewPane->showFile(filePathForIndex(currentView()->currentIndex()));
+}
+
+// Group headers span the whole row of the list view.
+void MainWindow::updateGroupSpans() {
+    listView->clearSpans();
+    if (listView->model() != fileModel) return;
+    for (int row : fileModel->groupHeaderRows()) {
+        listView->setSpan(row, 0, 1, FileModel::ColumnCount);
+    }
+}
+
+// The parent is prefetched so Up (and Back, after following a link down) is
+// instant. Navigation is timed from the request to the first full listing,
+// which is what the user waits on; the rate covers the same span.
+void MainWindow::handleDirectoryLoaded(const QString& path) {
+    if (path != currentPath) return;
+    if (path != QLatin1String("/")) fileModel->prefetch(QFileInfo(path).absolutePath());
+    if (!navigationStart) return;
+    const qint64 duration = PerfTrace::now() - navigationStart;
+    PerfTrace::record("navigation", navigationStart, duration);
+    navigationStart = 0;
+    navigationMs = duration / 1e6;
+    rowsPerSecond = duration > 0 ? fileModel->entryCount() * 1e9 / duration : 0;
+    if (perfHud->isVisible()) updatePerfHud();
+}
+
+// Folders the user is likely to open next are listed ahead of time (see
+// FileModel::prefetch): hovered and current folders, and the way up.
+void MainWindow::prefetchIndex(const QModelIndex& index) {
+    if (isDirIndex(index)) fileModel->prefetch(filePathForIndex(index));
+}
+
+void MainWindow::updatePerfHud() {
+    auto millis = [](double ms) {
+        return ms < 0 ? QString("-") : QString("%1 ms").arg(ms, 0, 'f', 1);
+    };
+    perfHud->setText(QString("Open %1 | %2 rows/s | Search %3 | Jobs %4 | Thumbnails %5")
+        .arg(millis(navigationMs))
+        .arg(qRound64(rowsPerSecond))
+        .arg(millis(searchMs))
+        .arg(fileOperations->pendingJobs())
+        .arg(fileModel->thumbnailCache()->queuedLoads()));
+}
+
+void MainWindow::dumpTrace() {
+    const QString suggested = QDir::homePath() + "/lotus-dir-trace-"
+        + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+    const QString path = QFileDialog::getSaveFileName(this, "Dump Trace", suggested,
+                                                      "Trace files (*.json)");
+    if (path.isEmpty()) return;
+    
+    QString error;
+    if (PerfTrace::dump(path, &error)) {
+        statusBar()->showMessage("Trace written to " + path + " (open in ui.perfetto.dev or chrome://tracing)", 5000);
+    } else {
+        QMessageBox::warning(this, "Dump Trace", "Could not write the trace: " + error);
+    }
+}
+
+void MainWindow::watchSelection(QAbstractItemView* view) {
+    connect(view->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::updatePreview);
+    connect(view->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::prefetchIndex);
+}
+
+void MainWindow::handleOperationStarted(int jobId, const QString& description) {
+    jobStarts.insert(jobId, PerfTrace::now());
+    activeJobId = jobId;
+    operationLabel->setText(description);
+    operationProgress->setRange(0, 0);
+    operationLabel->show();
+    operationProgress->show();
+    operationPauseButton->show();
+    operationCancelButton->show();
+}
+
+void MainWindow::handleOperationProgress(int jobId, qint64 bytesDone, qint64 bytesTotal, int filesDone, int filesTotal, double megabytesPerSecond) {
+    if (jobId != activeJobId) return;
+    
+    lastThroughput = megabytesPerSecond;
+    
+    // Trash and delete jobs move no bytes; permanent deletes don't know their total either
+    if (bytesTotal == 0) {
+        if (filesTotal > 0) {
+            operationLabel->setText(QString("%1 of %2 items").arg(filesDone).arg(filesTotal));
+            operationProgress->setRange(0, filesTotal);
+            operationProgress->setValue(filesDone);
+        } else {
+            operationLabel->setText(QString("%1 items removed").arg(filesDone));
+            operationProgress->setRange(0, 0);
+        }
+        return;
+    }
+    
+    QLocale locale;
+    operationLabel->setText(QString("%1 of %2 files, %3 of %4 (%5 MB/s)")
+                            .arg(filesDone)
+                            .arg(filesTotal)
+                            .arg(locale.formattedDataSize(bytesDone))
+                            .arg(locale.formattedDataSize(bytesTotal))
+                            .arg(megabytesPerSecond, 0, 'f', 1));
+    
+    // Scale to per-mille so multi-GB jobs fit in the bar's int range
+    operationProgress->setRange(0, 1000);
+    operationProgress->setValue(int(bytesDone * 1000 / bytesTotal));
+}
+
+void MainWindow::handleOperationFinished(int jobId, bool cancelled, const QStringList& errors) {
+    const qint64 started = jobStarts.take(jobId);
+    if (started) PerfTrace::record("fileOperation", started, PerfTrace::now() - started);
+    
+    if (fileOperations->pendingJobs() == 0) {
+        operationLabel->hide();
+        operationProgress->hide();
+        operationPauseButton->hide();
+        operationCancelButton->hide();
+        operationPauseButton->setChecked(false);
+    }
+    if (jobId == activeJobId) activeJobId = 0;
+    
+    // Rows follow the disk through inotify; only derived data needs redoing,
+    // unless the folder couldn't be watched
+    fileModel->refreshIfUnwatched();
+    fileModel->directorySizes()->clear();
+    listView->viewport()->update();
+    if (isSearchActive() && !searchBar->text().isEmpty()) runSearch();
+    
+    if (cancelled) {
+        statusBar()->showMessage("Operation cancelled", 3000);
+    } else if (errors.isEmpty() && lastThroughput > 0) {
+        statusBar()->showMessage(QString("Operation finished (%1 MB/s)").arg(lastThroughput, 0, 'f', 1), 3000);
+    } else if (errors.isEmpty()) {
+        statusBar()->showMessage("Operation finished", 3000);
+    }
+    
+    if (!errors.isEmpty()) {
+        QStringList shown = errors.mid(0, 10);
+        if (errors.size() > shown.size()) {
+            shown.append(QString("...and %1 more").arg(errors.size() - shown.size()));
+        }
+        QMessageBox::warning(this, "File Operation", shown.join("\n"));
+    }
 }
 
 void MainWindow::closeEvent(QCloseEvent* event) {
+    if (fileOperations->pendingJobs() > 0) {
+        QMessageBox::StandardButton reply = QMessageBox::question(
+            this, "File Operations",
+            "File operations are still running. Cancel them and quit?",
+            QMessageBox::Yes | QMessageBox::No
+        );
+        if (reply != QMessageBox::Yes) {
+            event->ignore();
+            return;
+        }
+        fileOperations->cancelAll();
+    }
+    saveSession();
     QMainWindow::closeEvent(event);
 }
 
@@ -604,25 +1098,64 @@ void MainWindow::updateWindowTitle() {
 }
 
 void MainWindow::updateNavigationState() {
-    actionBack->setEnabled(!backHistory.isEmpty());
-    actionForward->setEnabled(!forwardHistory.isEmpty());
+    actionBack->setEnabled(!history.backPath().isEmpty());
+    actionForward->setEnabled(!history.forwardPath().isEmpty());
 }
 
 void MainWindow::goToDirectory(const QString& path) {
-    if (!QDir(path).exists()) return;
+    if (showDirectory(path)) {
+        history.visit(path);
+        accessLog->record(path, true);
+    }
+    updateNavigationState();
+}
+
+bool MainWindow::showDirectory(const QString& path) {
+    PerfScope scope("MainWindow::showDirectory");
+    if (!QDir(path).exists()) return false;
+    
+    // Navigating leaves search results behind
+    if (isSearchActive()) {
+        searchBar->blockSignals(true);
+        searchBar->clear();
+        searchBar->blockSignals(false);
+        searchTimer->stop();
+        searchIndex->cancel();
+        contentSearch->cancel();
+        setSearchActive(false);
+    }
+    
+    // Sizes queued for the previous folder's rows are no longer needed
+    fileModel->directorySizes()->cancelPending();
     
-    backHistory.append(currentPath);
-    forwardHistory.clear();
     currentPath = path;
     
+    // Timed until the first rows are in (handleDirectoryLoaded)
+    navigationStart = PerfTrace::now();
     fileModel->setRootPath(path);
-    QModelIndex rootIndex = fileModel->index(path);
-    iconView->setRootIndex(proxyModel->mapFromSource(rootIndex));
-    listView->setRootIndex(proxyModel->mapFromSource(rootIndex));
+    searchIndex->refresh(path);
     
     pathLabel->setText(path);
     updateWindowTitle();
-    updateNavigationState();
+    return true;
+}
+
+void MainWindow::restoreSession() {
+    QSettings settings;
+    history.restore(settings.value("Session/history").toStringList(),
+                    settings.value("Session/historyPosition", 0).toInt());
+    const QString last = history.current();
+    if (!last.isEmpty() && QDir(last).exists()) currentPath = last;
+    history.visit(currentPath);
+    fileModel->restoreListing(sessionListingFile());
+}
+
+void MainWindow::saveSession() {
+    QSettings settings;
+    settings.setValue("Session/history", history.paths());
+    settings.setValue("Session/historyPosition", history.position());
+    // A stale listing would be caught by its mtime, but is no use either
+    if (!fileModel->saveListing(sessionListingFile())) QFile::remove(sessionListingFile());
 }
 
 void MainWindow::goToIndex(const QModelIndex& index) {
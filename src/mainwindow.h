@@ -9,9 +9,20 @@
 #include <QLabel>
 #include <QSplitter>
 #include <QTableView>
-#include <QSortFilterProxyModel>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QTimer>
+#include <QHash>
 #include "sidebar.h"
 #include "filemodel.h"
+#include "fileoperations.h"
+#include "searchindex.h"
+#include "contentsearch.h"
+#include "searchresultsmodel.h"
+#include "previewpane.h"
+#include "icongridview.h"
+#include "navigationhistory.h"
+#include "accesslog.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -41,10 +52,26 @@ private slots:
     void cutFiles();
     void pasteFiles();
     void deleteFiles();
+    void deleteFilesPermanently();
     void renameFile();
     void showFileInfo();
     void toggleSidebar();
     void togglePreview();
+    void handleOperationStarted(int jobId, const QString& description);
+    void handleOperationProgress(int jobId, qint64 bytesDone, qint64 bytesTotal, int filesDone, int filesTotal, double megabytesPerSecond);
+    void handleOperationFinished(int jobId, bool cancelled, const QStringList& errors);
+    void runSearch();
+    void showRecents();
+    void handleSearchResults(int generation, const QVector<SearchHit>& hits);
+    void handleSearchFinished(int generation, int matches, bool partial);
+    void handleContentResults(int generation, const QVector<SearchHit>& hits);
+    void handleContentSearchFinished(int generation, int matches, int filesScanned, bool truncated);
+    void updatePreview();
+    void updateGroupSpans();
+    void handleDirectoryLoaded(const QString& path);
+    void prefetchIndex(const QModelIndex& index);
+    void updatePerfHud();
+    void dumpTrace();
 
 private:
     void setupUI();
@@ -53,24 +80,64 @@ private:
     void updateWindowTitle();
     void updateNavigationState();
     void goToDirectory(const QString& path);
+    // Shows path without recording it in the history; false if it's gone.
+    bool showDirectory(const QString& path);
     void goToIndex(const QModelIndex& index);
+    void restoreSession();
+    void saveSession();
     QAbstractItemView* currentView() const;
-    void copyDirectory(const QString& src, const QString& dst);
+    QString filePathForIndex(const QModelIndex& index) const;
+    bool isDirIndex(const QModelIndex& index) const;
+    QStringList selectedFilePaths() const;
+    bool isSearchActive() const;
+    void setSearchActive(bool active);
+    void watchSelection(QAbstractItemView* view);
     
     QWidget* centralWidget;
     QToolBar* toolbar;
     Sidebar* sidebar;
     QStackedWidget* viewStack;
     FileModel* fileModel;
-    QSortFilterProxyModel* proxyModel;
-    QListView* iconView;
+    IconGridView* iconView;
     QTableView* listView;
     QLineEdit* searchBar;
     QLabel* pathLabel;
+    QSplitter* splitter;
+    // Created on first use
+    PreviewPane* previewPane;
     
-    // Navigation history
-    QList<QString> backHistory;
-    QList<QString> forwardHistory;
+    // Recursive filename (or file contents) search below currentPath
+    SearchIndex* searchIndex;
+    // Files opened and folders visited, ranked for Recents
+    AccessLog* accessLog;
+    ContentSearch* contentSearch;
+    SearchResultsModel* searchResults;
+    QTimer* searchTimer;
+    int searchGeneration;
+    bool searchingContents;
+    
+    // Background copy/move engine and its status bar widgets
+    FileOperationQueue* fileOperations;
+    QLabel* operationLabel;
+    QProgressBar* operationProgress;
+    QToolButton* operationPauseButton;
+    QToolButton* operationCancelButton;
+    int activeJobId;
+    double lastThroughput;
+    
+    // Performance HUD: latency of the last folder load and search, and how
+    // much work is queued. Start times are PerfTrace::now(), 0 when idle.
+    QLabel* perfHud;
+    QTimer* perfHudTimer;
+    qint64 navigationStart;
+    double navigationMs;
+    double rowsPerSecond;
+    qint64 searchStart;
+    double searchMs;
+    QHash<int, qint64> jobStarts;
+    
+    // Navigation history, kept across sessions
+    NavigationHistory history;
     QString currentPath;
     
     // Actions
@@ -88,8 +155,12 @@ private:
     QAction* actionCopy;
     QAction* actionPaste;
     QAction* actionDelete;
+    QAction* actionDeletePermanently;
     QAction* actionRename;
     QAction* actionInfo;
+    QAction* actionSearchContents;
+    QAction* actionPerfHud;
+    QAction* actionDumpTrace;
     
     bool isDarkMode;
     bool sidebarVisible;
@@ -0,0 +1,484 @@
+#include "mappedfileview.h"
+#include "simdsearch.h"
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QPainter>
+#include <QScrollBar>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+const int kReadSize = 1 << 20;
+const int kReportIntervalMs = 100;
+const int kHexBytesPerRow = 16;
+// Longer lines are cut off for display
+const qint64 kMaxLineBytes = 4096;
+// How far back (in checkpoints) to look for a known highlighter state; a
+// seek highlights at most this many checkpoints' worth of lines plus one
+const qint64 kStateLookback = 2;
+const int kTabWidth = 4;
+
+QColor formatColor(SyntaxHighlighter::Format format, bool dark) {
+    switch (format) {
+    case SyntaxHighlighter::Keyword: return dark ? QColor("#FF7AB2") : QColor("#AD3DA4");
+    case SyntaxHighlighter::String: return dark ? QColor("#FC6A5D") : QColor("#D12F1B");
+    case SyntaxHighlighter::Comment: return dark ? QColor("#7F8C98") : QColor("#707F8C");
+    case SyntaxHighlighter::Number: return dark ? QColor("#D9C97C") : QColor("#272AD8");
+    case SyntaxHighlighter::Preprocessor: return dark ? QColor("#FD8F3F") : QColor("#78492A");
+    default: return QColor();
+    }
+}
+
+} // namespace
+
+LineIndexer::LineIndexer(std::atomic<int>* generation, QObject *parent)
+    : QObject(parent)
+    , generation(generation)
+{
+}
+
+void LineIndexer::index(int gen, const QString& path, qint64 size) {
+    if (gen != generation->load()) return;
+
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        emit progress(gen, QVector<qint64>(), 0, true);
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // One buffer reused for the whole file, so memory use does not depend on its size
+    QByteArray buffer(kReadSize, Qt::Uninitialized);
+    QVector<qint64> batch;
+    qint64 offset = 0;
+    qint64 lines = 0;
+    char last = '\n';
+    QElapsedTimer sinceReport;
+    sinceReport.start();
+
+    while (offset < size) {
+        if (gen != generation->load()) {
+            ::close(fd);
+            return;
+        }
+
+        ssize_t n = pread(fd, buffer.data(), size_t(qMin<qint64>(kReadSize, size - offset)), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        const char* begin = buffer.constData();
+        const char* end = begin + n;
+        for (const char* p = begin; (p = static_cast<const char*>(memchr(p, '\n', size_t(end - p)))); ) {
+            p++;
+            lines++;
+            if (lines % MappedFileView::kLinesPerCheckpoint == 0) batch.append(offset + (p - begin));
+        }
+        last = end[-1];
+        offset += n;
+
+        if (sinceReport.elapsed() >= kReportIntervalMs) {
+            emit progress(gen, batch, lines, false);
+            batch.clear();
+            sinceReport.restart();
+        }
+    }
+    ::close(fd);
+
+    // A last line without a trailing newline still counts
+    if (offset > 0 && last != '\n') lines++;
+    emit progress(gen, batch, lines, true);
+}
+
+MappedFileView::MappedFileView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , generation(0)
+    , indexer(new LineIndexer(&generation))
+    , fd(-1)
+    , data(nullptr)
+    , mappedSize(0)
+    , size(0)
+    , viewMode(TextMode)
+    , language(SyntaxHighlighter::None)
+    , lineCount(0)
+    , indexRequested(false)
+    , cachedLine(0)
+    , cachedOffset(0)
+    , cachedState(SyntaxHighlighter::Normal)
+    , charWidth(1)
+    , lineHeight(1)
+    , widestLine(0)
+{
+    qRegisterMetaType<QVector<qint64>>("QVector<qint64>");
+
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    updateMetrics();
+
+    indexer->moveToThread(&indexerThread);
+    connect(&indexerThread, &QThread::finished, indexer, &QObject::deleteLater);
+    connect(indexer, &LineIndexer::progress, this, &MappedFileView::handleIndexProgress);
+    indexerThread.setObjectName("LineIndexer");
+    indexerThread.start(QThread::LowPriority);
+}
+
+MappedFileView::~MappedFileView() {
+    generation++;
+    indexerThread.quit();
+    indexerThread.wait();
+    if (data) munmap(const_cast<char*>(data), size_t(mappedSize));
+    if (fd >= 0) ::close(fd);
+}
+
+bool MappedFileView::openFile(const QString& path) {
+    closeFile();
+
+    int file = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) return false;
+
+    struct stat st;
+    if (fstat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(file);
+        return false;
+    }
+    if (st.st_size > 0) {
+        // Pages are only read in as the visible window touches them
+        void* mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(file);
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+    }
+
+    filePath = path;
+    fd = file;
+    mappedSize = st.st_size;
+    size = st.st_size;
+    viewMode = size > 0 && looksBinary(data, size_t(size)) ? HexMode : TextMode;
+    language = SyntaxHighlighter::languageForSuffix(QFileInfo(path).suffix());
+
+    if (viewMode == TextMode) startIndexing();
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+void MappedFileView::closeFile() {
+    generation++;
+    if (data) munmap(const_cast<char*>(data), size_t(mappedSize));
+    if (fd >= 0) ::close(fd);
+
+    filePath.clear();
+    fd = -1;
+    data = nullptr;
+    mappedSize = 0;
+    size = 0;
+    language = SyntaxHighlighter::None;
+    checkpoints = {0};
+    checkpointStates = {qint8(SyntaxHighlighter::Normal)};
+    lineCount = 0;
+    indexRequested = false;
+    cachedLine = 0;
+    cachedOffset = 0;
+    cachedState = SyntaxHighlighter::Normal;
+    widestLine = 0;
+
+    updateScrollBars();
+    viewport()->update();
+}
+
+void MappedFileView::setMode(Mode mode) {
+    if (mode == viewMode) return;
+
+    viewMode = mode;
+    // Binary files open in hex mode; only count their lines if asked to
+    if (viewMode == TextMode && !indexRequested) startIndexing();
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+}
+
+void MappedFileView::startIndexing() {
+    if (size == 0) return;
+
+    indexRequested = true;
+    int gen = generation.load();
+    QMetaObject::invokeMethod(indexer, "index", Qt::QueuedConnection, Q_ARG(int, gen),
+                              Q_ARG(QString, filePath), Q_ARG(qint64, size));
+}
+
+// Touching a mapped page wholly past the end of the file raises SIGBUS, so
+// a file truncated since it was opened is cut back to its current size
+// before every paint, and its lines are counted again.
+void MappedFileView::clampToFile() {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size >= size) return;
+
+    generation++;
+    size = qMax<qint64>(0, st.st_size);
+    checkpoints = {0};
+    checkpointStates = {qint8(SyntaxHighlighter::Normal)};
+    lineCount = 0;
+    indexRequested = false;
+    cachedLine = 0;
+    cachedOffset = 0;
+    cachedState = SyntaxHighlighter::Normal;
+    if (viewMode == TextMode) startIndexing();
+    updateScrollBars();
+}
+
+void MappedFileView::handleIndexProgress(int gen, const QVector<qint64>& newCheckpoints, qint64 lines, bool finished) {
+    // Partial counts are already usable: the scroll range just keeps growing
+    Q_UNUSED(finished);
+    if (gen != generation.load()) return;
+
+    checkpoints += newCheckpoints;
+    while (checkpointStates.size() < checkpoints.size()) checkpointStates.append(-1);
+    lineCount = lines;
+
+    updateScrollBars();
+    viewport()->update();
+}
+
+void MappedFileView::paintEvent(QPaintEvent *event) {
+    Q_UNUSED(event);
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().color(QPalette::Base));
+    if (!data) return;
+    clampToFile();
+
+    painter.setFont(font());
+    if (viewMode == HexMode) {
+        paintHex(painter);
+    } else {
+        paintText(painter);
+    }
+}
+
+void MappedFileView::paintText(QPainter& painter) {
+    const int rows = viewport()->height() / lineHeight + 1;
+    const qint64 top = verticalScrollBar()->value();
+    seekLine(top);
+
+    const int digits = QString::number(qMax<qint64>(lineCount, top + rows)).size();
+    const int gutter = (digits + 2) * charWidth;
+    const int x = gutter - horizontalScrollBar()->value();
+    const int ascent = painter.fontMetrics().ascent();
+    const bool dark = palette().color(QPalette::Base).lightness() < 128;
+    const QColor textColor = palette().color(QPalette::Text);
+    QColor gutterColor = textColor;
+    gutterColor.setAlphaF(0.4);
+
+    qint64 line = cachedLine;
+    qint64 offset = cachedOffset;
+    int state = cachedState;
+    int widest = widestLine;
+    QVector<SyntaxHighlighter::Span> spans;
+
+    for (int row = 0; row < rows && offset < size; row++, line++) {
+        qint64 end = lineEnd(offset, qMin(size, offset + kMaxLineBytes));
+        const QString text = lineText(offset, end);
+        spans.clear();
+        state = SyntaxHighlighter::highlightLine(language, text.constData(), text.size(), state, spans);
+        widest = qMax(widest, text.size());
+
+        const int y = row * lineHeight + ascent;
+        painter.setClipRect(gutter, 0, viewport()->width() - gutter, viewport()->height());
+        int column = 0;
+        for (const SyntaxHighlighter::Span& span : qAsConst(spans)) {
+            if (span.start > column) {
+                painter.setPen(textColor);
+                painter.drawText(x + column * charWidth, y, text.mid(column, span.start - column));
+            }
+            painter.setPen(formatColor(span.format, dark));
+            painter.drawText(x + span.start * charWidth, y, text.mid(span.start, span.length));
+            column = span.start + span.length;
+        }
+        if (column < text.size()) {
+            painter.setPen(textColor);
+            painter.drawText(x + column * charWidth, y, text.mid(column));
+        }
+        painter.setClipping(false);
+
+        painter.setPen(gutterColor);
+        painter.drawText(QRect(0, row * lineHeight, gutter - charWidth, lineHeight),
+                         Qt::AlignRight | Qt::AlignVCenter, QString::number(line + 1));
+
+        if (end < size && data[end] != '\n') {
+            // A cut-off line: only search for its end once the index has
+            // found one, so a huge single-line file is never scanned here.
+            if (line + 1 >= lineCount) break;
+            end = lineEnd(end, size);
+        }
+        offset = end + 1;
+    }
+
+    if (widest > widestLine) {
+        widestLine = widest;
+        updateScrollBars();
+    }
+}
+
+void MappedFileView::paintHex(QPainter& painter) {
+    static const char digits[] = "0123456789abcdef";
+    const int rows = viewport()->height() / lineHeight + 1;
+    const int offsetDigits = size > 0xFFFFFFFFLL ? 12 : 8;
+    const int x = charWidth - horizontalScrollBar()->value();
+    const int ascent = painter.fontMetrics().ascent();
+    painter.setPen(palette().color(QPalette::Text));
+
+    QString text;
+    for (int row = 0; row < rows; row++) {
+        const qint64 offset = (qint64(verticalScrollBar()->value()) + row) * kHexBytesPerRow;
+        if (offset >= size) break;
+
+        const uchar* bytes = reinterpret_cast<const uchar*>(data + offset);
+        const int count = int(qMin<qint64>(kHexBytesPerRow, size - offset));
+        text = QString("%1  ").arg(offset, offsetDigits, 16, QLatin1Char('0'));
+        for (int i = 0; i < kHexBytesPerRow; i++) {
+            if (i < count) {
+                text += QLatin1Char(digits[bytes[i] >> 4]);
+                text += QLatin1Char(digits[bytes[i] & 0xf]);
+            } else {
+                text += QLatin1String("  ");
+            }
+            text += QLatin1Char(' ');
+            if (i == kHexBytesPerRow / 2 - 1) text += QLatin1Char(' ');
+        }
+        text += QLatin1Char(' ');
+        for (int i = 0; i < count; i++) {
+            text += bytes[i] >= 0x20 && bytes[i] < 0x7f ? QLatin1Char(char(bytes[i])) : QLatin1Char('.');
+        }
+        painter.drawText(x, row * lineHeight + ascent, text);
+    }
+}
+
+// Finds the start offset and highlighter state of a line, walking forward
+// from the last paint position or from the nearest checkpoint.
+void MappedFileView::seekLine(qint64 line) {
+    const qint64 checkpoint = qMin<qint64>(line / kLinesPerCheckpoint, checkpoints.size() - 1);
+
+    qint64 current;
+    qint64 offset;
+    int state;
+    if (cachedLine <= line && cachedLine >= checkpoint * kLinesPerCheckpoint) {
+        current = cachedLine;
+        offset = cachedOffset;
+        state = cachedState;
+    } else {
+        // Start where the highlighter state is known, but don't walk far
+        // back for it: past the lookback, the checkpoint's line is assumed
+        // to start outside any comment or string.
+        qint64 start = checkpoint;
+        if (language != SyntaxHighlighter::None) {
+            const qint64 limit = qMax<qint64>(0, checkpoint - kStateLookback);
+            while (start > limit && checkpointStates.at(int(start)) < 0) start--;
+        }
+        current = start * kLinesPerCheckpoint;
+        offset = checkpoints.at(int(start));
+        state = qMax(0, int(checkpointStates.at(int(start))));
+    }
+
+    QVector<SyntaxHighlighter::Span> spans;
+    while (current < line && offset < size) {
+        const qint64 end = lineEnd(offset, size);
+        if (language != SyntaxHighlighter::None) {
+            const QString text = lineText(offset, qMin(end, offset + kMaxLineBytes));
+            spans.clear();
+            state = SyntaxHighlighter::highlightLine(language, text.constData(), text.size(), state, spans);
+        }
+        offset = end + 1;
+        current++;
+
+        if (current % kLinesPerCheckpoint == 0) {
+            const int index = int(current / kLinesPerCheckpoint);
+            if (index < checkpointStates.size() && checkpointStates.at(index) < 0) {
+                checkpointStates[index] = qint8(state);
+            }
+        }
+    }
+
+    cachedLine = current;
+    cachedOffset = qMin(offset, size);
+    cachedState = state;
+}
+
+// Offset of the next newline at or after offset, or limit if there is none before it.
+qint64 MappedFileView::lineEnd(qint64 offset, qint64 limit) const {
+    const void* newline = memchr(data + offset, '\n', size_t(limit - offset));
+    return newline ? static_cast<const char*>(newline) - data : limit;
+}
+
+QString MappedFileView::lineText(qint64 offset, qint64 end) const {
+    QString text = QString::fromUtf8(data + offset, int(end - offset));
+    if (text.endsWith(QLatin1Char('\r'))) text.chop(1);
+    if (!text.contains(QLatin1Char('\t'))) return text;
+
+    QString expanded;
+    expanded.reserve(text.size() + kTabWidth * 4);
+    for (QChar c : qAsConst(text)) {
+        if (c == QLatin1Char('\t')) {
+            expanded += QString(kTabWidth - expanded.size() % kTabWidth, QLatin1Char(' '));
+        } else {
+            expanded += c;
+        }
+    }
+    return expanded;
+}
+
+void MappedFileView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void MappedFileView::scrollContentsBy(int dx, int dy) {
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    viewport()->update();
+}
+
+void MappedFileView::changeEvent(QEvent *event) {
+    if (event->type() == QEvent::FontChange) {
+        updateMetrics();
+        updateScrollBars();
+    }
+    QAbstractScrollArea::changeEvent(event);
+}
+
+void MappedFileView::updateMetrics() {
+    QFontMetrics metrics(font());
+    charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char('0')));
+    lineHeight = qMax(1, metrics.height());
+}
+
+void MappedFileView::updateScrollBars() {
+    const int rows = qMax(1, viewport()->height() / lineHeight);
+    qint64 totalRows;
+    int contentWidth;
+    if (viewMode == HexMode) {
+        totalRows = (size + kHexBytesPerRow - 1) / kHexBytesPerRow;
+        const int offsetDigits = size > 0xFFFFFFFFLL ? 12 : 8;
+        contentWidth = (offsetDigits + 2 + kHexBytesPerRow * 3 + 2 + kHexBytesPerRow + 2) * charWidth;
+    } else {
+        totalRows = lineCount;
+        const int digits = QString::number(lineCount).size();
+        contentWidth = (digits + 2 + widestLine + 1) * charWidth;
+    }
+
+    verticalScrollBar()->setRange(0, int(qBound<qint64>(0, totalRows - rows, INT_MAX)));
+    verticalScrollBar()->setPageStep(rows);
+    horizontalScrollBar()->setRange(0, qMax(0, contentWidth - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(charWidth * 4);
+}
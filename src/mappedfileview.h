@@ -0,0 +1,106 @@
+#ifndef MAPPEDFILEVIEW_H
+#define MAPPEDFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include "syntaxhighlighter.h"
+
+// Counts the lines in the first size bytes of a file on a background thread
+// with fixed-size reads, reporting the offset of every kLinesPerCheckpoint-th
+// line (see MappedFileView).
+class LineIndexer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LineIndexer(std::atomic<int>* generation, QObject *parent = nullptr);
+
+public slots:
+    void index(int generation, const QString& path, qint64 size);
+
+signals:
+    // New checkpoints since the last report, and the number of lines whose
+    // start is known so far (the total once finished).
+    void progress(int generation, const QVector<qint64>& checkpoints, qint64 lines, bool finished);
+
+private:
+    std::atomic<int>* generation;
+};
+
+// Read-only text/hex view of a file of any size. The file is mapped, not
+// read, and only the lines in the window are decoded and painted. Lines are
+// found through a sparse index (one offset per kLinesPerCheckpoint lines)
+// that fills in while the user is already reading the top of the file.
+class MappedFileView : public QAbstractScrollArea {
+    Q_OBJECT
+
+public:
+    enum Mode {
+        TextMode,
+        HexMode
+    };
+
+    static const int kLinesPerCheckpoint = 1024;
+
+    explicit MappedFileView(QWidget *parent = nullptr);
+    ~MappedFileView();
+
+    // Maps a regular file and picks text or hex mode from its first bytes.
+    bool openFile(const QString& path);
+    void closeFile();
+
+    Mode mode() const { return viewMode; }
+    void setMode(Mode mode);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void changeEvent(QEvent *event) override;
+
+private slots:
+    void handleIndexProgress(int generation, const QVector<qint64>& checkpoints, qint64 lines, bool finished);
+
+private:
+    void startIndexing();
+    void clampToFile();
+    void paintText(QPainter& painter);
+    void paintHex(QPainter& painter);
+    void seekLine(qint64 line);
+    qint64 lineEnd(qint64 offset, qint64 limit) const;
+    QString lineText(qint64 offset, qint64 end) const;
+    void updateMetrics();
+    void updateScrollBars();
+
+    QThread indexerThread;
+    std::atomic<int> generation;
+    LineIndexer* indexer;
+
+    QString filePath;
+    // Kept open to notice the file shrinking under the mapping
+    int fd;
+    const char* data;
+    qint64 mappedSize;
+    qint64 size;
+    Mode viewMode;
+    SyntaxHighlighter::Language language;
+
+    // Offset of line i * kLinesPerCheckpoint, and the highlighter state that
+    // line starts in (-1 until some paint has walked past it).
+    QVector<qint64> checkpoints;
+    QVector<qint8> checkpointStates;
+    qint64 lineCount;
+    bool indexRequested;
+
+    // Where the last paint started, so scrolling walks on from there
+    qint64 cachedLine;
+    qint64 cachedOffset;
+    int cachedState;
+
+    int charWidth;
+    int lineHeight;
+    int widestLine;
+};
+
+#endif // MAPPEDFILEVIEW_H
@@ -0,0 +1,110 @@
+#include "navigationhistory.h"
+
+NavigationHistory::NavigationHistory(int capacity)
+    : ring(qMax(1, capacity), -1)
+    , first(0)
+    , count(0)
+    , cursor(-1)
+{
+}
+
+void NavigationHistory::visit(const QString& path) {
+    const int id = intern(path);
+    if (count > 0 && at(cursor) == id) return;
+
+    // Entries are unique, so there is at most one older visit to drop
+    count = cursor + 1;
+    for (int i = 0; i < count; i++) {
+        if (at(i) == id) {
+            erase(i);
+            break;
+        }
+    }
+    if (count == ring.size()) {
+        first = (first + 1) % ring.size();
+        count--;
+    }
+    ring[(first + count) % ring.size()] = id;
+    count++;
+    cursor = count - 1;
+    prune();
+}
+
+QString NavigationHistory::current() const {
+    return count > 0 ? pathsById.at(at(cursor)) : QString();
+}
+
+QString NavigationHistory::backPath() const {
+    return cursor > 0 ? pathsById.at(at(cursor - 1)) : QString();
+}
+
+QString NavigationHistory::forwardPath() const {
+    return cursor + 1 < count ? pathsById.at(at(cursor + 1)) : QString();
+}
+
+void NavigationHistory::goBack() {
+    if (cursor > 0) cursor--;
+}
+
+void NavigationHistory::goForward() {
+    if (cursor + 1 < count) cursor++;
+}
+
+void NavigationHistory::remove(const QString& path) {
+    const int id = idsByPath.value(path, -1);
+    if (id < 0) return;
+    for (int i = 0; i < count; i++) {
+        if (at(i) != id) continue;
+        erase(i);
+        if (cursor > i || cursor >= count) cursor--;
+        return;
+    }
+}
+
+QStringList NavigationHistory::paths() const {
+    QStringList result;
+    result.reserve(count);
+    for (int i = 0; i < count; i++) result.append(pathsById.at(at(i)));
+    return result;
+}
+
+void NavigationHistory::restore(const QStringList& paths, int position) {
+    first = 0;
+    count = 0;
+    cursor = -1;
+    pathsById.clear();
+    idsByPath.clear();
+    for (const QString& path : paths) visit(path);
+    if (count > 0) cursor = qBound(0, position, count - 1);
+}
+
+int NavigationHistory::intern(const QString& path) {
+    auto it = idsByPath.constFind(path);
+    if (it != idsByPath.constEnd()) return it.value();
+    const int id = pathsById.size();
+    pathsById.append(path);
+    idsByPath.insert(path, id);
+    return id;
+}
+
+// Closes the gap left by entry index; the cursor is the caller's to fix.
+void NavigationHistory::erase(int index) {
+    for (int i = index; i < count - 1; i++) ring[(first + i) % ring.size()] = at(i + 1);
+    count--;
+}
+
+// Paths that dropped out of the ring are only forgotten in bulk, once they
+// outnumber the live ones, so ids stay stable between prunes.
+void NavigationHistory::prune() {
+    if (pathsById.size() <= 2 * ring.size()) return;
+
+    QVector<QString> livePaths;
+    idsByPath.clear();
+    for (int i = 0; i < count; i++) {
+        const int slot = (first + i) % ring.size();
+        livePaths.append(pathsById.at(ring.at(slot)));
+        idsByPath.insert(livePaths.last(), i);
+        ring[slot] = i;
+    }
+    pathsById = livePaths;
+}
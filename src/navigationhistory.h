@@ -0,0 +1,52 @@
+#ifndef NAVIGATIONHISTORY_H
+#define NAVIGATIONHISTORY_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Back/forward history as a fixed ring of interned path ids with a cursor
+// on the folder on screen. Visiting a folder drops everything ahead of the
+// cursor and any older visit to the same folder, so going back and forth
+// between two folders never piles up entries; once the ring is full the
+// oldest visit is overwritten. Paths are stored once however often they
+// recur, and the table is pruned whenever it outgrows the ring.
+class NavigationHistory {
+public:
+    explicit NavigationHistory(int capacity = 64);
+
+    // Records path as the current folder; a no-op if it already is.
+    void visit(const QString& path);
+    QString current() const;
+    // Where Back and Forward lead, or an empty string
+    QString backPath() const;
+    QString forwardPath() const;
+    void goBack();
+    void goForward();
+    // Forgets a folder that can't be opened anymore, wherever it is.
+    void remove(const QString& path);
+
+    // Oldest first, with position() the index of the current folder; for
+    // saving the session and restoring it.
+    QStringList paths() const;
+    int position() const { return cursor; }
+    void restore(const QStringList& paths, int position);
+
+private:
+    int at(int index) const { return ring.at((first + index) % ring.size()); }
+    int intern(const QString& path);
+    void erase(int index);
+    void prune();
+
+    // count ids from ring[first] on, wrapping; cursor indexes into them
+    QVector<int> ring;
+    int first;
+    int count;
+    int cursor;
+
+    QVector<QString> pathsById;
+    QHash<QString, int> idsByPath;
+};
+
+#endif // NAVIGATIONHISTORY_H
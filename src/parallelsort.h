@@ -0,0 +1,69 @@
+#ifndef PARALLELSORT_H
+#define PARALLELSORT_H
+
+#include <QThread>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Sorts [first, last) by splitting it into one run per core, sorting the
+// runs concurrently and then merging neighbouring runs pairwise, also in
+// parallel. Small ranges are handed straight to std::sort.
+template <typename RandomIt, typename Compare>
+void parallelSort(RandomIt first, RandomIt last, Compare comp, int threads = QThread::idealThreadCount()) {
+    const std::ptrdiff_t count = last - first;
+    const std::ptrdiff_t kMinRunLength = 16384;
+    threads = int(std::min<std::ptrdiff_t>(threads, count / kMinRunLength));
+    if (threads < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<RandomIt> bounds;
+    for (int i = 0; i <= threads; i++) {
+        bounds.push_back(first + count * i / threads);
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&bounds, comp, i]() { std::sort(bounds[i], bounds[i + 1], comp); });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    while (bounds.size() > 2) {
+        std::vector<RandomIt> merged;
+        workers.clear();
+        size_t i = 0;
+        for (; i + 2 < bounds.size(); i += 2) {
+            RandomIt begin = bounds[i], middle = bounds[i + 1], end = bounds[i + 2];
+            workers.emplace_back([begin, middle, end, comp]() { std::inplace_merge(begin, middle, end, comp); });
+            merged.push_back(begin);
+        }
+        if (i + 1 < bounds.size()) merged.push_back(bounds[i]);
+        merged.push_back(bounds.back());
+        for (std::thread& worker : workers) worker.join();
+        bounds.swap(merged);
+    }
+}
+
+// Calls fn(begin, end) for consecutive slices of [0, count), one slice per
+// core; fn must only write to its own slice. Counts below two slices of
+// minSlice run on the calling thread.
+template <typename Function>
+void parallelFor(int count, Function fn, int minSlice = 4096, int threads = QThread::idealThreadCount()) {
+    threads = std::min(threads, count / std::max(minSlice, 1));
+    if (threads < 2) {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        const int begin = int(qint64(count) * i / threads);
+        const int end = int(qint64(count) * (i + 1) / threads);
+        workers.emplace_back([&fn, begin, end]() { fn(begin, end); });
+    }
+    for (std::thread& worker : workers) worker.join();
+}
+
+#endif // PARALLELSORT_H
@@ -0,0 +1,150 @@
+#include "perftrace.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+// Spans kept per thread
+const quint64 kRingSize = 16384;
+
+struct Span {
+    const char* name;
+    qint64 start;
+    qint64 duration;
+};
+
+// Written only by its thread. `written` counts every span ever recorded;
+// span n lives in slot n % kRingSize, published by the release store.
+struct Ring {
+    std::atomic<quint64> written{0};
+    bool inUse = false;
+    qint64 thread = 0;
+    QString threadName;
+    Span spans[kRingSize];
+};
+
+// Rings outlive their threads: a finished thread's spans stay readable
+// until a new thread takes the ring over.
+QMutex registryMutex;
+std::vector<Ring*> rings;
+
+struct RingOwner {
+    Ring* ring = nullptr;
+
+    ~RingOwner() {
+        QMutexLocker locker(&registryMutex);
+        if (ring) ring->inUse = false;
+    }
+};
+
+thread_local RingOwner owner;
+
+// The registry is only locked the first time a thread records.
+Ring* threadRing() {
+    if (owner.ring) return owner.ring;
+
+    QMutexLocker locker(&registryMutex);
+    Ring* ring = nullptr;
+    for (Ring* candidate : rings) {
+        if (!candidate->inUse) {
+            ring = candidate;
+            break;
+        }
+    }
+    if (!ring) {
+        ring = new Ring;
+        rings.push_back(ring);
+    }
+    ring->written.store(0, std::memory_order_relaxed);
+    ring->inUse = true;
+    ring->thread = qint64(::syscall(SYS_gettid));
+    ring->threadName = QThread::currentThread()->objectName();
+    owner.ring = ring;
+    return ring;
+}
+
+// Copies a ring's spans, oldest first. The owner may keep writing while
+// this runs; slots it may have overwritten meanwhile are left out.
+QVector<Span> snapshot(const Ring* ring) {
+    const quint64 end = ring->written.load(std::memory_order_acquire);
+    const quint64 begin = end > kRingSize ? end - kRingSize : 0;
+    QVector<Span> spans;
+    spans.reserve(int(end - begin));
+    for (quint64 n = begin; n < end; n++) spans.append(ring->spans[n % kRingSize]);
+
+    const quint64 after = ring->written.load(std::memory_order_acquire);
+    const quint64 overwritten = after > kRingSize ? after - kRingSize : 0;
+    if (overwritten > begin) spans.remove(0, int(qMin(overwritten - begin, quint64(spans.size()))));
+    return spans;
+}
+
+} // namespace
+
+qint64 PerfTrace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PerfTrace::record(const char* name, qint64 start, qint64 duration) {
+    Ring* ring = threadRing();
+    const quint64 n = ring->written.load(std::memory_order_relaxed);
+    ring->spans[n % kRingSize] = Span{name, start, duration};
+    ring->written.store(n + 1, std::memory_order_release);
+}
+
+// Complete ("X") events in microseconds, plus one metadata event naming
+// each thread.
+bool PerfTrace::dump(const QString& path, QString* error) {
+    const qint64 pid = ::getpid();
+    QJsonArray events;
+    {
+        QMutexLocker locker(&registryMutex);
+        for (const Ring* ring : rings) {
+            const QVector<Span> spans = snapshot(ring);
+            if (spans.isEmpty()) continue;
+
+            QJsonObject threadName;
+            threadName["name"] = "thread_name";
+            threadName["ph"] = "M";
+            threadName["pid"] = pid;
+            threadName["tid"] = ring->thread;
+            threadName["args"] = QJsonObject{{"name", ring->threadName.isEmpty()
+                                                      ? QString("Thread %1").arg(ring->thread)
+                                                      : ring->threadName}};
+            events.append(threadName);
+
+            for (const Span& span : spans) {
+                QJsonObject event;
+                event["name"] = span.name;
+                event["ph"] = "X";
+                event["ts"] = span.start / 1000.0;
+                event["dur"] = span.duration / 1000.0;
+                event["pid"] = pid;
+                event["tid"] = ring->thread;
+                events.append(event);
+            }
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+
+    QFile file(path);
+    const QByteArray json = QJsonDocument(trace).toJson(QJsonDocument::Compact);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef PERFTRACE_H
+#define PERFTRACE_H
+
+#include <QString>
+
+// Always-on tracing of the hot paths. Every thread writes finished spans
+// into a ring buffer of its own, without locks or allocation; when a ring
+// is full its oldest spans are overwritten. dump() writes every ring as
+// Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev.
+// Span names are kept by pointer, so they must be string literals.
+class PerfTrace {
+public:
+    // Nanoseconds on a monotonic clock: the time base of every span.
+    static qint64 now();
+    // Records a span that began and ended in different calls.
+    static void record(const char* name, qint64 start, qint64 duration);
+    static bool dump(const QString& path, QString* error = nullptr);
+};
+
+// Records the enclosing scope as a span. Scopes shorter than
+// minDurationNs are dropped, so per-cell code only logs its outliers.
+class PerfScope {
+public:
+    explicit PerfScope(const char* name, qint64 minDurationNs = 0)
+        : name(name)
+        , minDuration(minDurationNs)
+        , start(PerfTrace::now())
+    {
+    }
+
+    ~PerfScope() {
+        const qint64 duration = PerfTrace::now() - start;
+        if (duration >= minDuration) PerfTrace::record(name, start, duration);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    const char* name;
+    qint64 minDuration;
+    qint64 start;
+};
+
+#endif // PERFTRACE_H
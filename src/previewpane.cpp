@@ -0,0 +1,151 @@
+#include "previewpane.h"
+#include "iconcache.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QLocale>
+#include <QImageReader>
+#include <QPixmap>
+
+namespace {
+
+const int kIconSize = 128;
+
+} // namespace
+
+PreviewPane::PreviewPane(QWidget *parent)
+    : QWidget(parent)
+    , imageGeneration(0)
+{
+    // One decode at a time; a newer selection makes older ones moot
+    imagePool.setMaxThreadCount(1);
+    setupUI();
+}
+
+PreviewPane::~PreviewPane() {
+    imagePool.clear();
+    imagePool.waitForDone();
+}
+
+void PreviewPane::setupUI() {
+    setObjectName("previewPane");
+    setMinimumWidth(240);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+
+    QWidget* header = new QWidget(this);
+    QHBoxLayout* headerLayout = new QHBoxLayout(header);
+    headerLayout->setContentsMargins(12, 8, 8, 8);
+
+    QVBoxLayout* textLayout = new QVBoxLayout();
+    textLayout->setSpacing(2);
+    titleLabel = new QLabel(this);
+    titleLabel->setObjectName("previewTitle");
+    titleLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    detailsLabel = new QLabel(this);
+    detailsLabel->setObjectName("previewDetails");
+    textLayout->addWidget(titleLabel);
+    textLayout->addWidget(detailsLabel);
+    headerLayout->addLayout(textLayout, 1);
+
+    hexButton = new QToolButton(this);
+    hexButton->setText("Hex");
+    hexButton->setCheckable(true);
+    hexButton->setAutoRaise(true);
+    hexButton->hide();
+    headerLayout->addWidget(hexButton, 0, Qt::AlignTop);
+    layout->addWidget(header);
+
+    contentStack = new QStackedWidget(this);
+    imageLabel = new QLabel(this);
+    imageLabel->setObjectName("previewImage");
+    imageLabel->setAlignment(Qt::AlignCenter);
+    fileView = new MappedFileView(this);
+    fileView->setObjectName("previewText");
+    fileView->setFrameShape(QFrame::NoFrame);
+    contentStack->addWidget(imageLabel);
+    contentStack->addWidget(fileView);
+    layout->addWidget(contentStack, 1);
+
+    connect(hexButton, &QToolButton::toggled, [this](bool checked) {
+        fileView->setMode(checked ? MappedFileView::HexMode : MappedFileView::TextMode);
+    });
+}
+
+void PreviewPane::showFile(const QString& path) {
+    if (path == currentPath) return;
+    if (path.isEmpty()) {
+        clear();
+        return;
+    }
+
+    currentPath = path;
+    imageGeneration++;
+    fileView->closeFile();
+    imageLabel->clear();
+    hexButton->hide();
+
+    QFileInfo info(path);
+    titleLabel->setText(info.fileName().isEmpty() ? path : info.fileName());
+    const IconCache& icons = IconCache::instance();
+    IconCache::Category category = icons.category(info);
+    QString modified = QLocale::system().toString(info.lastModified(), QLocale::ShortFormat);
+    if (info.isDir()) {
+        detailsLabel->setText(QString("Folder, modified %1").arg(modified));
+    } else {
+        detailsLabel->setText(QString("%1, modified %2").arg(QLocale::system().formattedDataSize(info.size()), modified));
+    }
+
+    // Type icon first; images replace it once decoded
+    imageLabel->setPixmap(icons.icon(category).pixmap(kIconSize, kIconSize));
+    contentStack->setCurrentWidget(imageLabel);
+    if (info.isDir()) return;
+
+    if (category == IconCache::Image) {
+        int gen = imageGeneration;
+        QSize target = contentStack->size();
+        imagePool.clear();
+        imagePool.start([this, gen, path, target]() {
+            // Scale while decoding, so a huge photo never exists at full size
+            QImageReader reader(path);
+            reader.setAutoTransform(true);
+            QSize size = reader.size();
+            if (size.isValid() && target.isValid() && (size.width() > target.width() || size.height() > target.height())) {
+                reader.setScaledSize(size.scaled(target, Qt::KeepAspectRatio));
+            }
+            QImage image = reader.read();
+            QMetaObject::invokeMethod(this, [this, gen, image]() {
+                handleImageLoaded(gen, image);
+            }, Qt::QueuedConnection);
+        });
+        return;
+    }
+
+    if (fileView->openFile(path)) {
+        hexButton->blockSignals(true);
+        hexButton->setChecked(fileView->mode() == MappedFileView::HexMode);
+        hexButton->blockSignals(false);
+        hexButton->show();
+        contentStack->setCurrentWidget(fileView);
+    }
+}
+
+void PreviewPane::clear() {
+    currentPath.clear();
+    imageGeneration++;
+    imagePool.clear();
+    fileView->closeFile();
+    titleLabel->clear();
+    detailsLabel->clear();
+    imageLabel->clear();
+    hexButton->hide();
+    contentStack->setCurrentWidget(imageLabel);
+}
+
+void PreviewPane::handleImageLoaded(int gen, const QImage& image) {
+    if (gen != imageGeneration || image.isNull()) return;
+    imageLabel->setPixmap(QPixmap::fromImage(image));
+}
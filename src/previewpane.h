@@ -0,0 +1,44 @@
+#ifndef PREVIEWPANE_H
+#define PREVIEWPANE_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QStackedWidget>
+#include <QThreadPool>
+#include <QToolButton>
+#include <QImage>
+#include "mappedfileview.h"
+
+// The pane shown by Toggle Preview: the selected item's name and details,
+// then a picture for images or the file's contents (text or hex) otherwise.
+// Images are decoded off the GUI thread at the size they are shown.
+class PreviewPane : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit PreviewPane(QWidget *parent = nullptr);
+    ~PreviewPane();
+
+    // Shows path (a file or folder); an empty path clears the pane.
+    void showFile(const QString& path);
+    void clear();
+
+private slots:
+    void handleImageLoaded(int generation, const QImage& image);
+
+private:
+    void setupUI();
+
+    QLabel* titleLabel;
+    QLabel* detailsLabel;
+    QToolButton* hexButton;
+    QStackedWidget* contentStack;
+    QLabel* imageLabel;
+    MappedFileView* fileView;
+
+    QString currentPath;
+    int imageGeneration;
+    QThreadPool imagePool;
+};
+
+#endif // PREVIEWPANE_H
@@ -0,0 +1,958 @@
+#include "searchindex.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <string.h>
+
+namespace {
+
+const int kWorkSliceMs = 20;
+const int kTrigramBatch = 4096;
+const int kResultBatch = 256;
+const int kMaxResults = 100000;
+const int kCancelCheckInterval = 1024;
+const int kSaveDelayMs = 10000;
+const quint32 kNoNode = 0xffffffff;
+
+const quint32 kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+    | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+// On-disk layout: header, root path (UTF-16), padding to 8 bytes, the
+// node array, then the name arena (UTF-16).
+const char kFileMagic[8] = {'L', 'D', 'I', 'R', 'I', 'D', 'X', '1'};
+const quint32 kFileVersion = 2;
+
+struct IndexFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 nodeSize;
+    quint32 nodeCount;
+    quint32 rootLength;
+    quint64 namesLength;
+    // When the snapshot was written, in seconds since the epoch
+    qint64 savedAt;
+};
+
+qint64 nodesOffset(quint32 rootLength) {
+    qint64 offset = qint64(sizeof(IndexFileHeader)) + qint64(rootLength) * 2;
+    return (offset + 7) & ~qint64(7);
+}
+
+QString cacheFile(const QString& root) {
+    QByteArray key = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        + "/Lotus-DIR/index-" + QString::fromLatin1(key) + ".bin";
+}
+
+inline quint64 trigramKey(QChar a, QChar b, QChar c) {
+    return (quint64(a.unicode()) << 32) | (quint64(b.unicode()) << 16) | quint64(c.unicode());
+}
+
+inline bool isDotOrDotDot(const char* name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+} // namespace
+
+// SearchIndexWorker
+
+SearchIndexWorker::SearchIndexWorker(std::atomic<int>* generation, QObject *parent)
+    : QObject(parent)
+    , generation(generation)
+    , trigramCount(0)
+    , indexMap(nullptr)
+    , indexMapSize(0)
+    , savedAt(0)
+    , workScheduled(false)
+    , dirty(false)
+    , saveTimer(new QTimer(this))
+    , watcher(nullptr)
+    , queryKind(NoQuery)
+    , queryGeneration(0)
+    , queryLimit(0)
+    , queryRanPartial(false)
+    , lastScope(kNoNode)
+{
+    static_assert(sizeof(Node) == 24, "Node is stored on disk and must stay 24 bytes");
+
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(kSaveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &SearchIndexWorker::save);
+}
+
+SearchIndexWorker::~SearchIndexWorker() {
+    save();
+    names.clear();
+    if (indexMap) munmap(const_cast<uchar*>(indexMap), size_t(indexMapSize));
+}
+
+void SearchIndexWorker::preload(const QString& path) {
+    ensureRoot(QDir::cleanPath(path));
+}
+
+void SearchIndexWorker::refresh(const QString& dir) {
+    quint32 node = nodeForPath(QDir::cleanPath(dir));
+    if (node == kNoNode || int(node) >= staleFiles.size() || !staleFiles.testBit(int(node))) return;
+    staleFiles.clearBit(int(node));
+    refreshQueue.append(node);
+    scheduleWork();
+}
+
+void SearchIndexWorker::search(int gen, const QString& scope, const QString& text) {
+    queryKind = NameQuery;
+    queryGeneration = gen;
+    queryScope = QDir::cleanPath(scope);
+    queryText = text;
+    if (superseded()) return;
+
+    ensureRoot(queryScope);
+    reviveScope(queryScope);
+    refreshScope(nodeForPath(queryScope));
+    runQuery();
+}
+
+void SearchIndexWorker::recent(int gen, const QString& scope, int limit) {
+    queryKind = RecentQuery;
+    queryGeneration = gen;
+    queryScope = QDir::cleanPath(scope);
+    queryLimit = limit;
+    if (superseded()) return;
+
+    ensureRoot(queryScope);
+    reviveScope(queryScope);
+    refreshScope(nodeForPath(queryScope));
+    runQuery();
+}
+
+void SearchIndexWorker::invalidate() {
+    delete watcher;
+    watcher = nullptr;
+    watchedDirs.clear();
+    dirWatches.clear();
+    evictedDirs.clear();
+
+    root.clear();
+    nodes.clear();
+    nodes.squeeze();
+    names.clear();
+    names.squeeze();
+    // Only now that no string can still point into it
+    if (indexMap) munmap(const_cast<uchar*>(indexMap), size_t(indexMapSize));
+    indexMap = nullptr;
+    indexMapSize = 0;
+    savedAt = 0;
+    firstChild.clear();
+    firstChild.squeeze();
+    nextSibling.clear();
+    nextSibling.squeeze();
+    trigrams.clear();
+    trigramCount = 0;
+    pendingDirs.clear();
+    verifyQueue.clear();
+    refreshQueue.clear();
+    staleFiles.clear();
+    refreshedScopes.clear();
+    dirty = false;
+    saveTimer->stop();
+
+    lastText.clear();
+    lastScope = kNoNode;
+    lastResults.clear();
+}
+
+void SearchIndexWorker::ensureRoot(const QString& scope) {
+    QString prefix = root.endsWith('/') ? root : root + "/";
+    if (!root.isEmpty() && (scope == root || scope.startsWith(prefix))) return;
+
+    // Persist the index being replaced so coming back to it is instant.
+    save();
+    if (!load(scope)) {
+        startBuild(scope);
+    }
+    scheduleWork();
+}
+
+void SearchIndexWorker::startBuild(const QString& path) {
+    invalidate();
+    root = path;
+
+    // Node 0 is the root itself and has an empty name.
+    struct stat st;
+    quint32 mtime = ::lstat(QFile::encodeName(root).constData(), &st) == 0 ? quint32(st.st_mtime) : 0;
+    nodes.append({kNoNode, 0, 0, 1, 0, mtime, 0});
+    firstChild.append(kNoNode);
+    nextSibling.append(kNoNode);
+    trigramCount = 1;
+    pendingDirs.append(0);
+    dirty = true;
+}
+
+// Maps the persisted snapshot for root and queues every directory for a
+// lazy check against the disk. The nodes are copied, since rebuilding the
+// child lists reads all of them anyway; the name arena is used in place,
+// and only copied (by QString) once a name is added.
+bool SearchIndexWorker::load(const QString& path) {
+    const QString fileName = cacheFile(path);
+    int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= qint64(sizeof(IndexFileHeader))) {
+        mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid without the descriptor, and saving replaces
+    // the file rather than writing into it
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    const uchar* data = static_cast<const uchar*>(mapped);
+    const qint64 fileSize = st.st_size;
+
+    IndexFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    qint64 nodesAt = nodesOffset(header.rootLength);
+    qint64 namesAt = nodesAt + qint64(header.nodeCount) * qint64(sizeof(Node));
+
+    bool valid = memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) == 0
+        && header.version == kFileVersion
+        && header.nodeSize == sizeof(Node)
+        && header.nodeCount > 0
+        && header.namesLength < quint64(INT_MAX)
+        && namesAt + qint64(header.namesLength) * 2 <= fileSize
+        && QString(reinterpret_cast<const QChar*>(data + sizeof(header)), int(header.rootLength)) == path;
+    if (!valid) {
+        munmap(mapped, size_t(fileSize));
+        return false;
+    }
+
+    invalidate();
+    root = path;
+    savedAt = header.savedAt;
+    indexMap = data;
+    indexMapSize = fileSize;
+    nodes.resize(int(header.nodeCount));
+    memcpy(nodes.data(), data + nodesAt, size_t(header.nodeCount) * sizeof(Node));
+    names = QString::fromRawData(reinterpret_cast<const QChar*>(data + namesAt), int(header.namesLength));
+
+    // Rebuild the child lists; parents always precede their children.
+    firstChild.fill(kNoNode, nodes.size());
+    nextSibling.fill(kNoNode, nodes.size());
+    for (int id = nodes.size() - 1; id > 0; id--) {
+        const Node& n = nodes[id];
+        if (n.parent >= quint32(id) || quint64(n.nameOffset) + n.nameLength > quint64(names.size())) {
+            qWarning() << "Discarding corrupt search index" << fileName;
+            invalidate();
+            return false;
+        }
+        nextSibling[id] = firstChild[n.parent];
+        firstChild[n.parent] = quint32(id);
+    }
+
+    staleFiles.resize(nodes.size());
+    for (int id = nodes.size() - 1; id >= 0; id--) {
+        if (!nodes[id].isDir) continue;
+        verifyQueue.append(quint32(id));
+        staleFiles.setBit(id);
+    }
+    trigramCount = 0;
+    return true;
+}
+
+void SearchIndexWorker::save() {
+    saveTimer->stop();
+    // A half-walked tree would look complete on the next load, so wait.
+    if (!dirty || root.isEmpty() || !pendingDirs.isEmpty()) return;
+
+    // Compact: removed nodes and their names are dropped, ids renumbered.
+    QVector<quint32> remap(nodes.size(), kNoNode);
+    QVector<Node> live;
+    QString liveNames;
+    live.reserve(nodes.size());
+    for (int id = 0; id < nodes.size(); id++) {
+        if (nodes[id].removed) continue;
+        Node n = nodes[id];
+        n.parent = id == 0 ? kNoNode : remap[n.parent];
+        n.nameOffset = quint32(liveNames.size());
+        liveNames += QStringRef(&names, int(nodes[id].nameOffset), int(nodes[id].nameLength));
+        remap[id] = quint32(live.size());
+        live.append(n);
+    }
+
+    IndexFileHeader header;
+    memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.nodeSize = sizeof(Node);
+    header.nodeCount = quint32(live.size());
+    header.rootLength = quint32(root.size());
+    header.namesLength = quint64(liveNames.size());
+    header.savedAt = qint64(::time(nullptr));
+
+    QString fileName = cacheFile(root);
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write search index" << fileName << file.errorString();
+        return;
+    }
+
+    qint64 headerBytes = qint64(sizeof(header)) + qint64(root.size()) * 2;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(root.constData()), qint64(root.size()) * 2);
+    file.write(QByteArray(int(nodesOffset(header.rootLength) - headerBytes), '\0'));
+    file.write(reinterpret_cast<const char*>(live.constData()), qint64(live.size()) * qint64(sizeof(Node)));
+    file.write(reinterpret_cast<const char*>(liveNames.constData()), qint64(liveNames.size()) * 2);
+    if (file.commit()) {
+        dirty = false;
+    }
+}
+
+void SearchIndexWorker::scheduleWork() {
+    if (workScheduled || !isBusy()) return;
+    workScheduled = true;
+    QMetaObject::invokeMethod(this, "continueWork", Qt::QueuedConnection);
+}
+
+void SearchIndexWorker::scheduleSave() {
+    if (dirty && !saveTimer->isActive()) saveTimer->start();
+}
+
+bool SearchIndexWorker::isBusy() const {
+    return !pendingDirs.isEmpty() || trigramCount < nodes.size() || !verifyQueue.isEmpty() || !refreshQueue.isEmpty();
+}
+
+bool SearchIndexWorker::isPartial() const {
+    return !pendingDirs.isEmpty() || !verifyQueue.isEmpty() || !refreshQueue.isEmpty();
+}
+
+void SearchIndexWorker::continueWork() {
+    workScheduled = false;
+
+    QElapsedTimer slice;
+    slice.start();
+    while (slice.elapsed() < kWorkSliceMs) {
+        if (!pendingDirs.isEmpty()) {
+            scanDir(pendingDirs.takeLast());
+        } else if (trigramCount < nodes.size()) {
+            int end = qMin(trigramCount + kTrigramBatch, nodes.size());
+            for (; trigramCount < end; trigramCount++) {
+                indexTrigrams(quint32(trigramCount));
+            }
+        } else if (!verifyQueue.isEmpty()) {
+            verifyDir(verifyQueue.takeLast());
+        } else if (!refreshQueue.isEmpty()) {
+            quint32 dir = refreshQueue.takeLast();
+            if (!nodes[dir].removed) refreshFiles(dir, QFile::encodeName(pathOf(dir)));
+        } else {
+            break;
+        }
+    }
+
+    bool done = !isBusy();
+    emit indexProgress(nodes.size() - 1, done);
+
+    if (!done) {
+        // Yield to the event loop so queued queries run against the partial index.
+        scheduleWork();
+        return;
+    }
+
+    pendingDirs.squeeze();
+    verifyQueue.squeeze();
+    refreshQueue.squeeze();
+    if (queryRanPartial && queryKind != NoQuery && !superseded()) {
+        runQuery();
+    }
+    scheduleSave();
+}
+
+void SearchIndexWorker::scanDir(quint32 dir) {
+    if (nodes[dir].removed) return;
+
+    const QByteArray path = QFile::encodeName(pathOf(dir));
+    DIR* d = ::opendir(path.constData());
+    if (!d) return;
+
+    int fd = ::dirfd(d);
+    while (struct dirent* entry = ::readdir(d)) {
+        if (isDotOrDotDot(entry->d_name)) continue;
+
+        struct stat st;
+        if (::fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+
+        bool isDir = S_ISDIR(st.st_mode);
+        quint32 node = addNode(dir, QFile::decodeName(entry->d_name), isDir,
+                               isDir ? 0 : qint64(st.st_size), quint32(st.st_mtime));
+        if (isDir) pendingDirs.append(node);
+    }
+    ::closedir(d);
+
+    watchDir(dir);
+}
+
+// Called for directories loaded from disk: if the mtime moved on since the
+// snapshot was taken, or falls in the second it was written (mtimes are
+// kept in whole seconds), diff the listing against the stored children.
+// Otherwise the entries are the same; files edited in place since are
+// caught by refreshScope() and refresh() when a query or the view gets
+// there, and by the watches from now on.
+void SearchIndexWorker::verifyDir(quint32 dir) {
+    if (nodes[dir].removed) return;
+
+    const QByteArray path = QFile::encodeName(pathOf(dir));
+    struct stat st;
+    if (::lstat(path.constData(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+        if (dir != 0) {
+            removeSubtree(dir);
+            contentChanged();
+        }
+        return;
+    }
+
+    watchDir(dir);
+    if (quint32(st.st_mtime) == nodes[dir].mtime && qint64(st.st_mtime) < savedAt) return;
+    nodes[dir].mtime = quint32(st.st_mtime);
+    // The diff below stats every child anyway
+    if (int(dir) < staleFiles.size()) staleFiles.clearBit(int(dir));
+
+    DIR* d = ::opendir(path.constData());
+    if (!d) return;
+
+    QHash<QString, quint32> existing;
+    for (quint32 child = firstChild[dir]; child != kNoNode; child = nextSibling[child]) {
+        existing.insert(nameOf(child), child);
+    }
+
+    int fd = ::dirfd(d);
+    while (struct dirent* entry = ::readdir(d)) {
+        if (isDotOrDotDot(entry->d_name)) continue;
+
+        struct stat childStat;
+        if (::fstatat(fd, entry->d_name, &childStat, AT_SYMLINK_NOFOLLOW) < 0) continue;
+
+        QString name = QFile::decodeName(entry->d_name);
+        bool isDir = S_ISDIR(childStat.st_mode);
+        qint64 size = isDir ? 0 : qint64(childStat.st_size);
+
+        auto it = existing.find(name);
+        if (it != existing.end()) {
+            quint32 child = it.value();
+            existing.erase(it);
+            if (bool(nodes[child].isDir) == isDir) {
+                nodes[child].size = size;
+                if (!isDir) nodes[child].mtime = quint32(childStat.st_mtime);
+                continue;
+            }
+            removeSubtree(child);
+        }
+
+        quint32 node = addNode(dir, name, isDir, size, quint32(childStat.st_mtime));
+        if (isDir) pendingDirs.append(node);
+    }
+    ::closedir(d);
+
+    for (quint32 gone : qAsConst(existing)) {
+        removeSubtree(gone);
+    }
+    contentChanged();
+}
+
+void SearchIndexWorker::refreshFiles(quint32 dir, const QByteArray& path) {
+    int fd = ::open(path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    bool changed = false;
+    for (quint32 child = firstChild[dir]; child != kNoNode; child = nextSibling[child]) {
+        Node& n = nodes[child];
+        struct stat st;
+        if (n.isDir || ::fstatat(fd, QFile::encodeName(nameOf(child)).constData(), &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+        if (n.size == qint64(st.st_size) && n.mtime == quint32(st.st_mtime)) continue;
+        n.size = qint64(st.st_size);
+        n.mtime = quint32(st.st_mtime);
+        changed = true;
+    }
+    ::close(fd);
+    if (changed) contentChanged();
+}
+
+quint32 SearchIndexWorker::addNode(quint32 parent, const QString& name, bool isDir, qint64 size, quint32 mtime) {
+    quint32 id = quint32(nodes.size());
+    nodes.append({parent, quint32(names.size()), quint32(name.size()), isDir ? 1u : 0u, 0u, mtime, size});
+    names += name;
+
+    firstChild.append(kNoNode);
+    nextSibling.append(firstChild[parent]);
+    firstChild[parent] = id;
+
+    // While names loaded from disk are still being indexed, new nodes wait
+    // their turn so posting lists stay sorted.
+    if (trigramCount == int(id)) {
+        indexTrigrams(id);
+        trigramCount++;
+    }
+    dirty = true;
+    return id;
+}
+
+void SearchIndexWorker::indexTrigrams(quint32 node) {
+    const Node& n = nodes[node];
+    if (n.nameLength < 3) return;
+
+    const QString folded = nameOf(node).toCaseFolded();
+    for (int i = 0; i + 2 < folded.size(); i++) {
+        QVector<quint32>& postings = trigrams[trigramKey(folded[i], folded[i + 1], folded[i + 2])];
+        if (postings.isEmpty() || postings.last() != node) {
+            postings.append(node);
+        }
+    }
+}
+
+// Marks a node and everything below it removed. Ids are never reused, so
+// posting lists keep pointing at the tombstones until the next compaction.
+void SearchIndexWorker::removeSubtree(quint32 node) {
+    quint32 parent = nodes[node].parent;
+    if (parent != kNoNode) {
+        quint32* link = &firstChild[parent];
+        while (*link != kNoNode && *link != node) link = &nextSibling[*link];
+        if (*link == node) *link = nextSibling[node];
+    }
+
+    QVector<quint32> stack{node};
+    while (!stack.isEmpty()) {
+        quint32 id = stack.takeLast();
+        nodes[id].removed = 1;
+        auto watch = dirWatches.find(id);
+        if (watch != dirWatches.end()) {
+            watchedDirs.remove(watch.value());
+            if (watcher) watcher->unwatch(watch.value());
+            dirWatches.erase(watch);
+        }
+        evictedDirs.remove(id);
+        for (quint32 child = firstChild[id]; child != kNoNode; child = nextSibling[child]) {
+            stack.append(child);
+        }
+    }
+    dirty = true;
+}
+
+void SearchIndexWorker::watchDir(quint32 dir) {
+    if (dirWatches.contains(dir)) return;
+
+    // Leaves room under the cap for the folders on screen; past it, the
+    // least recently active directories give up their watch.
+    if (!watcher) {
+        watcher = new WatchManager(kWatchMask, qMax(0, WatchManager::maxWatches() - WatchManager::kViewWatches), this);
+        connect(watcher, &WatchManager::eventsReady, this, &SearchIndexWorker::handleEvents);
+        connect(watcher, &WatchManager::overflowed, this, &SearchIndexWorker::handleOverflow);
+        connect(watcher, &WatchManager::evicted, this, &SearchIndexWorker::handleEviction);
+    }
+
+    int wd = watcher->watch(pathOf(dir));
+    if (wd >= 0) {
+        watchedDirs.insert(wd, dir);
+        dirWatches.insert(dir, wd);
+        evictedDirs.remove(dir);
+    } else {
+        evictedDirs.insert(dir);
+    }
+}
+
+void SearchIndexWorker::handleEviction(int wd) {
+    quint32 dir = watchedDirs.value(wd, kNoNode);
+    if (dir == kNoNode) return;
+    watchedDirs.remove(wd);
+    dirWatches.remove(dir);
+    evictedDirs.insert(dir);
+}
+
+// Evicted directories under the query's scope missed their events: diff
+// them against the disk (and watch them again) before trusting results.
+void SearchIndexWorker::reviveScope(const QString& scope) {
+    quint32 scopeNode = nodeForPath(scope);
+    if (scopeNode == kNoNode) return;
+    if (watcher) watcher->touch(dirWatches.value(scopeNode, -1));
+    if (evictedDirs.isEmpty()) return;
+
+    for (auto it = evictedDirs.begin(); it != evictedDirs.end(); ) {
+        if (isUnder(*it, scopeNode)) {
+            nodes[*it].mtime = 0;
+            verifyQueue.append(*it);
+            it = evictedDirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    scheduleWork();
+}
+
+// Directories under the query's scope that still hold the snapshot's file
+// sizes and mtimes get them re-read, in slices like the rest of the work;
+// the query reports partial results until that is done.
+void SearchIndexWorker::refreshScope(quint32 scopeNode) {
+    if (scopeNode == kNoNode || staleFiles.isEmpty()) return;
+    for (quint32 id = scopeNode; id != kNoNode; id = id == 0 ? kNoNode : nodes[id].parent) {
+        if (refreshedScopes.contains(id)) return;
+    }
+    refreshedScopes.insert(scopeNode);
+
+    QVector<quint32> stack{scopeNode};
+    while (!stack.isEmpty()) {
+        quint32 dir = stack.takeLast();
+        if (int(dir) < staleFiles.size() && staleFiles.testBit(int(dir))) {
+            staleFiles.clearBit(int(dir));
+            refreshQueue.append(dir);
+        }
+        for (quint32 child = firstChild[dir]; child != kNoNode; child = nextSibling[child]) {
+            if (nodes[child].isDir && !nodes[child].removed) stack.append(child);
+        }
+    }
+    scheduleWork();
+}
+
+void SearchIndexWorker::handleEvents(const QVector<InotifyEvent>& events) {
+    bool changed = false;
+    for (const InotifyEvent& event : events) {
+        quint32 dir = watchedDirs.value(event.wd, kNoNode);
+        if (dir == kNoNode) continue;
+        watcher->touch(event.wd);
+
+        if (event.mask & IN_IGNORED) {
+            watchedDirs.remove(event.wd);
+            dirWatches.remove(dir);
+            continue;
+        }
+        if (event.name.isEmpty() || nodes[dir].removed) continue;
+
+        changed = true;
+        quint32 child = childNamed(dir, event.name);
+        if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            if (child != kNoNode) removeSubtree(child);
+            continue;
+        }
+
+        // Created, moved in or modified: take the entry's state from lstat.
+        QString base = pathOf(dir);
+        QString path = base.endsWith('/') ? base + event.name : base + "/" + event.name;
+        struct stat st;
+        if (::lstat(QFile::encodeName(path).constData(), &st) < 0) {
+            if (child != kNoNode) removeSubtree(child);
+            continue;
+        }
+
+        bool isDir = S_ISDIR(st.st_mode);
+        if (child != kNoNode && bool(nodes[child].isDir) != isDir) {
+            removeSubtree(child);
+            child = kNoNode;
+        }
+        if (child == kNoNode) {
+            child = addNode(dir, event.name, isDir, isDir ? 0 : qint64(st.st_size), quint32(st.st_mtime));
+            if (isDir) pendingDirs.append(child);
+        } else {
+            nodes[child].size = isDir ? 0 : qint64(st.st_size);
+            nodes[child].mtime = quint32(st.st_mtime);
+        }
+    }
+
+    if (changed) {
+        contentChanged();
+        scheduleWork();
+    }
+}
+
+void SearchIndexWorker::handleOverflow() {
+    // Events were lost: re-check every directory against the disk.
+    verifyQueue.clear();
+    for (int id = nodes.size() - 1; id >= 0; id--) {
+        if (nodes[id].isDir && !nodes[id].removed) {
+            nodes[id].mtime = 0;
+            verifyQueue.append(quint32(id));
+        }
+    }
+    scheduleWork();
+}
+
+void SearchIndexWorker::contentChanged() {
+    dirty = true;
+    lastText.clear();
+    lastResults.clear();
+    scheduleSave();
+}
+
+quint32 SearchIndexWorker::childNamed(quint32 parent, const QString& name) const {
+    for (quint32 child = firstChild[parent]; child != kNoNode; child = nextSibling[child]) {
+        const Node& n = nodes[child];
+        if (QStringRef(&names, int(n.nameOffset), int(n.nameLength)) == name) return child;
+    }
+    return kNoNode;
+}
+
+quint32 SearchIndexWorker::nodeForPath(const QString& path) const {
+    if (root.isEmpty()) return kNoNode;
+    if (path == root) return 0;
+
+    QString prefix = root.endsWith('/') ? root : root + "/";
+    if (!path.startsWith(prefix)) return kNoNode;
+
+    quint32 node = 0;
+    int start = prefix.size();
+    while (start < path.size() && node != kNoNode) {
+        int end = path.indexOf('/', start);
+        if (end < 0) end = path.size();
+        if (end > start) node = childNamed(node, path.mid(start, end - start));
+        start = end + 1;
+    }
+    return node;
+}
+
+QString SearchIndexWorker::nameOf(quint32 node) const {
+    const Node& n = nodes[node];
+    return names.mid(int(n.nameOffset), int(n.nameLength));
+}
+
+QString SearchIndexWorker::pathOf(quint32 node) const {
+    QVector<quint32> chain;
+    for (quint32 id = node; id != 0 && id != kNoNode; id = nodes[id].parent) {
+        chain.append(id);
+    }
+
+    QString path = root == "/" ? QString() : root;
+    for (int i = chain.size() - 1; i >= 0; i--) {
+        const Node& n = nodes[chain[i]];
+        path += '/';
+        path += QStringRef(&names, int(n.nameOffset), int(n.nameLength));
+    }
+    return path.isEmpty() ? root : path;
+}
+
+void SearchIndexWorker::runQuery() {
+    queryRanPartial = isPartial();
+    if (queryKind == NameQuery) {
+        runNameQuery();
+    } else if (queryKind == RecentQuery) {
+        runRecentQuery();
+    }
+}
+
+void SearchIndexWorker::runNameQuery() {
+    const int gen = queryGeneration;
+    const bool partial = queryRanPartial;
+
+    quint32 scope = nodeForPath(queryScope);
+    if (scope == kNoNode || queryText.isEmpty()) {
+        emit searchFinished(gen, 0, partial);
+        return;
+    }
+
+    const QString folded = queryText.toCaseFolded();
+
+    // Typing one more character only narrows the previous result set.
+    bool refine = !partial && scope == lastScope && !lastText.isEmpty()
+        && folded.contains(lastText) && lastResults.size() < kMaxResults;
+
+    bool scanAll = !refine && folded.size() < 3;
+    const QVector<quint32> pool = refine ? lastResults : (scanAll ? QVector<quint32>() : candidates(folded));
+    int count = scanAll ? nodes.size() : pool.size();
+
+    QVector<quint32> results;
+    QVector<SearchHit> batch;
+    for (int i = 0; i < count; i++) {
+        if (i % kCancelCheckInterval == 0 && superseded()) return;
+
+        quint32 id = scanAll ? quint32(i) : pool[i];
+        if (id == 0 || !matches(id, folded) || !isUnder(id, scope)) continue;
+
+        results.append(id);
+        batch.append({pathOf(id), nodes[id].isDir != 0});
+        if (batch.size() >= kResultBatch) {
+            emit resultsReady(gen, batch);
+            batch.clear();
+        }
+        if (results.size() >= kMaxResults) break;
+    }
+    if (!batch.isEmpty()) {
+        emit resultsReady(gen, batch);
+    }
+
+    if (!partial) {
+        lastText = folded;
+        lastScope = scope;
+        lastResults = results;
+    }
+    emit searchFinished(gen, results.size(), partial);
+}
+
+// One pass over the node array keeping a bounded min-heap on mtime.
+void SearchIndexWorker::runRecentQuery() {
+    const int gen = queryGeneration;
+    const bool partial = queryRanPartial;
+
+    quint32 scope = nodeForPath(queryScope);
+    if (scope == kNoNode || queryLimit <= 0) {
+        emit searchFinished(gen, 0, partial);
+        return;
+    }
+
+    typedef QPair<quint32, quint32> Entry; // mtime, node
+    auto newer = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+    QVector<Entry> heap;
+    heap.reserve(queryLimit);
+
+    for (int id = 1; id < nodes.size(); id++) {
+        if (id % kCancelCheckInterval == 0 && superseded()) return;
+
+        const Node& n = nodes[id];
+        if (n.removed || n.isDir || names.at(int(n.nameOffset)) == '.') continue;
+        if (heap.size() == queryLimit && n.mtime <= heap.first().first) continue;
+
+        // Skip anything inside a hidden directory (caches, dotfiles, VCS data).
+        bool visible = true;
+        bool inScope = scope == 0;
+        for (quint32 up = n.parent; up != 0 && up != kNoNode; up = nodes[up].parent) {
+            if (up == scope) inScope = true;
+            if (names.at(int(nodes[up].nameOffset)) == '.') {
+                visible = false;
+                break;
+            }
+        }
+        if (!visible || !inScope) continue;
+
+        if (heap.size() == queryLimit) {
+            std::pop_heap(heap.begin(), heap.end(), newer);
+            heap.removeLast();
+        }
+        heap.append(Entry(n.mtime, quint32(id)));
+        std::push_heap(heap.begin(), heap.end(), newer);
+    }
+
+    std::sort(heap.begin(), heap.end(), newer);
+    QVector<SearchHit> hits;
+    for (const Entry& entry : qAsConst(heap)) {
+        hits.append({pathOf(entry.second), false});
+    }
+    if (!hits.isEmpty()) {
+        emit resultsReady(gen, hits);
+    }
+    emit searchFinished(gen, hits.size(), partial);
+}
+
+// Intersects the posting lists of every trigram in the query, smallest
+// first. Posting lists are sorted because node ids only ever grow. Nodes
+// loaded from disk but not yet indexed are always candidates.
+QVector<quint32> SearchIndexWorker::candidates(const QString& folded) const {
+    QVector<quint32> result;
+    QVector<const QVector<quint32>*> lists;
+    bool missing = false;
+    for (int i = 0; i + 2 < folded.size(); i++) {
+        auto it = trigrams.constFind(trigramKey(folded[i], folded[i + 1], folded[i + 2]));
+        if (it == trigrams.constEnd()) {
+            missing = true;
+            break;
+        }
+        lists.append(&it.value());
+    }
+
+    if (!missing && !lists.isEmpty()) {
+        std::sort(lists.begin(), lists.end(), [](const QVector<quint32>* a, const QVector<quint32>* b) {
+            return a->size() < b->size();
+        });
+
+        result = *lists.first();
+        QVector<quint32> scratch;
+        for (int i = 1; i < lists.size() && !result.isEmpty(); i++) {
+            scratch.clear();
+            std::set_intersection(result.constBegin(), result.constEnd(),
+                                  lists[i]->constBegin(), lists[i]->constEnd(),
+                                  std::back_inserter(scratch));
+            result.swap(scratch);
+        }
+    }
+
+    for (int id = trigramCount; id < nodes.size(); id++) {
+        result.append(quint32(id));
+    }
+    return result;
+}
+
+bool SearchIndexWorker::matches(quint32 node, const QString& text) const {
+    const Node& n = nodes[node];
+    return !n.removed
+        && QStringRef(&names, int(n.nameOffset), int(n.nameLength)).contains(text, Qt::CaseInsensitive);
+}
+
+bool SearchIndexWorker::isUnder(quint32 node, quint32 ancestor) const {
+    if (ancestor == 0) return true;
+    while (node != kNoNode) {
+        if (node == ancestor) return true;
+        node = nodes[node].parent;
+    }
+    return false;
+}
+
+// SearchIndex
+
+SearchIndex::SearchIndex(QObject *parent)
+    : QObject(parent)
+    , generation(0)
+    , worker(new SearchIndexWorker(&generation))
+{
+    qRegisterMetaType<QVector<SearchHit>>("QVector<SearchHit>");
+
+    worker->moveToThread(&workerThread);
+    connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    connect(worker, &SearchIndexWorker::resultsReady, this, &SearchIndex::resultsReady);
+    connect(worker, &SearchIndexWorker::searchFinished, this, &SearchIndex::searchFinished);
+    connect(worker, &SearchIndexWorker::indexProgress, this, &SearchIndex::indexProgress);
+
+    workerThread.setObjectName("SearchIndex");
+    workerThread.start(QThread::LowPriority);
+}
+
+SearchIndex::~SearchIndex() {
+    generation++;
+    workerThread.quit();
+    workerThread.wait();
+}
+
+void SearchIndex::preload(const QString& root) {
+    QMetaObject::invokeMethod(worker, "preload", Qt::QueuedConnection, Q_ARG(QString, root));
+}
+
+void SearchIndex::refresh(const QString& dir) {
+    QMetaObject::invokeMethod(worker, "refresh", Qt::QueuedConnection, Q_ARG(QString, dir));
+}
+
+int SearchIndex::search(const QString& scope, const QString& text) {
+    int gen = ++generation;
+    QMetaObject::invokeMethod(worker, "search", Qt::QueuedConnection,
+                              Q_ARG(int, gen), Q_ARG(QString, scope), Q_ARG(QString, text));
+    return gen;
+}
+
+int SearchIndex::recent(const QString& scope, int limit) {
+    int gen = ++generation;
+    QMetaObject::invokeMethod(worker, "recent", Qt::QueuedConnection,
+                              Q_ARG(int, gen), Q_ARG(QString, scope), Q_ARG(int, limit));
+    return gen;
+}
+
+void SearchIndex::cancel() {
+    generation++;
+}
+
+void SearchIndex::invalidate() {
+    generation++;
+    QMetaObject::invokeMethod(worker, "invalidate", Qt::QueuedConnection);
+}
@@ -0,0 +1,182 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QThread>
+#include <QString>
+#include <QVector>
+#include <QBitArray>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <atomic>
+#include "watchmanager.h"
+
+struct SearchHit {
+    QString path;
+    bool isDir;
+    // Content search only: 1-based line number and the matching line.
+    int line = 0;
+    QString context;
+};
+
+// Index of every name below a root directory, with size, mtime and type.
+// Persisted under ~/.cache/Lotus-DIR and kept current through inotify.
+// Lives on the search thread; SearchIndex below is its GUI-side handle.
+class SearchIndexWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SearchIndexWorker(std::atomic<int>* generation, QObject *parent = nullptr);
+    ~SearchIndexWorker();
+
+public slots:
+    void preload(const QString& root);
+    void refresh(const QString& dir);
+    void search(int generation, const QString& scope, const QString& text);
+    void recent(int generation, const QString& scope, int limit);
+    void invalidate();
+
+signals:
+    void resultsReady(int generation, const QVector<SearchHit>& hits);
+    void searchFinished(int generation, int matches, bool partial);
+    void indexProgress(int entries, bool done);
+
+private slots:
+    void continueWork();
+    void handleEvents(const QVector<InotifyEvent>& events);
+    void handleOverflow();
+    void handleEviction(int wd);
+    void save();
+
+private:
+    // Written to disk as-is, so keep it plain and fixed-size.
+    struct Node {
+        quint32 parent;
+        quint32 nameOffset;
+        quint32 nameLength : 30;
+        quint32 isDir : 1;
+        quint32 removed : 1;
+        quint32 mtime;
+        qint64 size;
+    };
+
+    enum QueryKind { NoQuery, NameQuery, RecentQuery };
+
+    void ensureRoot(const QString& scope);
+    void startBuild(const QString& root);
+    bool load(const QString& root);
+    void scheduleWork();
+    void scheduleSave();
+    bool isBusy() const;
+    bool isPartial() const;
+
+    void scanDir(quint32 dir);
+    void verifyDir(quint32 dir);
+    void refreshFiles(quint32 dir, const QByteArray& path);
+    quint32 addNode(quint32 parent, const QString& name, bool isDir, qint64 size, quint32 mtime);
+    void indexTrigrams(quint32 node);
+    void removeSubtree(quint32 node);
+    void watchDir(quint32 dir);
+    void reviveScope(const QString& scope);
+    void refreshScope(quint32 scopeNode);
+    quint32 childNamed(quint32 parent, const QString& name) const;
+    quint32 nodeForPath(const QString& path) const;
+    QString nameOf(quint32 node) const;
+    QString pathOf(quint32 node) const;
+
+    void runQuery();
+    void runNameQuery();
+    void runRecentQuery();
+    QVector<quint32> candidates(const QString& folded) const;
+    bool matches(quint32 node, const QString& text) const;
+    bool isUnder(quint32 node, quint32 ancestor) const;
+    bool superseded() const { return generation->load() != queryGeneration; }
+    void contentChanged();
+
+    std::atomic<int>* generation;
+
+    // Index storage: names live in one arena, nodes point into it, and each
+    // directory's children form a singly linked list through nextSibling.
+    QString root;
+    QVector<Node> nodes;
+    QString names;
+    QVector<quint32> firstChild;
+    QVector<quint32> nextSibling;
+    QHash<quint64, QVector<quint32>> trigrams;
+    int trigramCount;
+    // The loaded snapshot, mapped while names may still point into it, and
+    // when it was written
+    const uchar* indexMap;
+    qint64 indexMapSize;
+    qint64 savedAt;
+
+    // Background work, run in time slices so queries can interleave:
+    // walking new directories, indexing names loaded from disk, re-checking
+    // directory mtimes against the loaded snapshot, and re-reading file
+    // sizes and mtimes where a query or the view needs them.
+    QVector<quint32> pendingDirs;
+    QVector<quint32> verifyQueue;
+    QVector<quint32> refreshQueue;
+    // Loaded directories whose files still carry the snapshot's size and
+    // mtime; edits since the save don't touch the directory, so they are
+    // re-statted on first use instead of all at load.
+    QBitArray staleFiles;
+    QSet<quint32> refreshedScopes;
+    bool workScheduled;
+    bool dirty;
+    QTimer* saveTimer;
+
+    WatchManager* watcher;
+    QHash<int, quint32> watchedDirs;
+    QHash<quint32, int> dirWatches;
+    // Directories whose watch was evicted; re-checked when a query needs them
+    QSet<quint32> evictedDirs;
+
+    // Current query, plus the last complete result set for refinement.
+    QueryKind queryKind;
+    int queryGeneration;
+    QString queryScope;
+    QString queryText;
+    int queryLimit;
+    bool queryRanPartial;
+    QString lastText;
+    quint32 lastScope;
+    QVector<quint32> lastResults;
+};
+
+// Runs indexing and queries off the GUI thread. Every query bumps a
+// generation counter; stale queries notice and stop early.
+class SearchIndex : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SearchIndex(QObject *parent = nullptr);
+    ~SearchIndex();
+
+    // Maps in (or starts building) the index for root without querying it.
+    void preload(const QString& root);
+    // The view opened dir: brings its files' sizes and mtimes up to date.
+    void refresh(const QString& dir);
+    int search(const QString& scope, const QString& text);
+    // Most recently modified files below scope, newest first.
+    int recent(const QString& scope, int limit);
+    void cancel();
+    void invalidate();
+
+signals:
+    void resultsReady(int generation, const QVector<SearchHit>& hits);
+    void searchFinished(int generation, int matches, bool partial);
+    void indexProgress(int entries, bool done);
+
+private:
+    QThread workerThread;
+    std::atomic<int> generation;
+    SearchIndexWorker* worker;
+};
+
+Q_DECLARE_METATYPE(SearchHit)
+Q_DECLARE_METATYPE(QVector<SearchHit>)
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,78 @@
+#include "searchresultsmodel.h"
+#include "iconcache.h"
+#include <QDir>
+
+SearchResultsModel::SearchResultsModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int SearchResultsModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : hits.size();
+}
+
+int SearchResultsModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : 3;
+}
+
+QVariant SearchResultsModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= hits.size()) return QVariant();
+
+    const SearchHit& hit = hits.at(index.row());
+    int slash = hit.path.lastIndexOf('/');
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case 0: return hit.line > 0 ? QString("%1:%2").arg(hit.path.mid(slash + 1), QString::number(hit.line))
+                                    : hit.path.mid(slash + 1);
+        case 1: return QDir::toNativeSeparators(slash > 0 ? hit.path.left(slash) : QString("/"));
+        case 2: return hit.context;
+        }
+    }
+
+    if (role == Qt::DecorationRole && index.column() == 0) {
+        const IconCache& icons = IconCache::instance();
+        return icons.iconValue(icons.categoryForName(hit.path, hit.isDir, false));
+    }
+
+    if (role == Qt::ToolTipRole) {
+        return hit.line > 0 ? QString("%1:%2\n%3").arg(hit.path, QString::number(hit.line), hit.context) : hit.path;
+    }
+
+    return QVariant();
+}
+
+QVariant SearchResultsModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return QString("Name");
+        case 1: return QString("Folder");
+        case 2: return QString("Match");
+        }
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void SearchResultsModel::clear() {
+    if (hits.isEmpty()) return;
+    beginResetModel();
+    hits.clear();
+    endResetModel();
+}
+
+void SearchResultsModel::append(const QVector<SearchHit>& batch) {
+    if (batch.isEmpty()) return;
+    beginInsertRows(QModelIndex(), hits.size(), hits.size() + batch.size() - 1);
+    hits += batch;
+    endInsertRows();
+}
+
+QString SearchResultsModel::filePath(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= hits.size()) return QString();
+    return hits.at(index.row()).path;
+}
+
+bool SearchResultsModel::isDir(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= hits.size()) return false;
+    return hits.at(index.row()).isDir;
+}
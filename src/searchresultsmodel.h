@@ -0,0 +1,30 @@
+#ifndef SEARCHRESULTSMODEL_H
+#define SEARCHRESULTSMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include "searchindex.h"
+
+// Flat list of search hits, appended to in batches as the index streams them.
+class SearchResultsModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    explicit SearchResultsModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void clear();
+    void append(const QVector<SearchHit>& hits);
+
+    QString filePath(const QModelIndex& index) const;
+    bool isDir(const QModelIndex& index) const;
+
+private:
+    QVector<SearchHit> hits;
+};
+
+#endif // SEARCHRESULTSMODEL_H
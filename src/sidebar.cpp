@@ -24,15 +24,15 @@ void Sidebar::setupUI() {
     treeWidget->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
     
     // Favorites section - create items first
-    QTreeWidgetItem* airDropItem = createItem("AirDrop", ":/icons/airdrop.png", "airdrop");
-    QTreeWidgetItem* recentsItem = createItem("Recents", ":/icons/recents.png", "recents");
-    QTreeWidgetItem* applicationsItem = createItem("Applications", ":/icons/applications.png", "/usr/share/applications");
-    QTreeWidgetItem* desktopItem = createItem("Desktop", ":/icons/desktop.png", QDir::homePath() + "/Desktop");
-    QTreeWidgetItem* documentsItem = createItem("Documents", ":/icons/documents.png", QDir::homePath() + "/Documents");
-    QTreeWidgetItem* downloadsItem = createItem("Downloads", ":/icons/downloads.png", QDir::homePath() + "/Downloads");
-    QTreeWidgetItem* moviesItem = createItem("Movies", ":/icons/movies.png", QDir::homePath() + "/Movies");
-    QTreeWidgetItem* musicItem = createItem("Music", ":/icons/music.png", QDir::homePath() + "/Music");
-    QTreeWidgetItem* picturesItem = createItem("Pictures", ":/icons/pictures.png", QDir::homePath() + "/Pictures");
+    QTreeWidgetItem* airDropItem = createItem("AirDrop", ":/icons/airdrop.svg", "airdrop");
+    QTreeWidgetItem* recentsItem = createItem("Recents", ":/icons/recents.svg", "recents");
+    QTreeWidgetItem* applicationsItem = createItem("Applications", ":/icons/applications.svg", "/usr/share/applications");
+    QTreeWidgetItem* desktopItem = createItem("Desktop", ":/icons/desktop.svg", QDir::homePath() + "/Desktop");
+    QTreeWidgetItem* documentsItem = createItem("Documents", ":/icons/documents.svg", QDir::homePath() + "/Documents");
+    QTreeWidgetItem* downloadsItem = createItem("Downloads", ":/icons/downloads.svg", QDir::homePath() + "/Downloads");
+    QTreeWidgetItem* moviesItem = createItem("Movies", ":/icons/movies.svg", QDir::homePath() + "/Movies");
+    QTreeWidgetItem* musicItem = createItem("Music", ":/icons/music.svg", QDir::homePath() + "/Music");
+    QTreeWidgetItem* picturesItem = createItem("Pictures", ":/icons/pictures.svg", QDir::homePath() + "/Pictures");
     
     QTreeWidgetItem* favoritesItem = new QTreeWidgetItem(treeWidget);
     favoritesItem->setText(0, "Favorites");
@@ -49,8 +49,8 @@ void Sidebar::setupUI() {
     favoritesItem->addChild(picturesItem);
     
     // Locations section - create items first
-    QTreeWidgetItem* homeItem = createItem("Home", ":/icons/home.png", QDir::homePath());
-    QTreeWidgetItem* computerItem = createItem("Computer", ":/icons/computer.png", "/");
+    QTreeWidgetItem* homeItem = createItem("Home", ":/icons/home.svg", QDir::homePath());
+    QTreeWidgetItem* computerItem = createItem("Computer", ":/icons/computer.svg", "/");
     
     QTreeWidgetItem* locationsItem = new QTreeWidgetItem(treeWidget);
     locationsItem->setText(0, "Locations");
@@ -90,7 +90,7 @@ void Sidebar::handleItemClicked(QTreeWidgetItem* item, int column) {
     if (path == "airdrop") {
         emit navigateTo(QDir::homePath());
     } else if (path == "recents") {
-        emit navigateTo(QDir::homePath());
+        emit showRecents();
     } else if (path == "/usr/share/applications") {
         emit navigateTo(path);
     } else if (name == "Home") {
@@ -18,6 +18,7 @@ signals:
     void navigateToDesktop();
     void navigateToDocuments();
     void navigateToDownloads();
+    void showRecents();
 
 private slots:
     void handleItemClicked(QTreeWidgetItem* item, int column);
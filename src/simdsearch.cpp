@@ -0,0 +1,118 @@
+#include "simdsearch.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOTUS_SIMD_X86 1
+#endif
+
+namespace {
+
+const size_t kBinaryProbeBytes = 8192;
+
+inline char lowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+inline char upperAscii(char c) {
+    return (c >= 'a' && c <= 'z') ? char(c - ('a' - 'A')) : c;
+}
+
+inline bool equalsIgnoreCase(const char* text, const char* needleLower, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (lowerAscii(text[i]) != needleLower[i]) return false;
+    }
+    return true;
+}
+
+const char* findScalar(const char* haystack, size_t size, const char* needle, size_t needleSize, size_t from) {
+    for (size_t i = from; i + needleSize <= size; i++) {
+        if (lowerAscii(haystack[i]) == needle[0] && equalsIgnoreCase(haystack + i + 1, needle + 1, needleSize - 1)) {
+            return haystack + i;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef LOTUS_SIMD_X86
+
+// Compare the first and last needle byte at every offset of a block at once
+// (both cases), and only verify the middle bytes where both ends matched.
+const char* findSse2(const char* haystack, size_t size, const char* needle, size_t needleSize) {
+    const size_t last = needleSize - 1;
+    const __m128i firstLower = _mm_set1_epi8(needle[0]);
+    const __m128i firstUpper = _mm_set1_epi8(upperAscii(needle[0]));
+    const __m128i lastLower = _mm_set1_epi8(needle[last]);
+    const __m128i lastUpper = _mm_set1_epi8(upperAscii(needle[last]));
+
+    size_t i = 0;
+    for (; i + last + 16 <= size; i += 16) {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + last));
+        const __m128i eqFirst = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, firstLower), _mm_cmpeq_epi8(blockFirst, firstUpper));
+        const __m128i eqLast = _mm_or_si128(_mm_cmpeq_epi8(blockLast, lastLower), _mm_cmpeq_epi8(blockLast, lastUpper));
+
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast)));
+        while (mask) {
+            unsigned bit = unsigned(__builtin_ctz(mask));
+            if (needleSize <= 2 || equalsIgnoreCase(haystack + i + bit + 1, needle + 1, needleSize - 2)) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(haystack, size, needle, needleSize, i);
+}
+
+__attribute__((target("avx2")))
+const char* findAvx2(const char* haystack, size_t size, const char* needle, size_t needleSize) {
+    const size_t last = needleSize - 1;
+    const __m256i firstLower = _mm256_set1_epi8(needle[0]);
+    const __m256i firstUpper = _mm256_set1_epi8(upperAscii(needle[0]));
+    const __m256i lastLower = _mm256_set1_epi8(needle[last]);
+    const __m256i lastUpper = _mm256_set1_epi8(upperAscii(needle[last]));
+
+    size_t i = 0;
+    for (; i + last + 32 <= size; i += 32) {
+        const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+        const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + last));
+        const __m256i eqFirst = _mm256_or_si256(_mm256_cmpeq_epi8(blockFirst, firstLower), _mm256_cmpeq_epi8(blockFirst, firstUpper));
+        const __m256i eqLast = _mm256_or_si256(_mm256_cmpeq_epi8(blockLast, lastLower), _mm256_cmpeq_epi8(blockLast, lastUpper));
+
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqLast)));
+        while (mask) {
+            unsigned bit = unsigned(__builtin_ctz(mask));
+            if (needleSize <= 2 || equalsIgnoreCase(haystack + i + bit + 1, needle + 1, needleSize - 2)) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(haystack, size, needle, needleSize, i);
+}
+
+typedef const char* (*FindFunction)(const char*, size_t, const char*, size_t);
+
+FindFunction resolveFind() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? findAvx2 : findSse2;
+}
+
+#endif // LOTUS_SIMD_X86
+
+} // namespace
+
+const char* findIgnoreCase(const char* haystack, size_t size, const char* needleLower, size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) return nullptr;
+
+#ifdef LOTUS_SIMD_X86
+    static const FindFunction find = resolveFind();
+    return find(haystack, size, needleLower, needleSize);
+#else
+    return findScalar(haystack, size, needleLower, needleSize, 0);
+#endif
+}
+
+bool looksBinary(const char* data, size_t size) {
+    return std::memchr(data, 0, size < kBinaryProbeBytes ? size : kBinaryProbeBytes) != nullptr;
+}
@@ -0,0 +1,14 @@
+#ifndef SIMDSEARCH_H
+#define SIMDSEARCH_H
+
+#include <cstddef>
+
+// Byte-level substring search for content search. Matching ignores ASCII
+// case; needleLower must already be lowercased. Uses AVX2 when the CPU has
+// it, SSE2 otherwise, and a scalar loop on other architectures.
+const char* findIgnoreCase(const char* haystack, size_t size, const char* needleLower, size_t needleSize);
+
+// Heuristic used to skip binary files: a NUL byte in the first few KiB.
+bool looksBinary(const char* data, size_t size);
+
+#endif // SIMDSEARCH_H
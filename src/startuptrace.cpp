@@ -0,0 +1,62 @@
+#include "startuptrace.h"
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QObject>
+#include <QTimer>
+#include <QWidget>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const qint64 kFirstPaintTargetMs = 150;
+
+QElapsedTimer clock;
+qint64 lastMarkNs = 0;
+bool enabled = false;
+
+// Waits for the first paint event, then marks once the event loop is idle
+// again, i.e. after the frame has actually been drawn and flushed.
+class FirstPaintFilter : public QObject {
+public:
+    using QObject::QObject;
+
+    bool eventFilter(QObject* watched, QEvent* event) override {
+        if (event->type() == QEvent::Paint) {
+            watched->removeEventFilter(this);
+            QTimer::singleShot(0, [] {
+                StartupTrace::mark("first paint");
+                if (clock.elapsed() > kFirstPaintTargetMs) {
+                    fprintf(stderr, "startup: first paint missed the %lld ms target\n", kFirstPaintTargetMs);
+                }
+            });
+            deleteLater();
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+void StartupTrace::start(int argc, char *argv[]) {
+    clock.start();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--startup-trace") == 0) enabled = true;
+    }
+}
+
+bool StartupTrace::isEnabled() {
+    return enabled;
+}
+
+void StartupTrace::mark(const char* phase) {
+    if (!enabled) return;
+    const qint64 now = clock.nsecsElapsed();
+    fprintf(stderr, "startup: %8.2f ms (+%7.2f ms) %s\n", now / 1e6, (now - lastMarkNs) / 1e6, phase);
+    lastMarkNs = now;
+}
+
+void StartupTrace::watchFirstPaint(QWidget* widget) {
+    if (!enabled) return;
+    widget->installEventFilter(new FirstPaintFilter(widget));
+}
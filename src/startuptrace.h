@@ -0,0 +1,18 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+class QWidget;
+
+// Cold-start timeline, printed to stderr when run with --startup-trace.
+// The clock starts with main(); every mark logs the time since then and
+// since the previous mark, ending with the first paint of the file view.
+class StartupTrace {
+public:
+    static void start(int argc, char *argv[]);
+    static bool isEnabled();
+    static void mark(const char* phase);
+    // Marks "first paint" once the widget has painted for the first time.
+    static void watchFirstPaint(QWidget* widget);
+};
+
+#endif // STARTUPTRACE_H
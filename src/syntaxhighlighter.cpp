@@ -0,0 +1,192 @@
+#include "syntaxhighlighter.h"
+#include <QSet>
+#include <cstring>
+
+namespace {
+
+const QSet<QString>& keywords(SyntaxHighlighter::Language language) {
+    static const QSet<QString> cpp = {
+        "alignas", "alignof", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+        "constexpr", "const_cast", "continue", "decltype", "default", "delete", "do", "double",
+        "dynamic_cast", "else", "enum", "explicit", "extern", "false", "final", "float", "for",
+        "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+        "nullptr", "operator", "override", "private", "protected", "public", "register",
+        "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert",
+        "static_cast", "struct", "switch", "template", "this", "throw", "true", "try", "typedef",
+        "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "while"
+    };
+    static const QSet<QString> python = {
+        "False", "None", "True", "and", "as", "assert", "async", "await", "break", "class",
+        "continue", "def", "del", "elif", "else", "except", "finally", "for", "from", "global",
+        "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return",
+        "self", "try", "while", "with", "yield"
+    };
+    static const QSet<QString> javaScript = {
+        "async", "await", "break", "case", "catch", "class", "const", "continue", "debugger",
+        "default", "delete", "do", "else", "export", "extends", "false", "finally", "for",
+        "function", "if", "import", "in", "instanceof", "let", "new", "null", "of", "return",
+        "static", "super", "switch", "this", "throw", "true", "try", "typeof", "undefined",
+        "var", "void", "while", "with", "yield"
+    };
+    static const QSet<QString> none;
+
+    switch (language) {
+    case SyntaxHighlighter::Cpp: return cpp;
+    case SyntaxHighlighter::Python: return python;
+    case SyntaxHighlighter::JavaScript: return javaScript;
+    default: return none;
+    }
+}
+
+// Position of an ASCII token in the line, or -1.
+int find(const QChar* text, int length, int from, const char* token) {
+    const int tokenLength = int(strlen(token));
+    for (int i = from; i + tokenLength <= length; i++) {
+        int j = 0;
+        while (j < tokenLength && text[i + j] == QLatin1Char(token[j])) j++;
+        if (j == tokenLength) return i;
+    }
+    return -1;
+}
+
+// Index just past the closing quote, or -1 when the line ends first.
+int skipString(const QChar* text, int length, int from, QChar quote) {
+    int i = from;
+    while (i < length) {
+        if (text[i] == QLatin1Char('\\')) {
+            i += 2;
+            continue;
+        }
+        if (text[i] == quote) return i + 1;
+        i++;
+    }
+    return -1;
+}
+
+} // namespace
+
+SyntaxHighlighter::Language SyntaxHighlighter::languageForSuffix(const QString& suffix) {
+    const QString lower = suffix.toLower();
+    if (lower == "cpp" || lower == "c" || lower == "h" || lower == "hpp" || lower == "cc" || lower == "cxx") {
+        return Cpp;
+    }
+    if (lower == "py") return Python;
+    if (lower == "js" || lower == "mjs") return JavaScript;
+    return None;
+}
+
+int SyntaxHighlighter::highlightLine(Language language, const QChar* text, int length, int state, QVector<Span>& spans) {
+    if (language == None) return Normal;
+
+    auto add = [&spans](int start, int end, Format format) {
+        if (end > start) spans.append(Span{start, end - start, format});
+    };
+
+    // Finish whatever the previous line left open
+    int i = 0;
+    if (state == BlockComment) {
+        int end = find(text, length, 0, "*/");
+        if (end < 0) {
+            add(0, length, Comment);
+            return BlockComment;
+        }
+        add(0, end + 2, Comment);
+        i = end + 2;
+    } else if (state == TripleDoubleQuote || state == TripleSingleQuote) {
+        int end = find(text, length, 0, state == TripleDoubleQuote ? "\"\"\"" : "'''");
+        if (end < 0) {
+            add(0, length, String);
+            return state;
+        }
+        add(0, end + 3, String);
+        i = end + 3;
+    } else if (state == TemplateString) {
+        int end = skipString(text, length, 0, QLatin1Char('`'));
+        if (end < 0) {
+            add(0, length, String);
+            return TemplateString;
+        }
+        add(0, end, String);
+        i = end;
+    } else if (language == Cpp) {
+        int first = 0;
+        while (first < length && text[first].isSpace()) first++;
+        if (first < length && text[first] == QLatin1Char('#')) {
+            add(first, length, Preprocessor);
+            return Normal;
+        }
+    }
+
+    const bool cStyle = language == Cpp || language == JavaScript;
+    const QSet<QString>& words = keywords(language);
+    while (i < length) {
+        const QChar c = text[i];
+        const QChar next = i + 1 < length ? text[i + 1] : QChar();
+
+        if (cStyle && c == QLatin1Char('/') && next == QLatin1Char('/')) {
+            add(i, length, Comment);
+            return Normal;
+        }
+        if (cStyle && c == QLatin1Char('/') && next == QLatin1Char('*')) {
+            int end = find(text, length, i + 2, "*/");
+            if (end < 0) {
+                add(i, length, Comment);
+                return BlockComment;
+            }
+            add(i, end + 2, Comment);
+            i = end + 2;
+            continue;
+        }
+        if (language == Python && c == QLatin1Char('#')) {
+            add(i, length, Comment);
+            return Normal;
+        }
+
+        if (c == QLatin1Char('"') || c == QLatin1Char('\'') || (language == JavaScript && c == QLatin1Char('`'))) {
+            if (language == Python && next == c && i + 2 < length && text[i + 2] == c) {
+                const bool doubleQuote = c == QLatin1Char('"');
+                int end = find(text, length, i + 3, doubleQuote ? "\"\"\"" : "'''");
+                if (end < 0) {
+                    add(i, length, String);
+                    return doubleQuote ? TripleDoubleQuote : TripleSingleQuote;
+                }
+                add(i, end + 3, String);
+                i = end + 3;
+                continue;
+            }
+            int end = skipString(text, length, i + 1, c);
+            if (end < 0) {
+                // Only template literals span lines; other strings end with the line
+                add(i, length, String);
+                return c == QLatin1Char('`') ? TemplateString : Normal;
+            }
+            add(i, end, String);
+            i = end;
+            continue;
+        }
+
+        if (c.isDigit()) {
+            int start = i;
+            while (i < length && (text[i].isLetterOrNumber() || text[i] == QLatin1Char('.')
+                                  || text[i] == QLatin1Char('_')
+                                  || (language == Cpp && text[i] == QLatin1Char('\'')))) {
+                i++;
+            }
+            add(start, i, Number);
+            continue;
+        }
+
+        if (c.isLetter() || c == QLatin1Char('_') || c == QLatin1Char('$')) {
+            int start = i;
+            while (i < length && (text[i].isLetterOrNumber() || text[i] == QLatin1Char('_') || text[i] == QLatin1Char('$'))) {
+                i++;
+            }
+            // fromRawData wraps the characters without copying them
+            if (words.contains(QString::fromRawData(text + start, i - start))) add(start, i, Keyword);
+            continue;
+        }
+
+        i++;
+    }
+    return Normal;
+}
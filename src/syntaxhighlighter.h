@@ -0,0 +1,51 @@
+#ifndef SYNTAXHIGHLIGHTER_H
+#define SYNTAXHIGHLIGHTER_H
+
+#include <QString>
+#include <QVector>
+
+// Highlighting for the preview, one line at a time. All that carries over
+// from one line to the next (an open block comment or multi-line string) is
+// a small int, so the viewer can start anywhere in a file from a saved state
+// instead of highlighting everything above the visible lines first.
+class SyntaxHighlighter {
+public:
+    enum Language {
+        None,
+        Cpp,
+        Python,
+        JavaScript
+    };
+
+    enum Format {
+        Plain,
+        Keyword,
+        String,
+        Comment,
+        Number,
+        Preprocessor
+    };
+
+    // Line start states; Normal is also the state at the top of a file.
+    enum State {
+        Normal = 0,
+        BlockComment,
+        TripleDoubleQuote,
+        TripleSingleQuote,
+        TemplateString
+    };
+
+    struct Span {
+        int start;
+        int length;
+        Format format;
+    };
+
+    static Language languageForSuffix(const QString& suffix);
+
+    // Appends the formatted spans of one line (plain text gets none) and
+    // returns the state the next line starts in.
+    static int highlightLine(Language language, const QChar* text, int length, int state, QVector<Span>& spans);
+};
+
+#endif // SYNTAXHIGHLIGHTER_H
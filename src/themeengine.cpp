@@ -0,0 +1,127 @@
+#include "themeengine.h"
+#include <QApplication>
+#include <QDesktopWidget>
+#include <QFile>
+#include <QStringList>
+#include <QStyle>
+#include <QWidget>
+#include <QDebug>
+
+namespace {
+
+const char* const kThemeProperty = "theme";
+
+const char* themeName(ThemeEngine::Theme theme) {
+    return theme == ThemeEngine::Dark ? "dark" : "light";
+}
+
+QString stripComments(const QString& qss) {
+    QString result;
+    result.reserve(qss.size());
+    int i = 0;
+    while (i < qss.size()) {
+        int start = qss.indexOf(QLatin1String("/*"), i);
+        if (start < 0) start = qss.size();
+        result += qss.midRef(i, start - i);
+        int end = qss.indexOf(QLatin1String("*/"), start);
+        i = end < 0 ? qss.size() : end + 2;
+    }
+    return result;
+}
+
+// Restricts one selector to widgets under a window tagged with the theme.
+// Rules aimed at the main window itself get the tag in their first compound
+// instead, ahead of any pseudo-state ("QMainWindow[theme=x]:active").
+QString scopeSelector(const QString& selector, const QString& tag) {
+    if (selector.startsWith(QLatin1String("QMainWindow"))) {
+        int end = 0;
+        while (end < selector.size() && !selector.at(end).isSpace()
+               && selector.at(end) != QLatin1Char(':') && selector.at(end) != QLatin1Char('>')) {
+            end++;
+        }
+        return selector.left(end) + tag + selector.mid(end);
+    }
+    return QStringLiteral("*") + tag + QLatin1Char(' ') + selector;
+}
+
+} // namespace
+
+ThemeEngine& ThemeEngine::instance() {
+    static ThemeEngine engine;
+    return engine;
+}
+
+ThemeEngine::ThemeEngine()
+    : current(Light)
+{
+}
+
+// Rewrites every rule of a theme file with scoped selectors; the
+// declarations are copied through untouched.
+QString ThemeEngine::loadScoped(const QString& resource, const char* name) {
+    QFile file(resource);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to load stylesheet:" << resource;
+        return QString();
+    }
+    const QString qss = stripComments(QString::fromUtf8(file.readAll()));
+    const QString tag = QString("[%1=\"%2\"]").arg(kThemeProperty, name);
+
+    QString scoped;
+    scoped.reserve(qss.size() * 2);
+    int i = 0;
+    while (i < qss.size()) {
+        int open = qss.indexOf(QLatin1Char('{'), i);
+        if (open < 0) break;
+        int close = qss.indexOf(QLatin1Char('}'), open);
+        if (close < 0) break;
+
+        QStringList selectors;
+        for (const QString& selector : qss.mid(i, open - i).split(QLatin1Char(','))) {
+            const QString trimmed = selector.trimmed();
+            if (!trimmed.isEmpty()) selectors.append(scopeSelector(trimmed, tag));
+        }
+        scoped += selectors.join(QLatin1String(", "));
+        scoped += qss.midRef(open, close - open + 1);
+        scoped += QLatin1Char('\n');
+        i = close + 1;
+    }
+    return scoped;
+}
+
+void ThemeEngine::install(QApplication& app, Theme theme) {
+    current = theme;
+    // Tooltips are parented to the desktop's screen widgets, so the desktop
+    // carries the tag for them.
+    attach(QApplication::desktop());
+    app.setStyleSheet(loadScoped(":/qss/light.qss", themeName(Light))
+                      + loadScoped(":/qss/dark.qss", themeName(Dark)));
+}
+
+void ThemeEngine::attach(QWidget* window) const {
+    window->setProperty(kThemeProperty, QString(themeName(current)));
+}
+
+void ThemeEngine::setTheme(Theme theme) {
+    if (theme == current) return;
+    current = theme;
+
+    attach(QApplication::desktop());
+    for (QWidget* window : QApplication::topLevelWidgets()) {
+        attach(window);
+        repolish(window);
+    }
+}
+
+// Property selectors are only re-evaluated on polish (see the Qt style
+// sheet docs), so each widget of the window is unpolished and polished.
+void ThemeEngine::repolish(QWidget* widget) {
+    QStyle* style = widget->style();
+    style->unpolish(widget);
+    style->polish(widget);
+    widget->update();
+
+    for (QWidget* child : widget->findChildren<QWidget*>(QString(), Qt::FindDirectChildrenOnly)) {
+        repolish(child);
+    }
+}
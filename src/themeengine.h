@@ -0,0 +1,37 @@
+#ifndef THEMEENGINE_H
+#define THEMEENGINE_H
+
+#include <QString>
+
+class QApplication;
+class QWidget;
+
+// Both themes, parsed once. At start-up the light and dark style sheets are
+// merged into one application style sheet, each rule scoped to a "theme"
+// property on the top-level windows. Switching only flips that property and
+// re-polishes the widgets under them: the style sheet is never re-parsed,
+// the style caches of other windows survive, and views get a palette change
+// (a repaint) rather than a style change (a relayout of every row).
+class ThemeEngine {
+public:
+    enum Theme { Light, Dark };
+
+    static ThemeEngine& instance();
+
+    // Loads both themes and installs the merged style sheet on the app.
+    void install(QApplication& app, Theme theme);
+    // Tags a new top-level window before it is first polished.
+    void attach(QWidget* window) const;
+    void setTheme(Theme theme);
+    Theme theme() const { return current; }
+
+private:
+    ThemeEngine();
+
+    static QString loadScoped(const QString& resource, const char* name);
+    static void repolish(QWidget* widget);
+
+    Theme current;
+};
+
+#endif // THEMEENGINE_H
@@ -0,0 +1,189 @@
+#include "thumbnailcache.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+#include <QUrl>
+#include <QIcon>
+#include <climits>
+#include <sys/stat.h>
+
+namespace {
+
+// freedesktop.org "normal" size
+const int kThumbnailSize = 128;
+const int kDefaultMemoryBudgetMB = 64;
+const int kMaxPending = 512;
+const int kMaxFailures = 10000;
+const int kMaxHandles = 100000;
+
+QImage readCachedThumbnail(const QString& cachePath, qint64 mtimeSecs) {
+    QImageReader reader(cachePath, "png");
+    if (!reader.canRead()) return QImage();
+    // The spec keys validity on the source mtime stored in the PNG
+    if (reader.text("Thumb::MTime").toLongLong() != mtimeSecs) return QImage();
+    return reader.read();
+}
+
+void writeCachedThumbnail(const QString& cachePath, QImage image, const QByteArray& uri, qint64 mtimeSecs) {
+    // The spec wants the thumbnail folders private to the user: only the
+    // cache folder above them is made with the default permissions
+    const QString sizeDir = QFileInfo(cachePath).absolutePath();
+    const QString thumbnailDir = QFileInfo(sizeDir).absolutePath();
+    QDir().mkpath(QFileInfo(thumbnailDir).absolutePath());
+    ::mkdir(QFile::encodeName(thumbnailDir).constData(), 0700);
+    ::mkdir(QFile::encodeName(sizeDir).constData(), 0700);
+
+    image.setText("Thumb::URI", QString::fromUtf8(uri));
+    image.setText("Thumb::MTime", QString::number(mtimeSecs));
+    image.setText("Software", "Lotus-DIR");
+
+    // Written to a temporary file and renamed, so readers never see half a PNG
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    QImageWriter writer(&file, "png");
+    if (writer.write(image)) file.commit();
+}
+
+// Runs on a pool thread.
+QImage loadThumbnail(const QString& path, qint64 mtime, const QString& thumbnailDir, bool decode) {
+    const qint64 mtimeSecs = mtime / 1000;
+    const QByteArray uri = QUrl::fromLocalFile(path).toEncoded();
+    const QString cachePath = thumbnailDir + "/normal/"
+        + QString::fromLatin1(QCryptographicHash::hash(uri, QCryptographicHash::Md5).toHex()) + ".png";
+
+    QImage image = readCachedThumbnail(cachePath, mtimeSecs);
+    if (!image.isNull() || !decode) return image;
+
+    // Let the decoder scale while decoding (JPEG decodes straight at a
+    // fraction of full size) instead of scaling a full-size image afterwards.
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    QSize size = reader.size();
+    if (size.isValid() && (size.width() > kThumbnailSize || size.height() > kThumbnailSize)) {
+        reader.setScaledSize(size.scaled(kThumbnailSize, kThumbnailSize, Qt::KeepAspectRatio));
+    }
+    image = reader.read();
+    if (image.isNull()) return image;
+
+    // Never thumbnail the thumbnail cache itself
+    if (!path.startsWith(thumbnailDir + "/")) {
+        writeCachedThumbnail(cachePath, image, uri, mtimeSecs);
+    }
+    return image;
+}
+
+} // namespace
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent)
+    , generation(0)
+    , inFlight(0)
+    , thumbnailDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/thumbnails")
+{
+    int budgetMB = QSettings().value("Thumbnails/memoryBudgetMB", kDefaultMemoryBudgetMB).toInt();
+    memory.setMaxCost(qMax(1, budgetMB) * 1024 * 1024);
+
+    // Decoding is CPU-bound; leave cores for the GUI and the listers
+    pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+    maxInFlight = pool.maxThreadCount() * 2;
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    pool.clear();
+    pool.waitForDone();
+}
+
+int ThumbnailCache::handle(const QString& path) {
+    auto it = handles.constFind(path);
+    if (it != handles.constEnd()) return it.value();
+    const int id = paths.size();
+    paths.append(path);
+    handles.insert(path, id);
+    return id;
+}
+
+const QVariant* ThumbnailCache::thumbnail(int handle, qint64 mtime) {
+    if (Entry* entry = memory.object(handle)) {
+        if (entry->mtime == mtime) return &entry->icon;
+        memory.remove(handle);
+    }
+
+    auto failure = failed.constFind(handle);
+    if (failure != failed.constEnd() && failure.value() == mtime) return nullptr;
+
+    if (!queued.contains(handle)) {
+        queued.insert(handle);
+        pending.append(Request{handle, mtime});
+        // Requests nobody looked at for a while belong to rows scrolled far away
+        if (pending.size() > kMaxPending) {
+            queued.remove(pending.first().handle);
+            pending.removeFirst();
+        }
+        startNext();
+    }
+    return nullptr;
+}
+
+void ThumbnailCache::cancelPending() {
+    for (const Request& request : qAsConst(pending)) {
+        queued.remove(request.handle);
+    }
+    pending.clear();
+
+    if (paths.size() > kMaxHandles) {
+        handles.clear();
+        paths.clear();
+        memory.clear();
+        failed.clear();
+        queued.clear();
+        generation++;
+    }
+}
+
+void ThumbnailCache::startNext() {
+    while (inFlight < maxInFlight && !pending.isEmpty()) {
+        // Newest first: the last rows painted are the ones on screen
+        Request request = pending.takeLast();
+        QString path = paths.at(request.handle);
+        // Videos only get thumbnails other programs already made
+        bool decode = IconCache::instance().categoryForName(path, false, false) == IconCache::Image;
+        QString dir = thumbnailDir;
+        int loadGeneration = generation;
+
+        inFlight++;
+        pool.start([this, request, path, decode, dir, loadGeneration]() {
+            QImage image = loadThumbnail(path, request.mtime, dir, decode);
+            QMetaObject::invokeMethod(this, [this, request, loadGeneration, image]() {
+                handleLoaded(request.handle, loadGeneration, request.mtime, image);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void ThumbnailCache::handleLoaded(int handle, int loadGeneration, qint64 mtime, const QImage& image) {
+    inFlight--;
+    if (loadGeneration != generation) {
+        startNext();
+        return;
+    }
+    queued.remove(handle);
+
+    if (image.isNull()) {
+        if (failed.size() >= kMaxFailures) failed.clear();
+        failed.insert(handle, mtime);
+    } else {
+        Entry* entry = new Entry{mtime, QIcon(QPixmap::fromImage(image))};
+        memory.insert(handle, entry, int(qMin<qint64>(image.sizeInBytes(), INT_MAX)));
+        emit thumbnailReady(paths.at(handle));
+    }
+
+    startNext();
+}
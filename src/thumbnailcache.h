@@ -0,0 +1,79 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QThreadPool>
+#include <QVariant>
+#include <QVector>
+#include "iconcache.h"
+
+// Thumbnails for the file views. Lookups never block: a miss queues a load
+// and returns nullptr, and thumbnailReady() follows once it is decoded.
+// Loads check the freedesktop.org cache (~/.cache/thumbnails) first, so
+// thumbnails made by other programs (videos included) are reused; images
+// are decoded at thumbnail size on a small pool and written back there.
+// The newest requests run first, since they are the rows on screen now.
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache();
+
+    static bool canThumbnail(IconCache::Category category) {
+        return category == IconCache::Image || category == IconCache::Video;
+    }
+
+    // A small key for path, so views can keep one per row and look thumbnails
+    // up without building paths. Valid until the next cancelPending().
+    int handle(const QString& path);
+    // The thumbnail as a decoration value, or nullptr while loading or when there is none.
+    // mtime is in msecs since epoch; a changed file gets a new thumbnail.
+    const QVariant* thumbnail(int handle, qint64 mtime);
+    // Drops queued loads, e.g. when the visible folder changes. Once many
+    // paths have been seen this also forgets every handle (and the
+    // thumbnails held under them), so the table can't grow without bound.
+    void cancelPending();
+    // Loads waiting or running
+    int queuedLoads() const { return pending.size() + inFlight; }
+
+signals:
+    void thumbnailReady(const QString& path);
+
+private:
+    struct Request {
+        int handle;
+        qint64 mtime;
+    };
+
+    struct Entry {
+        qint64 mtime;
+        QVariant icon;
+    };
+
+    void startNext();
+    void handleLoaded(int handle, int loadGeneration, qint64 mtime, const QImage& image);
+
+    QHash<QString, int> handles;
+    QVector<QString> paths;
+    // Bumped when the handles are forgotten, so loads still running for
+    // the old ones are dropped
+    int generation;
+
+    // In-memory LRU, costed in bytes of pixel data
+    QCache<int, Entry> memory;
+    QHash<int, qint64> failed;
+
+    QVector<Request> pending;
+    QSet<int> queued;
+    int inFlight;
+    int maxInFlight;
+    QString thumbnailDir;
+    QThreadPool pool;
+};
+
+#endif // THUMBNAILCACHE_H
@@ -0,0 +1,212 @@
+#include "trashbackend.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace {
+
+const QByteArray kInfoSuffix(".trashinfo");
+
+struct Trash {
+    bool valid = false;
+    // Path= entries are relative to this for trashes on other filesystems
+    QByteArray topDir;
+    int filesFd = -1;
+    int infoFd = -1;
+    // Names already used in files/ or info/
+    QSet<QByteArray> names;
+};
+
+QByteArray homeTrashPath() {
+    QByteArray dataHome = qgetenv("XDG_DATA_HOME");
+    if (dataHome.isEmpty()) dataHome = QFile::encodeName(QDir::homePath()) + "/.local/share";
+    return dataHome + "/Trash";
+}
+
+bool makeDir(const QByteArray& path) {
+    return mkdir(path.constData(), 0700) == 0 || errno == EEXIST;
+}
+
+void listNames(int dirFd, QSet<QByteArray>& names, bool stripInfoSuffix) {
+    int fd = dup(dirFd);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    while (dirent* entry = readdir(dir)) {
+        QByteArray name(entry->d_name);
+        if (stripInfoSuffix) {
+            if (!name.endsWith(kInfoSuffix)) continue;
+            name.chop(kInfoSuffix.size());
+        }
+        names.insert(name);
+    }
+    closedir(dir);
+}
+
+// Opens base/files and base/info, creating them as needed, and reads the
+// names in use once, rather than probing for a free name per item.
+bool openTrash(const QByteArray& base, Trash& trash) {
+    if (!makeDir(base) || !makeDir(base + "/files") || !makeDir(base + "/info")) return false;
+
+    trash.filesFd = open((base + "/files").constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    trash.infoFd = open((base + "/info").constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (trash.filesFd < 0 || trash.infoFd < 0) return false;
+
+    listNames(trash.filesFd, trash.names, false);
+    listNames(trash.infoFd, trash.names, true);
+    trash.valid = true;
+    return true;
+}
+
+// The mount point holding path: the highest ancestor still on device.
+QByteArray topDirOf(const QByteArray& path, dev_t device) {
+    QByteArray dir = path;
+    for (;;) {
+        int slash = dir.lastIndexOf('/');
+        if (slash <= 0) return "/";
+        QByteArray parent = dir.left(slash);
+        struct stat st;
+        if (lstat(parent.constData(), &st) != 0 || st.st_dev != device) return dir;
+        dir = parent;
+    }
+}
+
+// $topdir/.Trash/$uid if the admin set up a shared trash, else $topdir/.Trash-$uid.
+bool openTopDirTrash(const QByteArray& topDir, Trash& trash) {
+    const QByteArray prefix = topDir == "/" ? QByteArray() : topDir;
+    const QByteArray uid = QByteArray::number(getuid());
+    trash.topDir = topDir;
+
+    struct stat st;
+    QByteArray shared = prefix + "/.Trash";
+    if (lstat(shared.constData(), &st) == 0 && S_ISDIR(st.st_mode) && (st.st_mode & S_ISVTX)) {
+        if (openTrash(shared + "/" + uid, trash)) return true;
+    }
+    return openTrash(prefix + "/.Trash-" + uid, trash);
+}
+
+QByteArray uniqueName(Trash& trash, const QByteArray& name) {
+    QByteArray base = name;
+    QByteArray ext;
+    int dot = name.lastIndexOf('.');
+    if (dot > 0) {
+        base = name.left(dot);
+        ext = name.mid(dot);
+    }
+
+    QByteArray candidate = name;
+    for (int n = 2; trash.names.contains(candidate); n++) {
+        candidate = base + '.' + QByteArray::number(n) + ext;
+    }
+    trash.names.insert(candidate);
+    return candidate;
+}
+
+bool writeAll(int fd, const QByteArray& data) {
+    const char* p = data.constData();
+    qint64 left = data.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, size_t(left));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+QString trashError(const QByteArray& path, int error) {
+    return QString("Could not move \"%1\" to Trash: %2").arg(QFile::decodeName(path), QString::fromLocal8Bit(strerror(error)));
+}
+
+} // namespace
+
+QStringList TrashBackend::moveToTrash(const QStringList& paths, const Progress& progress) {
+    QStringList errors;
+
+    // Every entry of the batch gets the same deletion date
+    const QByteArray deletionDate = QDateTime::currentDateTime().toString("yyyy-MM-ddThh:mm:ss").toLatin1();
+
+    const QByteArray homeTrash = homeTrashPath();
+    QDir().mkpath(QFile::decodeName(homeTrash));
+    struct stat homeStat;
+    const bool haveHome = stat(homeTrash.constData(), &homeStat) == 0;
+
+    // One trash per device, opened on first use
+    QHash<quint64, Trash> trashes;
+
+    for (const QString& pathString : paths) {
+        const QByteArray path = QFile::encodeName(QDir::cleanPath(QFileInfo(pathString).absoluteFilePath()));
+
+        struct stat st;
+        if (lstat(path.constData(), &st) != 0) {
+            errors.append(trashError(path, errno));
+            if (!progress()) break;
+            continue;
+        }
+
+        const quint64 device = quint64(st.st_dev);
+        if (!trashes.contains(device)) {
+            Trash& trash = trashes[device];
+            if (haveHome && homeStat.st_dev == st.st_dev) {
+                openTrash(homeTrash, trash);
+            } else {
+                openTopDirTrash(topDirOf(path, st.st_dev), trash);
+            }
+        }
+        Trash& trash = trashes[device];
+        if (!trash.valid) {
+            errors.append(QString("Could not move \"%1\" to Trash: no trash folder on its disk").arg(pathString));
+            if (!progress()) break;
+            continue;
+        }
+
+        // Reserve the name with O_EXCL on the info file, as the spec asks,
+        // so a concurrent trasher can never get the same one.
+        const QByteArray fileName = path.mid(path.lastIndexOf('/') + 1);
+        QByteArray name;
+        int infoFile = -1;
+        do {
+            name = uniqueName(trash, fileName);
+            infoFile = openat(trash.infoFd, (name + kInfoSuffix).constData(),
+                              O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        } while (infoFile < 0 && errno == EEXIST);
+        if (infoFile < 0) {
+            errors.append(trashError(path, errno));
+            if (!progress()) break;
+            continue;
+        }
+
+        QByteArray original = path;
+        if (!trash.topDir.isEmpty()) original = path.mid(trash.topDir == "/" ? 1 : trash.topDir.size() + 1);
+        const QByteArray info = "[Trash Info]\nPath=" + original.toPercentEncoding("/")
+            + "\nDeletionDate=" + deletionDate + "\n";
+        const bool written = writeAll(infoFile, info);
+        const int writeError = errno;
+        close(infoFile);
+
+        if (!written || renameat(AT_FDCWD, path.constData(), trash.filesFd, name.constData()) != 0) {
+            errors.append(trashError(path, written ? errno : writeError));
+            unlinkat(trash.infoFd, (name + kInfoSuffix).constData(), 0);
+        }
+        if (!progress()) break;
+    }
+
+    for (const Trash& trash : qAsConst(trashes)) {
+        if (trash.filesFd >= 0) close(trash.filesFd);
+        if (trash.infoFd >= 0) close(trash.infoFd);
+    }
+    return errors;
+}
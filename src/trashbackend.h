@@ -0,0 +1,21 @@
+#ifndef TRASHBACKEND_H
+#define TRASHBACKEND_H
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Moves files to the freedesktop.org trash in batches. Items are grouped by
+// the trash they belong in (the home trash, or $topdir/.Trash-$uid on other
+// filesystems); each trash's files/ and info/ folders are opened and listed
+// once per batch, and every item is then one trashinfo write plus a renameat.
+class TrashBackend {
+public:
+    // Called after every item; return false to stop.
+    using Progress = std::function<bool()>;
+
+    // Returns one error message per item that could not be trashed.
+    static QStringList moveToTrash(const QStringList& paths, const Progress& progress);
+};
+
+#endif // TRASHBACKEND_H
@@ -0,0 +1,145 @@
+#include "watchmanager.h"
+#include <QFile>
+#include <QSettings>
+#include <sys/inotify.h>
+
+namespace {
+
+const int kDefaultMaxWatches = 8192;
+
+} // namespace
+
+std::atomic<int> WatchManager::totalWatches(0);
+
+WatchManager::WatchManager(quint32 mask, int limit, QObject *parent)
+    : QObject(parent)
+    , watcher(new InotifyWatcher(mask, this))
+    , limit(limit)
+{
+    connect(watcher, &InotifyWatcher::eventsReady, this, &WatchManager::handleEvents);
+    connect(watcher, &InotifyWatcher::overflowed, this, &WatchManager::overflowed);
+}
+
+WatchManager::~WatchManager() {
+    // The inotify fd closes with the watcher, taking its watches along
+    totalWatches -= watches.size();
+}
+
+// The configured cap, kept to half the kernel's per-user limit so other
+// applications still get watches of their own.
+int WatchManager::maxWatches() {
+    static const int cap = [] {
+        int configured = QSettings().value("Watches/maxWatches", kDefaultMaxWatches).toInt();
+        QFile limitFile("/proc/sys/fs/inotify/max_user_watches");
+        if (limitFile.open(QIODevice::ReadOnly)) {
+            int kernelLimit = limitFile.readAll().trimmed().toInt();
+            if (kernelLimit > 0) configured = qMin(configured, kernelLimit / 2);
+        }
+        return qMax(1, configured);
+    }();
+    return cap;
+}
+
+int WatchManager::watch(const QString& path, bool pinned) {
+    auto existing = watchesByPath.constFind(path);
+    if (existing != watchesByPath.constEnd()) {
+        const int wd = existing.value();
+        if (pinned) setPinned(wd, true);
+        else touch(wd);
+        return wd;
+    }
+
+    if (!reserveSlot()) return -1;
+    const int wd = watcher->addWatch(path);
+    if (wd < 0) {
+        totalWatches--;
+        return -1;
+    }
+
+    // Another path may resolve to a folder that is already watched
+    if (watches.contains(wd)) {
+        totalWatches--;
+        watches[wd].paths.append(path);
+        watchesByPath.insert(path, wd);
+        if (pinned) setPinned(wd, true);
+        else touch(wd);
+        return wd;
+    }
+
+    Watch entry;
+    entry.pinned = pinned;
+    entry.paths.append(path);
+    entry.use = pinned ? lru.end() : lru.insert(lru.end(), wd);
+    watches.insert(wd, entry);
+    watchesByPath.insert(path, wd);
+    return wd;
+}
+
+void WatchManager::unwatch(int wd) {
+    if (!watches.contains(wd)) return;
+    watcher->removeWatch(wd);
+    forget(wd);
+}
+
+void WatchManager::touch(int wd) {
+    auto it = watches.find(wd);
+    if (it == watches.end() || it->pinned) return;
+    lru.splice(lru.end(), lru, it->use);
+}
+
+void WatchManager::setPinned(int wd, bool pinned) {
+    auto it = watches.find(wd);
+    if (it == watches.end() || it->pinned == pinned) return;
+    it->pinned = pinned;
+    if (pinned) {
+        lru.erase(it->use);
+        it->use = lru.end();
+    } else {
+        it->use = lru.insert(lru.end(), wd);
+    }
+}
+
+// Evicts least recently used watches until one more fits under both caps,
+// and counts it against the process-wide one. Managers on other threads
+// reserve concurrently, so the slot is taken with a compare-and-swap rather
+// than checked first; the caller gives it back if the watch isn't added.
+bool WatchManager::reserveSlot() {
+    while (watches.size() >= limit) {
+        if (!evictOldest()) return false;
+    }
+    int total = totalWatches.load();
+    while (true) {
+        if (total >= maxWatches()) {
+            if (!evictOldest()) return false;
+            total = totalWatches.load();
+        } else if (totalWatches.compare_exchange_weak(total, total + 1)) {
+            return true;
+        }
+    }
+}
+
+bool WatchManager::evictOldest() {
+    if (lru.empty()) return false;
+    const int wd = lru.front();
+    const QString path = watcher->pathForWatch(wd);
+    unwatch(wd);
+    emit evicted(wd, path);
+    return true;
+}
+
+void WatchManager::forget(int wd) {
+    auto it = watches.find(wd);
+    if (it == watches.end()) return;
+    if (!it->pinned) lru.erase(it->use);
+    for (const QString& path : qAsConst(it->paths)) watchesByPath.remove(path);
+    watches.erase(it);
+    totalWatches--;
+}
+
+void WatchManager::handleEvents(const QVector<InotifyEvent>& events) {
+    for (const InotifyEvent& event : events) {
+        // The kernel dropped the watch: the folder is gone or unmounted
+        if (event.mask & IN_IGNORED) forget(event.wd);
+    }
+    emit eventsReady(events);
+}
@@ -0,0 +1,76 @@
+#ifndef WATCHMANAGER_H
+#define WATCHMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <list>
+#include "inotifywatcher.h"
+
+// Bounded set of inotify watches. Folders on screen are pinned; everything
+// else is kept in least-recently-used order and the oldest watch is dropped
+// once the process-wide cap (Watches/maxWatches, shared by every manager)
+// is reached, so long sessions never run into fs.inotify.max_user_watches.
+// Like InotifyWatcher, must live in the thread that consumes its events.
+class WatchManager : public QObject {
+    Q_OBJECT
+
+public:
+    // Watches the search index leaves free for the folder view, which holds
+    // the folder on screen, the one being prefetched and the cached ones.
+    // The index takes the rest of the cap: it watches every folder it has
+    // indexed (as many as fit, least recently queried dropped first), since
+    // a watch is what keeps its results current without rescanning.
+    static const int kViewWatches = 64;
+
+    // `limit` caps this manager on top of the process-wide cap.
+    WatchManager(quint32 mask, int limit, QObject *parent = nullptr);
+    ~WatchManager();
+
+    // Adds a watch, or refreshes an existing one; returns -1 if the cap is
+    // reached and nothing can be evicted.
+    int watch(const QString& path, bool pinned = false);
+    void unwatch(int wd);
+    // Marks a watch as recently used.
+    void touch(int wd);
+    void setPinned(int wd, bool pinned);
+
+    int watchCount() const { return watches.size(); }
+    QString pathForWatch(int wd) const { return watcher->pathForWatch(wd); }
+
+    static int maxWatches();
+
+signals:
+    void eventsReady(const QVector<InotifyEvent>& events);
+    void overflowed();
+    // Dropped to make room; changes below path are no longer reported.
+    void evicted(int wd, const QString& path);
+
+private slots:
+    void handleEvents(const QVector<InotifyEvent>& events);
+
+private:
+    struct Watch {
+        bool pinned;
+        // Every path this folder was watched under
+        QStringList paths;
+        std::list<int>::iterator use;
+    };
+
+    bool reserveSlot();
+    bool evictOldest();
+    void forget(int wd);
+
+    InotifyWatcher* watcher;
+    int limit;
+    QHash<int, Watch> watches;
+    QHash<QString, int> watchesByPath;
+    // Unpinned watches, least recently used first
+    std::list<int> lru;
+
+    static std::atomic<int> totalWatches;
+};
+
+#endif // WATCHMANAGER_H